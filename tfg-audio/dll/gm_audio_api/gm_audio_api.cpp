@@ -4,19 +4,69 @@ DLL para GameMaker basada en miniaudio que ofrece
 - Transport musical (bpm, play/pause/stop y lectura de la posicion en beats)
 - Lanzamiento cuantizado de sonidos al siguiente beat (play_on_beat)
 - Carga de BPM desde un JSON simple (mediante micro-parser con regex)
+- Engine offline sin dispositivo (gm_audio_init_offline + gm_audio_render) para pruebas y perfiles
+- Grabacion opcional de las llamadas a la API en un binario compacto y reproduccion (replay) posterior
+- Estadisticas internas (espera en gMutex...) y benchmark de contencion multihilo
+- Modo de carga de los sonidos (por defecto, decodificado o streaming) y medicion de latencia trigger -> salida
+- Benchmark de precision de cuantizacion (play_on_beat y cancion) con varios bpm, ticks y cambios de tempo
+- Comprobador de tiempo real (GMAUDIO_RT_CHECK, activo en Debug): cuenta reservas de memoria y locks de gMutex
+  hechos desde el hilo de audio
+- Varios transports independientes por handle (funciones _h), cada uno con su bpm, estado y mapa de tempo.
+  El transport 0 es el de la API sin handle
+- Varias canciones/capas a la vez por handle (loop, mute y volumen propios) con voces de pools compartidos
+  por sample y una sola pasada de planificacion (heap) sobre todas las canciones
+- Grupos de stems (musica adaptativa vertical): arrancan en el mismo frame del engine, en streaming, y
+  un parametro de intensidad mueve las curvas de ganancia de cada stem en el hilo de audio
+- Planificacion con lookahead: el tick programa con start time (frame exacto del engine) todo lo que cae
+  en la ventana de lookahead. Transiciones entre canciones y stingers cuantizados al compas
+- Canciones con cambios de compas (timeSignatures) y pistas con su propio ciclo (polimetria),
+  compiladas al cargar en una sola timeline
+- Instrumentos multisample en el JSON de la cancion (zonas de teclas y capas de velocidad), resueltos al
+  cargar a sample y pitch por nota: cada nota usa el sample grabado mas cerca
+- Patrones en memoria (secuenciador por pasos sin JSON): cada edicion es O(1) sobre una copia
+  pendiente que la cancion adopta al empezar su siguiente vuelta
+- Seek del transport: recoloca los cursores de las canciones con busqueda binaria, vuelve a armar las
+  voces que deberian estar sonando y lleva los stems a su frame
+- Puntos de loop (intro + loop en un archivo) en frames o beats, por API o desde metadatos (chunk smpl
+  del WAV o <archivo>.loop.json). El salto lo hace una fuente propia sobre el data source, sin voces extra
+- Playlists de musica sin huecos: la siguiente pista se abre en segundo plano y se programa con start
+  time en el frame exacto en que acaba la actual (opcionalmente con crossfade)
+- Transiciones de musica alineadas al transport 0: la pista nueva entra en fase en un limite de la
+  rejilla de beats con un crossfade de potencia constante de N beats calculado en el hilo de audio
+- Automatizacion de parametros (volumen, pan, pitch, intensidad de stems, master y bus de musica) con
+  curvas lineales, exponenciales o bezier en beats, por API o en el JSON de la cancion. El hilo de
+  audio la evalua en cada bloque contra el reloj del transport
+- LFOs sincronizados al tempo (seno, triangulo, cuadrada, sample and hold) sobre volumen, pan, pitch
+  o el corte de un filtro paso bajo por sonido, evaluados tambien por bloque en el hilo de audio
+- Juicio de entradas ritmicas: el timestamp de la pulsacion se pasa al reloj de audio (con la latencia
+  de salida y la calibracion del jugador) y se busca la nota mas cercana del carril en el chart
+- Charts en JSON o binario con las notas ordenadas por carril: la ventana visible se consulta en
+  O(log n + k) a un buffer de GML y los mismos datos sirven al juicio de entradas
+- Analisis de archivos en un hilo de trabajo (fuera del engine) con cache en memoria y opcionalmente en
+  disco: picos de la forma de onda para editores (min/max con SSE2), envolvente RMS (p.ej. a 100 Hz)
+  que se consulta en O(1) en el cursor de un sonido sin coste en el hilo de audio y deteccion de
+  onsets (flujo espectral) y de tempo y fase (autocorrelacion) para sincronizar musica cualquiera
+- Delays como bus de efecto con el tiempo en beats del transport (p.ej. corchea con puntillo): siguen los
+  cambios de tempo con un deslizamiento suave del tiempo de retardo y todos los envios comparten una
+  sola instancia
 
 Cuestiones:
 - Thread-safety: se usa un mutex global (gMutex) para proteger todos los estados compartidos (mapas, colas y el transport)
 - Transport: se calcula el beat como baseBeat + dt*(bpm/60). baseBeat se actualiza al pausar/cambiar bpm para evitar saltos
+  Con mapa de tempo el dt se integra por tramos entre los puntos del mapa
 - Cuantizacion: se programa un lanzamiento con targetBeat un tick (llamado desde GML en Step) libera los sonidos cuya hora haya llegado.
+  El tick mira gLookaheadSec por delante y arranca cada sonido en el frame que corresponde a su beat (no en el tick).
 - JSON: se busca el campo "bpm" con regular expresions.
+- Offline: sin dispositivo el reloj del transport es el tiempo del engine (frames renderizados), no el reloj de pared.
 
 Requisitos:
-- GameMaker debe llamar a gm_audio_transport_tick() cada Step si usa cuantizacion.
+- GameMaker debe llamar a gm_audio_transport_tick() cada Step si usa cuantizacion o playlists.
 */
 
 #define MINIAUDIO_IMPLEMENTATION
-#include "miniaudio.h"
+// miniaudio.h de upstream con los parches de patches/ ya aplicados: lo genera antes de compilar
+// miniaudio_patches.targets en $(IntDir)miniaudio (ver patches/README.md). Va con <> para no coger el de esta carpeta sin parchear
+#include <miniaudio.h>
 
 #include <unordered_map>
 #include <vector>
@@ -29,6 +79,22 @@ Requisitos:
 #include <sstream>
 #include <regex>
 #include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <initializer_list>
+#include <random>
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <sys/stat.h>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define GMAUDIO_SSE2 1
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////////////
 // Estado global del engine y recursos basicos
@@ -37,13 +103,198 @@ Requisitos:
 // Motor de miniaudio
 static ma_engine gEngine;
 static bool gEngineIniciado = false;
+// true si el engine se inicio sin dispositivo: el audio solo avanza con gm_audio_render
+static bool gEngineOffline = false;
+
+// Flags de carga para gm_audio_play / play_on_beat (0, MA_SOUND_FLAG_DECODE o MA_SOUND_FLAG_STREAM)
+static std::atomic<ma_uint32> gLoadFlags{ 0 };
+
+// Tap de captura sobre la salida del engine: se llama desde el hilo de audio con cada bloque mezclado
+// (frames entrelazados en f32). Debe ser rapido y no bloquear
+typedef void (*CaptureTapProc)(void* pUserData, const float* pFrames, ma_uint64 frameCount, ma_uint32 channels);
+static std::atomic<CaptureTapProc> gCaptureTap{ nullptr };
+static void* gCaptureTapUserData = nullptr;
+
+// Nodo que emite silencio continuamente hacia el endpoint. Sin el, cuando no suena nada el grafo
+// no produce frames y el reloj del engine se para (y con el el transport offline y los start_time)
+static void clock_node_process(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut) {
+    (void)ppFramesIn;
+    (void)pFrameCountIn;
+    ma_silence_pcm_frames(ppFramesOut[0], *pFrameCountOut, ma_format_f32, ma_node_get_output_channels(pNode, 0));
+}
+
+static ma_node_vtable gClockNodeVtable = { clock_node_process, NULL, 0, 1, 0 };
+static ma_node_base gClockNode;
+// true solo si gClockNode se inicio y esta enganchado al endpoint (solo entonces se libera)
+static bool gClockNodeReady = false;
+
+// Si falla, el nodo no entra en el grafo: el engine funciona igual, pero su reloj se para en silencio
+static bool clock_node_init() {
+    ma_uint32 channels = ma_engine_get_channels(&gEngine);
+    ma_node_config nc = ma_node_config_init();
+    nc.vtable = &gClockNodeVtable;
+    nc.inputBusCount = 0;
+    nc.outputBusCount = 1;
+    nc.pOutputChannels = &channels;
+    if (ma_node_init(ma_engine_get_node_graph(&gEngine), &nc, NULL, &gClockNode) != MA_SUCCESS) return false;
+    if (ma_node_attach_output_bus(&gClockNode, 0, ma_engine_get_endpoint(&gEngine), 0) != MA_SUCCESS) {
+        ma_node_uninit(&gClockNode, NULL);
+        return false;
+    }
+    return true;
+}
+
+static void clock_node_uninit() {
+    if (!gClockNodeReady) return;
+    ma_node_uninit(&gClockNode, NULL);
+    gClockNodeReady = false;
+}
+
+// Evaluacion de la automatizacion en el hilo de audio (seccion AUTOMATIZACION)
+static void automation_process();
+
+// onProcess del engine: se ejecuta al final de cada ma_engine_read_pcm_frames (hilo de audio)
+static void engine_on_process(void* pUserData, float* pFramesOut, ma_uint64 frameCount) {
+    (void)pUserData;
+    CaptureTapProc tap = gCaptureTap.load(std::memory_order_acquire);
+    if (tap) tap(gCaptureTapUserData, pFramesOut, frameCount, ma_engine_get_channels(&gEngine));
+    automation_process();
+}
 
 // Mapas de sonidos activos y su posicion pausada (en frames PCM)
 static std::unordered_map<int, ma_sound*> gSounds;
 static std::unordered_map<int, ma_uint64> gPausedFrame;
+// Archivo de cada sonido de gSounds (para encontrar su envolvente precalculada)
+static std::unordered_map<int, std::string> gSoundPaths;
 
 // protege todas las estructuras globales mediante mutex
 static std::mutex gMutex;
+
+// Contadores internos consultables con gm_audio_stats_get
+struct Stats {
+    std::atomic<ma_uint64> lockAcquires{ 0 };
+    std::atomic<ma_uint64> lockContended{ 0 };
+    std::atomic<ma_uint64> lockWaitNs{ 0 };
+    std::atomic<ma_uint64> lockWaitMaxNs{ 0 };
+    // violaciones de tiempo real desde el hilo de audio (solo con GMAUDIO_RT_CHECK)
+    std::atomic<ma_uint64> rtAllocs{ 0 };
+    std::atomic<ma_uint64> rtFrees{ 0 };
+    std::atomic<ma_uint64> rtLocks{ 0 };
+} static gStats;
+
+////////////////////////////////////////////////////////////////////////////////////////
+// COMPROBADOR DE TIEMPO REAL (GMAUDIO_RT_CHECK)
+// - el hilo de audio se marca mientras mezcla (callback del dispositivo o gm_audio_render)
+// - desde ese hilo se cuentan: reservas/liberaciones (new/delete globales de la DLL y
+//   allocation callbacks de miniaudio) y cada lock de gMutex
+// - con trap activado (gm_audio_rtcheck_set_trap) la primera violacion para el depurador
+////////////////////////////////////////////////////////////////////////////////////////
+#ifdef GMAUDIO_RT_CHECK
+static thread_local bool tAudioThread = false;
+static std::atomic<bool> gRtTrap{ false };
+
+static inline void rt_violation(std::atomic<ma_uint64>& counter) {
+    if (!tAudioThread) return;
+    counter.fetch_add(1, std::memory_order_relaxed);
+    if (gRtTrap.load(std::memory_order_relaxed)) {
+#ifdef _MSC_VER
+        __debugbreak();
+#else
+        abort();
+#endif
+    }
+}
+
+// Marca el hilo actual como hilo de audio durante el scope
+struct AudioThreadScope {
+    bool prev;
+    AudioThreadScope() : prev(tAudioThread) { tAudioThread = true; }
+    ~AudioThreadScope() { tAudioThread = prev; }
+};
+
+static void* rt_malloc(size_t sz, void* pUserData) {
+    (void)pUserData;
+    rt_violation(gStats.rtAllocs);
+    return malloc(sz);
+}
+static void* rt_realloc(void* p, size_t sz, void* pUserData) {
+    (void)pUserData;
+    rt_violation(gStats.rtAllocs);
+    return realloc(p, sz);
+}
+static void rt_free(void* p, void* pUserData) {
+    (void)pUserData;
+    if (p) rt_violation(gStats.rtFrees);
+    free(p);
+}
+
+// Rellena los allocation callbacks de miniaudio con las versiones que cuentan
+static void rt_set_allocation_callbacks(ma_engine_config& cfg) {
+    cfg.allocationCallbacks.onMalloc = rt_malloc;
+    cfg.allocationCallbacks.onRealloc = rt_realloc;
+    cfg.allocationCallbacks.onFree = rt_free;
+}
+#else
+struct AudioThreadScope {
+    AudioThreadScope() {}
+};
+static inline void rt_set_allocation_callbacks(ma_engine_config&) {}
+#endif
+
+// Lock de gMutex que mide la espera. Si el try_lock entra a la primera no se toca el reloj
+struct MutexGuard {
+    MutexGuard() {
+#ifdef GMAUDIO_RT_CHECK
+        rt_violation(gStats.rtLocks);
+#endif
+        gStats.lockAcquires.fetch_add(1, std::memory_order_relaxed);
+        if (gMutex.try_lock()) return;
+        const auto t0 = std::chrono::steady_clock::now();
+        gMutex.lock();
+        const ma_uint64 ns = (ma_uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - t0).count();
+        gStats.lockContended.fetch_add(1, std::memory_order_relaxed);
+        gStats.lockWaitNs.fetch_add(ns, std::memory_order_relaxed);
+        ma_uint64 prev = gStats.lockWaitMaxNs.load(std::memory_order_relaxed);
+        while (ns > prev && !gStats.lockWaitMaxNs.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {}
+    }
+    ~MutexGuard() { gMutex.unlock(); }
+    MutexGuard(const MutexGuard&) = delete;
+    MutexGuard& operator=(const MutexGuard&) = delete;
+};
+
+// Reloj de pared en microsegundos (steady_clock) con el que se comparan los timestamps de entrada
+static inline double wall_time_us() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Instante de pared (us) en que el dispositivo pidio el frame 0 del engine, estimado en cada callback:
+// un callback nunca llega antes de tiempo, asi que se baja de golpe y se sube poco a poco (deriva)
+static std::atomic<double> gAudioAnchorUs{ 0.0 };
+static std::atomic<bool> gAudioAnchorValid{ false };
+
+static void audio_anchor_update(ma_engine* engine, double nowUs) {
+    const double frameUs = (double)ma_engine_get_time_in_pcm_frames(engine) * 1e6 / (double)ma_engine_get_sample_rate(engine);
+    const double measured = nowUs - frameUs;
+    const double anchor = gAudioAnchorUs.load(std::memory_order_relaxed);
+    if (!gAudioAnchorValid.load(std::memory_order_relaxed) || measured < anchor || measured - anchor > 20000.0) {
+        gAudioAnchorUs.store(measured, std::memory_order_relaxed);
+        gAudioAnchorValid.store(true, std::memory_order_release);
+    }
+    else {
+        gAudioAnchorUs.store(anchor + (measured - anchor) / 64.0, std::memory_order_relaxed);
+    }
+}
+
+// Callback del dispositivo: igual que el interno de miniaudio pero marcando el hilo de audio
+static void engine_data_callback(ma_device* pDevice, void* pFramesOut, const void* pFramesIn, ma_uint32 frameCount) {
+    (void)pFramesIn;
+    AudioThreadScope audioThread;
+    ma_engine* engine = (ma_engine*)pDevice->pUserData;
+    audio_anchor_update(engine, wall_time_us());
+    ma_engine_read_pcm_frames(engine, pFramesOut, frameCount, NULL);
+}
+
 // generador atomico de IDS
 static std::atomic<int> gNextId{ 1 };
 static inline int makeId() { return gNextId.fetch_add(1); }
@@ -52,23 +303,209 @@ static inline int makeId() { return gNextId.fetch_add(1); }
 
 ////////////////////////////////////////////////////////////////////////////////////////
 // TRANSPORT MUSICAL bpm y reloj de beats
-// - bpm: tempo
+// - bpm: tempo base (el que rige antes del primer punto del mapa de tempo)
 // - baseBeat: acumulado hasta el ultimo play/pause/cambio de bpm
 // - startTime: instante en que se reanudo para integrar el dt
+// - tempoMap: cambios de tempo en beats concretos, ordenados por beat
+// - hay un transport por defecto (handle 0, el de la API sin _h) y los creados por handle
 ////////////////////////////////////////////////////////////////////////////////////////
+struct TempoPoint {
+    double beat;
+    double bpm;
+};
+
 struct Transport {
     std::atomic<bool> playing{ false };
     std::atomic<double> bpm{ 120.0 };
     double baseBeat = 0.0;
     std::chrono::high_resolution_clock::time_point startTime;
-} static gTransport;
+    std::vector<TempoPoint> tempoMap;
+    double tickBeat = 0.0;      // beat calculado al principio de cada tick
+    double horizonBeat = 0.0;   // beat al final de la ventana de lookahead de ese tick
+    // Reloj para el hilo de audio (seqlock, lo escribe el tick y cada cambio del transport):
+    // beat en el frame clockFrame del engine y beats por frame, que pasan a clockRate2 en clockSplit
+    // (el siguiente punto del mapa de tempo)
+    std::atomic<ma_uint32> clockSeq{ 0 };
+    std::atomic<ma_uint64> clockFrame{ 0 };
+    std::atomic<double> clockBeat{ 0.0 };
+    std::atomic<double> clockRate{ 0.0 };
+    std::atomic<double> clockSplit{ INFINITY };
+    std::atomic<double> clockRate2{ 0.0 };
+};
+
+static Transport gTransport;
+static std::unordered_map<int, std::unique_ptr<Transport>> gTransports;
+
+// Ventana de lookahead del tick en segundos y frame del engine al empezar el tick
+static double gLookaheadSec = 0.05;
+static ma_uint64 gTickFrame = 0;
+
+// Busca un transport por handle (0 = por defecto). nullptr si no existe
+static Transport* transport_find_unlocked(double h) {
+    const int id = (int)h;
+    if (id == 0) return &gTransport;
+    auto it = gTransports.find(id);
+    return (it != gTransports.end()) ? it->second.get() : nullptr;
+}
+
+// Reloj del transport. Con engine offline se usa el tiempo del engine (frames renderizados)
+// para que el resultado sea determinista e independiente de la velocidad de render
+static inline std::chrono::high_resolution_clock::time_point transport_now() {
+    using clock = std::chrono::high_resolution_clock;
+    if (gEngineOffline) {
+        const double sec = (double)ma_engine_get_time_in_pcm_frames(&gEngine) / (double)ma_engine_get_sample_rate(&gEngine);
+        return clock::time_point(std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(sec)));
+    }
+    return clock::now();
+}
+
+// Primer punto del mapa de tempo con beat > 'beat'
+static inline std::vector<TempoPoint>::const_iterator tempo_map_after(const Transport& t, double beat) {
+    return std::upper_bound(t.tempoMap.begin(), t.tempoMap.end(), beat,
+        [](double b, const TempoPoint& p) { return b < p.beat; });
+}
+
+// Tempo vigente en un beat
+static inline double transport_bpm_at(const Transport& t, double beat) {
+    auto it = tempo_map_after(t, beat);
+    return (it == t.tempoMap.begin()) ? t.bpm.load() : (it - 1)->bpm;
+}
+
+// Beat alcanzado tras 'sec' segundos desde 'beat', integrando por tramos del mapa de tempo
+static double transport_advance(const Transport& t, double beat, double sec) {
+    double bpm = transport_bpm_at(t, beat);
+    for (auto it = tempo_map_after(t, beat); it != t.tempoMap.end(); ++it) {
+        const double secToPoint = (it->beat - beat) * 60.0 / bpm;
+        if (sec < secToPoint) break;
+        sec -= secToPoint;
+        beat = it->beat;
+        bpm = it->bpm;
+    }
+    return beat + sec * (bpm / 60.0);
+}
+
+// Segundos que tarda el transport en ir de b0 a b1 (b1 >= b0) segun el mapa de tempo
+static double transport_seconds_between(const Transport& t, double b0, double b1) {
+    if (b1 <= b0) return 0.0;
+    double bpm = transport_bpm_at(t, b0);
+    double sec = 0.0;
+    for (auto it = tempo_map_after(t, b0); it != t.tempoMap.end() && it->beat < b1; ++it) {
+        sec += (it->beat - b0) * 60.0 / bpm;
+        b0 = it->beat;
+        bpm = it->bpm;
+    }
+    return sec + (b1 - b0) * 60.0 / bpm;
+}
+
+// Pasa n beats a segundos desde el beat 0 segun el mapa de tempo (in y out pueden ser el mismo array)
+// Acumula los segundos de cada tramo una vez y luego cada beat es una busqueda en los tramos; si los
+// beats vienen ordenados (lo normal en una ventana visible) el tramo anterior casi siempre sirve
+static void transport_beats_to_seconds(const Transport& t, const double* in, double* out, size_t n) {
+    struct Seg { double beat, sec, spb; };
+    std::vector<Seg> segs;
+    segs.reserve(t.tempoMap.size() + 1);
+    segs.push_back(Seg{ 0.0, 0.0, 60.0 / transport_bpm_at(t, 0.0) });
+    for (auto it = tempo_map_after(t, 0.0); it != t.tempoMap.end(); ++it) {
+        const Seg& prev = segs.back();
+        segs.push_back(Seg{ it->beat, prev.sec + (it->beat - prev.beat) * prev.spb, 60.0 / it->bpm });
+    }
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const double b = in[i];
+        const bool inSeg = b >= segs[k].beat && (k + 1 == segs.size() || b < segs[k + 1].beat);
+        if (!inSeg) {
+            auto it = std::upper_bound(segs.begin(), segs.end(), b, [](double v, const Seg& s) { return v < s.beat; });
+            k = (it == segs.begin()) ? 0 : (size_t)(it - segs.begin()) - 1;
+        }
+        out[i] = segs[k].sec + (b - segs[k].beat) * segs[k].spb;
+    }
+}
 
 // calcula el beat actual SIN tomar el mutex (se asume que el llamador ya bloqueo)
+static inline double transport_get_beat_unlocked(const Transport& t) {
+    if (!t.playing.load()) return t.baseBeat;
+    const double dt = std::chrono::duration<double>(transport_now() - t.startTime).count();
+    return t.baseBeat + ((t.tempoMap.empty()) ? dt * (t.bpm.load() / 60.0) : transport_advance(t, t.baseBeat, dt) - t.baseBeat);
+}
+
 static inline double transport_get_beat_unlocked() {
-    if (!gTransport.playing.load()) return gTransport.baseBeat;
-    using clock = std::chrono::high_resolution_clock;
-    const double dt = std::chrono::duration<double>(clock::now() - gTransport.startTime).count();
-    return gTransport.baseBeat + dt * (gTransport.bpm.load() / 60.0);
+    return transport_get_beat_unlocked(gTransport);
+}
+
+// Frame del engine en el que el transport llega a 'beat' (segun el beat y frame del tick actual)
+// Un beat ya pasado devuelve el frame del tick: suena cuanto antes
+static inline ma_uint64 transport_beat_to_frame_unlocked(const Transport& t, double beat) {
+    if (beat <= t.tickBeat) return gTickFrame;
+    const double sec = transport_seconds_between(t, t.tickBeat, beat);
+    return gTickFrame + (ma_uint64)(sec * (double)ma_engine_get_sample_rate(&gEngine) + 0.5);
+}
+
+// Publica el reloj del transport para el hilo de audio (el caller debe tomar gMutex)
+static void transport_clock_publish_unlocked(Transport& t) {
+    if (!gEngineIniciado) return;
+    const double sr = (double)ma_engine_get_sample_rate(&gEngine);
+    const ma_uint64 frame = ma_engine_get_time_in_pcm_frames(&gEngine);
+    const double beat = transport_get_beat_unlocked(t);
+    const bool playing = t.playing.load();
+    const double rate = playing ? transport_bpm_at(t, beat) / 60.0 / sr : 0.0;
+    auto next = tempo_map_after(t, beat);
+    const bool split = playing && next != t.tempoMap.end();
+    const ma_uint32 seq = t.clockSeq.load(std::memory_order_relaxed);
+    t.clockSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    t.clockFrame.store(frame, std::memory_order_relaxed);
+    t.clockBeat.store(beat, std::memory_order_relaxed);
+    t.clockRate.store(rate, std::memory_order_relaxed);
+    t.clockSplit.store(split ? next->beat : INFINITY, std::memory_order_relaxed);
+    t.clockRate2.store(split ? next->bpm / 60.0 / sr : rate, std::memory_order_relaxed);
+    t.clockSeq.store(seq + 2, std::memory_order_release);
+}
+
+// Beat del transport en un frame del engine segun el ultimo reloj publicado. Sin locks: para el hilo de audio
+static double transport_clock_beat(const Transport& t, ma_uint64 frame) {
+    for (;;) {
+        const ma_uint32 seq = t.clockSeq.load(std::memory_order_acquire);
+        if (seq & 1u) continue;
+        const double df = (double)(ma_int64)(frame - t.clockFrame.load(std::memory_order_relaxed));
+        const double beat = t.clockBeat.load(std::memory_order_relaxed);
+        const double rate = t.clockRate.load(std::memory_order_relaxed);
+        const double split = t.clockSplit.load(std::memory_order_relaxed);
+        const double rate2 = t.clockRate2.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (t.clockSeq.load(std::memory_order_relaxed) != seq) continue;
+        double b = beat + df * rate;
+        if (b > split && rate > 0.0) b = split + (df - (split - beat) / rate) * rate2;
+        return b;
+    }
+}
+
+// Arranca un sonido en un frame del engine (limpia un stop time anterior)
+// fromFrame es la posicion dentro del sonido desde la que empieza (0 = el principio)
+static void sound_schedule_start(ma_sound* s, ma_uint64 startFrame, ma_uint64 fromFrame = 0) {
+    ma_sound_stop(s);
+    ma_sound_seek_to_pcm_frame(s, fromFrame);
+    ma_sound_set_stop_time_in_pcm_frames(s, ~(ma_uint64)0);
+    ma_sound_set_start_time_in_pcm_frames(s, startFrame);
+    ma_sound_start(s);
+}
+
+// Cambia el tempo ya manteniendo la continuidad del beat
+// Sin mapa de tempo cambia el bpm base; con mapa, anade un punto en el beat actual
+static void transport_set_tempo_unlocked(Transport& t, double bpm) {
+    const double current = transport_get_beat_unlocked(t);
+    if (t.tempoMap.empty()) {
+        t.bpm.store(bpm);
+    }
+    else {
+        auto it = std::lower_bound(t.tempoMap.begin(), t.tempoMap.end(), current,
+            [](const TempoPoint& p, double b) { return p.beat < b; });
+        if (it != t.tempoMap.end() && std::fabs(it->beat - current) < 1e-9) it->bpm = bpm;
+        else t.tempoMap.insert(it, TempoPoint{ current, bpm });
+    }
+    // reancla el reloj al instante actual manteniendo el beat
+    t.baseBeat = current;
+    if (t.playing.load()) t.startTime = transport_now();
+    transport_clock_publish_unlocked(t);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -76,27 +513,16 @@ static inline double transport_get_beat_unlocked() {
 // - se programa un sonido para un beat objetivo (targetBeat)
 // - el tick (desde GML) verifica cuando dispararlo
 ////////////////////////////////////////////////////////////////////////////////////////
-struct ActiveVoice {
-    ma_sound* sound = nullptr;
-    int id = 0;
-};
-
-struct PendingStop {
-    ma_sound* voice = nullptr;
-    double endBeat = 0.0;
-};
-
 struct PendingLaunch {
     int id;
     double targetBeat;
+    int transport;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////
 // UTILDADES DE ARCHIVO Y PARSER JSON
 ////////////////////////////////////////////////////////////////////////////////////////
 static std::vector<PendingLaunch> gQueue;
-static std::vector<ActiveVoice> gActiveVoices;
-static std::vector<PendingStop> gPendingStops;
 static std::vector<ma_sound*> gPendingDelete;
 
 // Lee un archivo de texto completo a memoria
@@ -129,8 +555,15 @@ static std::string path_dirname(const std::string& p) {
     size_t i = p.find_last_of("/\\");
     return (i == std::string::npos) ? std::string() : p.substr(0, i + 1);
 }
+// Ruta absoluta: con letra de unidad (C:...), o empezando por \ o / (incluye UNC \\servidor\...)
+static bool path_is_absolute(const std::string& p) {
+    if (p.empty()) return false;
+    if (p[0] == '\\' || p[0] == '/') return true;
+    return p.size() >= 2 && p[1] == ':' && std::isalpha((unsigned char)p[0]);
+}
+// Une b a la carpeta a. Una b absoluta (p.ej. working_directory + "x.wav" desde GML) se deja igual
 static std::string path_join(const std::string& a, const std::string& b) {
-    if (a.empty()) return b;
+    if (a.empty() || path_is_absolute(b)) return b;
     if (b.empty()) return a;
     char last = a.back();
     if (last == '\\' || last == '/') return a + b;
@@ -167,727 +600,6545 @@ static void schedule_sound_delete(ma_sound* s) {
     gPendingDelete.push_back(s);
 }
 
+// Fuente de loop de un sonido de archivo (PUNTOS DE LOOP): se libera despues de su ma_sound_uninit
+static void loop_source_release(ma_sound* s);
+// Seek hecho desde aqui de un sonido parado y si ya tiene datos en su posicion (PUNTOS DE LOOP)
+static void sound_seek_stopped_unlocked(ma_sound* s, ma_uint64 pos);
+static bool sound_data_ready_unlocked(ma_sound* s);
+
+// Destruye los ma_sound pendientes (el caller debe tomar gMutex)
+static void flush_pending_deletes_unlocked() {
+    for (ma_sound* s : gPendingDelete) {
+        if (s) {
+            ma_sound_stop(s);
+            ma_sound_uninit(s);
+            loop_source_release(s);
+            delete s;
+        }
+    }
+    gPendingDelete.clear();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// POOLS DE VOCES COMPARTIDOS
+// - un pool por sample (ruta completa): todas las canciones que lo usan comparten sus voces
+// - las voces no se destruyen al acabar la nota, se reutilizan (nada de init/uninit por nota)
+// - si todas estan sonando y el pool esta lleno se roba la disparada hace mas tiempo
+// - los pools viven hasta gm_audio_shutdown
+////////////////////////////////////////////////////////////////////////////////////////
+struct PoolVoice {
+    ma_sound* sound = nullptr;
+    ma_uint32 gen = 0;      // numero de disparo (la de gen menor es la mas antigua)
+    int song = -1;          // cancion que la disparo por ultima vez
+    float vel = 1.0f;
+    ma_uint64 startFrame = 0;   // frame programado: hasta entonces la voz esta reservada aunque no suene
+};
+
+struct VoicePool {
+    std::string path;
+    std::vector<PoolVoice> voices;  // reservado a kPoolMaxVoices: los punteros a voces son estables
+};
+
+static const size_t kPoolMaxVoices = 16;
+static std::unordered_map<std::string, std::unique_ptr<VoicePool>> gVoicePools;
+static ma_uint32 gVoiceGen = 0;
+
+// Crea una voz del pool. Decodificada: todas las voces comparten el PCM del resource manager
+static PoolVoice* voice_pool_add_unlocked(VoicePool& p) {
+    if (p.voices.size() >= kPoolMaxVoices) return nullptr;
+    ma_sound* s = new ma_sound();
+    if (ma_sound_init_from_file(&gEngine, p.path.c_str(), MA_SOUND_FLAG_DECODE, NULL, NULL, s) != MA_SUCCESS) {
+        delete s;
+        return nullptr;
+    }
+    p.voices.push_back(PoolVoice{ s });
+    return &p.voices.back();
+}
+
+// Devuelve el pool de un sample (lo crea con una voz si no existe). nullptr si el archivo no carga
+static VoicePool* voice_pool_get_unlocked(const std::string& path) {
+    auto it = gVoicePools.find(path);
+    if (it != gVoicePools.end()) return it->second.get();
+    std::unique_ptr<VoicePool> p(new VoicePool());
+    p->path = path;
+    p->voices.reserve(kPoolMaxVoices);
+    if (!voice_pool_add_unlocked(*p)) return nullptr;
+    VoicePool* raw = p.get();
+    gVoicePools[path] = std::move(p);
+    return raw;
+}
+
+// Voz libre del pool: una parada, una nueva si cabe, o la mas antigua
+static PoolVoice* voice_pool_acquire_unlocked(VoicePool& p) {
+    PoolVoice* oldest = nullptr;
+    const ma_uint64 now = ma_engine_get_time_in_pcm_frames(&gEngine);
+    for (auto& v : p.voices) {
+        if (!ma_sound_is_playing(v.sound) && v.startFrame <= now) return &v;
+        if (!oldest || v.gen < oldest->gen) oldest = &v;
+    }
+    PoolVoice* v = voice_pool_add_unlocked(p);
+    return v ? v : oldest;
+}
+
+// Libera todos los pools (el caller debe tomar gMutex)
+static void voice_pools_clear_unlocked() {
+    for (auto& kv : gVoicePools) {
+        for (auto& v : kv.second->voices) {
+            ma_sound_stop(v.sound);
+            schedule_sound_delete(v.sound);
+        }
+    }
+    gVoicePools.clear();
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////
 // SECUENCIADOR DE CANCION
+// - cada cancion tiene su timeline ordenada por beat y un cursor
+// - la cancion dura bars compases; cada compas tiene los beats de su cambio de compas (timeSignatures)
+// - las pistas (tracks) se repiten cada 'cycle' beats. Al cargar se despliegan en una sola timeline
+//   de cycleBeats beats (el mcm de la duracion y los ciclos con loop): el tick no ve las pistas.
+//   Una cancion cuyo mcm no cabe en la rejilla de 1/960 o sale demasiado largo no se carga
+// - la cancion 0 es la de la API sin handle; el resto se crean con gm_audio_song_create
 ////////////////////////////////////////////////////////////////////////////////////////
 struct SongEvent {
     std::string path;
-    ma_sound* sound = nullptr;
+    VoicePool* pool = nullptr;
     double offsetBeat = 0.0;
-    double nextBeat = 0.0;
     double dur = 0.0;
     float vel = 1.0f;
-    bool active = true;
+    float pitch = 1.0f;
 };
 
 struct Song {
     bool loaded = false;
     bool loop = false;
-    int beatsPerBar = 4;
-    int bars = 1;
+    bool playing = false;
+    bool muted = false;
+    float volume = 1.0f;
+    double lengthBeats = 4.0;       // duracion de la cancion (suma de sus compases)
+    double cycleBeats = 4.0;        // periodo de la timeline compilada (multiplo de lengthBeats con loop)
+    std::vector<double> barStarts{ 0.0 };  // beat de inicio de cada compas dentro de la cancion
     double startBeat = 0.0;
-    std::vector<SongEvent> events;
-} static gSong;
+    int transport = 0;      // handle del transport que sigue la cancion
+    std::string baseDir;    // carpeta del JSON: las rutas de la cancion (eventos, stingers) son relativas a ella
+    std::vector<SongEvent> events;  // timeline
+    size_t cursor = 0;              // siguiente evento de la timeline
+    double cycleStart = 0.0;        // beat en que empezo la vuelta actual de la timeline
+    // Corte cuantizado (transicion o stinger): en holdFrom se cortan las voces y no se dispara nada
+    // hasta holdUntil (infinito = la cancion acaba ahi). Opcionalmente suena un stinger en holdFrom
+    double holdFrom = INFINITY;
+    double holdUntil = -INFINITY;
+    bool holdCutPending = false;
+    VoicePool* stinger = nullptr;
+    // Seek: ended distingue una cancion que llego a su final (un seek hacia atras la recupera) de
+    // una parada con stop. rearm pide al tick que vuelva a armar las voces que deberian sonar
+    bool ended = false;
+    bool rearm = false;
+    double tailSec = 0.0;   // lo que mas dura un evento de la timeline (sample / pitch), en segundos
+    // Patron en memoria: un evento por paso (pool nullptr = paso vacio). Las ediciones van a
+    // pendingEvents y se intercambian con events al empezar la siguiente vuelta; dirtySteps son los
+    // pasos que hay que copiar de vuelta a la copia pendiente tras el intercambio
+    bool pattern = false;
+    std::vector<SongEvent> pendingEvents;
+    std::vector<ma_uint32> dirtySteps;
+};
 
-static bool json_extract_bool(const std::string& txt, const char* key, bool& out) {
-    std::regex re(std::string("\"") + key + R"("\s*:\s*(true|false))", std::regex::icase);
-    std::smatch m;
-    if (std::regex_search(txt, m, re) && m.size() >= 2) {
-        std::string v = m[1].str();
-        out = (v == "true" || v == "TRUE");
-        return true;
-    }
-    return false;
+static Song gSong;
+static std::unordered_map<int, std::unique_ptr<Song>> gSongs;
+
+// Busca una cancion por handle (0 = por defecto). nullptr si no existe
+static Song* song_find_unlocked(double h) {
+    const int id = (int)h;
+    if (id == 0) return &gSong;
+    auto it = gSongs.find(id);
+    return (it != gSongs.end()) ? it->second.get() : nullptr;
 }
 
-static bool json_extract_int(const std::string& txt, const char* key, int& out) {
-    std::regex re(std::string("\"") + key + R"("\s*:\s*(-?\d+))");
-    std::smatch m;
-    if (std::regex_search(txt, m, re) && m.size() >= 2) {
-        out = std::stoi(m[1].str());
-        return true;
-    }
-    return false;
+// Recorre todas las canciones (la de por defecto y las creadas por handle)
+template <class F>
+static void for_each_song_unlocked(F f) {
+    f(0, gSong);
+    for (auto& kv : gSongs) f(kv.first, *kv.second);
 }
 
-static bool json_extract_events(const std::string& txt, std::vector<SongEvent>& out) {
-    out.clear();
-    const std::regex reFile(R"(\{\s*\"file\"\s*:\s*\"([^\"]+)\"\s*,\s*\"beat\"\s*:\s*([-+]?\d*\.?\d+)\s*(?:,\s*\"dur\"\s*:\s*([-+]?\d*\.?\d+))?\s*(?:,\s*\"vel\"\s*:\s*([-+]?\d*\.?\d+))?\s*\})");
-    const std::regex reNote(R"(\{\s*\"note\"\s*:\s*\"([A-Ga-g][#b]?\-?\d+)\"\s*,\s*\"beat\"\s*:\s*([-+]?\d*\.?\d+)\s*(?:,\s*\"dur\"\s*:\s*([-+]?\d*\.?\d+))?\s*(?:,\s*\"vel\"\s*:\s*([-+]?\d*\.?\d+))?\s*\})");
-    for (auto it = std::sregex_iterator(txt.begin(), txt.end(), reFile); it != std::sregex_iterator(); ++it) {
-        SongEvent ev;
-        ev.path = (*it)[1].str();
-        ev.offsetBeat = std::stod((*it)[2].str());
-        if ((*it).size() >= 3 && (*it)[3].matched) ev.dur = std::stod((*it)[3].str());
-        if ((*it).size() >= 4 && (*it)[4].matched) ev.vel = (float)std::stod((*it)[4].str());
-        out.push_back(ev);
+// Para las voces que ha disparado la cancion (tambien las programadas que aun no suenan)
+static void song_clear_voices_unlocked(int songId) {
+    for (auto& kv : gVoicePools) {
+        for (auto& v : kv.second->voices) {
+            if (v.song == songId) {
+                ma_sound_stop(v.sound);
+                v.startFrame = 0;
+            }
+        }
     }
-    for (auto it = std::sregex_iterator(txt.begin(), txt.end(), reNote); it != std::sregex_iterator(); ++it) {
-        SongEvent ev;
-        ev.path = std::string("NOTE:") + (*it)[1].str();
-        ev.offsetBeat = std::stod((*it)[2].str());
-        if ((*it).size() >= 3 && (*it)[3].matched) ev.dur = std::stod((*it)[3].str());
-        if ((*it).size() >= 4 && (*it)[4].matched) ev.vel = (float)std::stod((*it)[4].str());
-        out.push_back(ev);
+}
+
+// Quita un corte/stinger pendiente
+static void song_clear_hold(Song& s) {
+    s.holdFrom = INFINITY;
+    s.holdUntil = -INFINITY;
+    s.holdCutPending = false;
+    s.stinger = nullptr;
+}
+
+// Rebobina la timeline para que la cancion empiece en startBeat
+static void song_rewind(Song& s, double startBeat) {
+    s.startBeat = startBeat;
+    s.cycleStart = startBeat;
+    s.cursor = 0;
+    s.ended = false;
+    s.rearm = false;
+    song_clear_hold(s);
+}
+
+// Siguiente beat >= fromBeat que cae en beatInBar dentro de un compas de la cancion (los compases
+// se repiten cada lengthBeats). Cuenta desde el inicio de la cancion si esta sonando, si no desde el
+// beat 0 del transport
+static double song_next_bar_beat(const Song& s, double fromBeat, double beatInBar) {
+    const double origin = s.playing ? s.startBeat : 0.0;
+    const double len = s.lengthBeats;
+    const double rel = fromBeat - origin;
+    double cycle = std::floor(rel / len) * len;
+    size_t bar = (size_t)(std::upper_bound(s.barStarts.begin(), s.barStarts.end(), rel - cycle) - s.barStarts.begin());
+    bar = (bar > 0) ? bar - 1 : 0;
+    for (;;) {
+        const double barLen = ((bar + 1 < s.barStarts.size()) ? s.barStarts[bar + 1] : len) - s.barStarts[bar];
+        const double beat = cycle + s.barStarts[bar] + std::fmod(beatInBar, barLen);
+        if (beat >= rel - 1e-9) return origin + beat;
+        if (++bar >= s.barStarts.size()) {
+            bar = 0;
+            cycle += len;
+        }
     }
-    return !out.empty();
 }
 
+// Voz del pool programada en un frame y asignada a una cancion (fromFrame: posicion dentro del sample)
+static PoolVoice* voice_pool_schedule_unlocked(VoicePool& pool, int songId, float vel, float volume, float pitch, ma_uint64 startFrame, ma_uint64 fromFrame = 0) {
+    PoolVoice* v = voice_pool_acquire_unlocked(pool);
+    if (!v) return nullptr;
+    v->gen = ++gVoiceGen;
+    v->song = songId;
+    v->vel = vel;
+    v->startFrame = startFrame;
+    ma_sound_set_volume(v->sound, vel * volume);
+    ma_sound_set_pitch(v->sound, pitch);
+    sound_schedule_start(v->sound, startFrame, fromFrame);
+    return v;
+}
 
+// Aplica el corte de la cancion cuando holdFrom entra en la ventana de lookahead:
+// las voces de la cancion paran en el frame exacto y el stinger (si hay) arranca en ese frame
+static void song_apply_hold_unlocked(int songId, Song& s, const Transport& t) {
+    if (!s.holdCutPending || s.holdFrom > t.horizonBeat) return;
+    const ma_uint64 cutFrame = transport_beat_to_frame_unlocked(t, s.holdFrom);
+    for (auto& kv : gVoicePools) {
+        for (auto& v : kv.second->voices) {
+            if (v.song == songId) ma_sound_set_stop_time_in_pcm_frames(v.sound, cutFrame);
+        }
+    }
+    if (s.stinger) voice_pool_schedule_unlocked(*s.stinger, songId, 1.0f, s.volume, 1.0f, cutFrame);
+    s.stinger = nullptr;
+    s.holdCutPending = false;
+}
 
+// Adopta las ediciones pendientes de un patron (intercambio de buffers + copia de los pasos editados)
+static void song_pattern_commit(Song& s) {
+    s.events.swap(s.pendingEvents);
+    for (ma_uint32 step : s.dirtySteps) s.pendingEvents[step] = s.events[step];
+    s.dirtySteps.clear();
+}
 
+// Beat del siguiente evento de la timeline
+static inline double song_next_beat(const Song& s) {
+    return s.cycleStart + s.events[s.cursor].offsetBeat;
+}
 
+// Programa el evento del cursor en su frame exacto (si no esta en mute ni en un corte) y avanza el cursor
+// Las notas con duracion llevan su stop time. Sin loop, la cancion se apaga cuando el siguiente
+// evento cae fuera de bars compases (o despues de un corte sin vuelta)
+static void song_fire_next_unlocked(int songId, Song& s, const Transport& t) {
+    const SongEvent& ev = s.events[s.cursor];
+    const double beat = song_next_beat(s);
+    const bool held = (beat >= s.holdFrom - 1e-9 && beat < s.holdUntil - 1e-9);
+    if (!s.muted && !held && ev.pool) {
+        PoolVoice* v = voice_pool_schedule_unlocked(*ev.pool, songId, ev.vel, s.volume, ev.pitch, transport_beat_to_frame_unlocked(t, beat));
+        if (v && ev.dur > 1e-9) ma_sound_set_stop_time_in_pcm_frames(v->sound, transport_beat_to_frame_unlocked(t, beat + ev.dur));
+    }
+    if (++s.cursor >= s.events.size()) {
+        s.cursor = 0;
+        s.cycleStart += s.cycleBeats;
+        if (!s.dirtySteps.empty()) song_pattern_commit(s);
+    }
+    const double next = song_next_beat(s);
+    if (!s.loop && (next - s.startBeat) >= s.lengthBeats - 1e-6) s.playing = false;
+    if (s.holdUntil == INFINITY && next >= s.holdFrom - 1e-9) s.playing = false;
+    s.ended = !s.playing;
+}
 
-////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////
-// API C exportada para GameMaker
-////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////
+// Recoloca la cancion en 'beat' del transport sin recorrer la timeline desde el principio:
+// vuelta de la timeline por division y evento por busqueda binaria (O(log n))
+// Para las voces de la cancion; las que deberian seguir sonando las vuelve a armar el tick (rearm)
+static void song_seek_unlocked(int songId, Song& s, double beat) {
+    if (!s.loaded || s.events.empty() || !(s.playing || s.ended)) return;
+    song_clear_voices_unlocked(songId);
+    s.playing = true;
+    s.ended = false;
+    // corte pendiente: despues de una transicion la cancion ya no suena; antes, el corte se vuelve a aplicar
+    if (beat >= s.holdUntil - 1e-9) song_clear_hold(s);
+    else if (beat < s.holdFrom - 1e-9) s.holdCutPending = true;
+    else if (s.holdUntil == INFINITY) {
+        s.playing = false;
+        s.ended = true;
+        return;
+    }
+    const double period = s.cycleBeats;
+    if (beat <= s.startBeat) {
+        s.cycleStart = s.startBeat;
+        s.cursor = 0;
+        return;
+    }
+    const double rel = beat - s.startBeat;
+    if (!s.loop && rel >= s.lengthBeats - 1e-6) {
+        s.playing = false;
+        s.ended = true;
+        return;
+    }
+    const double cycles = std::floor(rel / period);
+    s.cycleStart = s.startBeat + cycles * period;
+    auto it = std::lower_bound(s.events.begin(), s.events.end(), rel - cycles * period - 1e-9,
+        [](const SongEvent& e, double b) { return e.offsetBeat < b; });
+    s.cursor = (size_t)(it - s.events.begin());
+    if (s.cursor >= s.events.size()) {
+        s.cursor = 0;
+        s.cycleStart += period;
+        if (!s.loop && (s.cycleStart - s.startBeat) >= s.lengthBeats - 1e-6) {
+            s.playing = false;
+            s.ended = true;
+            return;
+        }
+    }
+    s.rearm = true;
+}
 
-extern "C" {
+// Tras un seek, arranca en el frame del tick las voces que empezaron antes del cursor y aun deberian
+// sonar, cada una en su posicion dentro del sample. Solo recorre hacia atras los eventos que caen
+// dentro de tailSec (el evento mas largo de la cancion)
+static void song_rearm_unlocked(int songId, Song& s, const Transport& t) {
+    s.rearm = false;
+    if (!s.playing || s.muted) return;
+    const double period = s.cycleBeats;
+    size_t idx = s.cursor;
+    double cycle = s.cycleStart;
+    for (;;) {
+        if (idx == 0) {
+            if (cycle - period < s.startBeat - 1e-9) break;
+            cycle -= period;
+            idx = s.events.size();
+        }
+        const SongEvent& ev = s.events[--idx];
+        const double beat = cycle + ev.offsetBeat;
+        if (beat > t.tickBeat) continue;
+        const double age = transport_seconds_between(t, beat, t.tickBeat);
+        if (age >= s.tailSec) break;
+        if (!ev.pool || (beat >= s.holdFrom - 1e-9 && beat < s.holdUntil - 1e-9)) continue;
+        if (ev.dur > 1e-9 && beat + ev.dur <= t.tickBeat) continue;
+        ma_sound* ref = ev.pool->voices[0].sound;
+        float lenSec = 0.0f;
+        ma_uint32 sr = 0;
+        ma_sound_get_length_in_seconds(ref, &lenSec);
+        ma_sound_get_data_format(ref, NULL, NULL, &sr, NULL, 0);
+        if (age * ev.pitch >= (double)lenSec) continue;
+        PoolVoice* v = voice_pool_schedule_unlocked(*ev.pool, songId, ev.vel, s.volume, ev.pitch, gTickFrame, (ma_uint64)(age * ev.pitch * (double)sr));
+        if (v && ev.dur > 1e-9) ma_sound_set_stop_time_in_pcm_frames(v->sound, transport_beat_to_frame_unlocked(t, beat + ev.dur));
+    }
+}
 
+// Entrada del heap de planificacion: cancion y beats que faltan para su siguiente evento
+struct SongDue {
+    double remaining;
+    int id;
+    Song* song;
+    const Transport* transport;
+    bool operator>(const SongDue& o) const { return remaining > o.remaining; }
+};
+static std::vector<SongDue> gSongHeap;
 
-    // Inicializa miniaudio y limpia estados
-    __declspec(dllexport) double gm_audio_init() {
-        std::lock_guard<std::mutex> lock(gMutex);
-        if (gEngineIniciado) return 1.0;
 
-        ma_result res = ma_engine_init(NULL, &gEngine);
-        if (res == MA_SUCCESS) {
-            gEngineIniciado = true;
+////////////////////////////////////////////////////////////////////////////////////////
+// INSTRUMENTOS MULTISAMPLE
+// - un instrumento de cancion es una lista de zonas: las teclas lo..hi con velocidad velLo..velHi
+//   suenan un sample grabado en la nota baseNote
+// - cada nota se resuelve al cargar la cancion (la timeline guarda el pool y el pitch, el tick no
+//   busca nada): gana la zona mas cercana por teclas, despues por velocidad y despues la de menos
+//   transposicion. Es O(zonas) por nota y exacto tambien con huecos o solapes entre zonas
+// - el "instrument": { "file", "baseNote" } de siempre es una sola zona que cubre todo el teclado
+////////////////////////////////////////////////////////////////////////////////////////
+struct InstrumentZone {
+    std::string file;
+    int baseNote = 60;
+    int lo = 0;
+    int hi = 127;
+    float velLo = 0.0f;
+    float velHi = 1.0f;
+};
 
-            // Resetea estructuras globales
-            gSounds.clear();
-            gPausedFrame.clear();
-            gQueue.clear();
+struct KeyCell {
+    VoicePool* pool = nullptr;
+    float pitch = 1.0f;
+};
 
-            // Transport por defecto
-            gTransport.playing.store(false);
-            gTransport.bpm.store(120.0);
-            gTransport.baseBeat = 0.0;
+struct Instrument {
+    std::vector<InstrumentZone> zones;
+    std::vector<VoicePool*> pools;  // pool de cada zona (vacio hasta instrument_build_unlocked)
+};
 
-            return 1.0;
+// Abre los pools de las zonas. false si no hay zonas o algun sample no carga (el caller debe tomar gMutex)
+static bool instrument_build_unlocked(Instrument& ins, const std::string& baseDir) {
+    ins.pools.clear();
+    if (ins.zones.empty()) return false;
+    for (const InstrumentZone& z : ins.zones) {
+        VoicePool* p = voice_pool_get_unlocked(path_join(baseDir, z.file));
+        if (!p) {
+            ins.pools.clear();
+            return false;
         }
-        return 0.0;
+        ins.pools.push_back(p);
     }
+    return true;
+}
 
-    // Apaga el engine y libera todos los sonidos
-    __declspec(dllexport) double gm_audio_shutdown() {
-        std::lock_guard<std::mutex> lock(gMutex);
-        if (!gEngineIniciado) return 1.0;
-        for (auto& kv : gSounds) {
-            schedule_sound_delete(kv.second);
-        }
-        gSounds.clear();
-        gPausedFrame.clear();
-        gQueue.clear();
-        for (auto& ev : gSong.events) {
-            if (ev.sound) {
-                schedule_sound_delete(ev.sound);
-                ev.sound = nullptr;
-            }
-        }
-        gSong = Song{};
-        for (auto& av : gActiveVoices) {
-            if (av.sound) {
-                ma_sound_stop(av.sound);
-                schedule_sound_delete(av.sound);
-                av.sound = nullptr;
-            }
+// Sample y pitch de una nota MIDI (0..127) a una velocidad. Distancias en teclas y en velocidad a
+// los rangos de cada zona (0 dentro), comparadas en ese orden; empate: menos semitonos de transposicion
+static KeyCell instrument_lookup(const Instrument& ins, int key, float vel) {
+    size_t best = 0;
+    int bestDk = 0, bestDt = 0;
+    float bestDv = 0.0f;
+    for (size_t z = 0; z < ins.zones.size(); ++z) {
+        const InstrumentZone& zn = ins.zones[z];
+        const int dk = (key < zn.lo) ? zn.lo - key : (key > zn.hi) ? key - zn.hi : 0;
+        const float dv = (vel < zn.velLo) ? zn.velLo - vel : (vel > zn.velHi) ? vel - zn.velHi : 0.0f;
+        const int dt = std::abs(key - zn.baseNote);
+        if (z == 0 || dk < bestDk || (dk == bestDk && (dv < bestDv || (dv == bestDv && dt < bestDt)))) {
+            best = z;
+            bestDk = dk;
+            bestDv = dv;
+            bestDt = dt;
         }
-        gActiveVoices.clear();
-        gPendingStops.clear();
-        // NOTA: la destruccin real ocurre en gm_audio_transport_tick()
-        ma_engine_uninit(&gEngine);
-        gEngineIniciado = false;
-        return 1.0;
     }
+    KeyCell cell;
+    cell.pool = ins.pools[best];
+    cell.pitch = (float)pitch_from_semitones((double)(key - ins.zones[best].baseNote), 0.0);
+    return cell;
+}
 
 
+////////////////////////////////////////////////////////////////////////////////////////
+// GRUPOS DE STEMS
+// - hasta kMaxStems sonidos en streaming conectados a un nodo mezclador propio (un bus de
+//   entrada por stem)
+// - play fija el mismo frame de inicio del engine a todos: quedan alineados a la muestra
+// - cada stem tiene una curva de ganancia sobre la intensidad (trapecio: sube entre in0 e in1,
+//   plena hasta out0, baja hasta out1). El nodo evalua las curvas en el hilo de audio con
+//   un suavizado de un polo para que los cambios de intensidad no hagan clics
+// - el streaming lo sirven los hilos de jobs del resource manager, comunes a todos los stems
+////////////////////////////////////////////////////////////////////////////////////////
+static const ma_uint32 kMaxStems = 8;
 
+struct StemCurve {
+    std::atomic<float> in0{ 0.0f };
+    std::atomic<float> in1{ 0.0f };
+    std::atomic<float> out0{ 2.0f };
+    std::atomic<float> out1{ 2.0f };
+};
 
-    ////////////////////////////////////////////////////////////////////////////////////////
-    // REPRODUCCION BASICA
-    ////////////////////////////////////////////////////////////////////////////////////////
+struct StemGroup;
 
-    // Crea y reproduce un sonido desde archivo
-    __declspec(dllexport) double gm_audio_play(const char* path) {
-        if (!gEngineIniciado || path == nullptr) return 0.0;
-        std::lock_guard<std::mutex> lock(gMutex);
-        ma_sound* s = new ma_sound();
-        ma_result res = ma_sound_init_from_file(&gEngine, path, 0, NULL, NULL, s);
-        if (res != MA_SUCCESS) {
-            delete s;
-            return 0.0;
-        }
-        ma_sound_start(s);
-        int id = makeId();
-        gSounds[id] = s;
-        gPausedFrame.erase(id);
-        return (double)id;
-    }
+// Nodo mezclador: ma_node_base tiene que ser el primer miembro
+struct StemMixNode {
+    ma_node_base base;
+    StemGroup* group;
+};
+
+struct StemGroup {
+    StemMixNode node;
+    bool nodeReady = false;
+    std::atomic<float> intensity{ 0.0f };
+    std::atomic<float> smooth{ 1.0f };      // coeficiente del suavizado por muestra
+    std::atomic<ma_uint32> count{ 0 };      // stems conectados (el hilo de audio solo lee hasta aqui)
+    StemCurve curves[kMaxStems];
+    float gains[kMaxStems] = {};            // ganancia actual de cada stem (solo hilo de audio)
+    std::atomic<bool> snapGains{ false };   // el hilo de audio pone 'gains' en su objetivo sin suavizar
+    ma_sound* stems[kMaxStems] = {};
+    bool playing = false;
+    double startBeat = 0.0;                 // beat del transport 0 en el que sono el principio de los stems
+    bool startPending = false;              // stems parados en su posicion esperando a sus seeks
+    ma_uint64 startFrame = 0;               // frame del engine previsto para el arranque
+};
 
+static std::unordered_map<int, std::unique_ptr<StemGroup>> gStemGroups;
+
+// Ganancia de un stem para una intensidad (rampas de potencia constante)
+static inline float stem_curve_gain(const StemCurve& c, float x) {
+    const float in0 = c.in0.load(std::memory_order_relaxed), in1 = c.in1.load(std::memory_order_relaxed);
+    const float out0 = c.out0.load(std::memory_order_relaxed), out1 = c.out1.load(std::memory_order_relaxed);
+    const float halfPi = 1.5707963f;
+    if (x < in0 || x >= out1) return 0.0f;
+    if (x < in1) return std::sin((x - in0) / (in1 - in0) * halfPi);
+    if (x < out0) return 1.0f;
+    return std::cos((x - out0) / (out1 - out0) * halfPi);
+}
 
-    // Detiene y destruye un sonido existente por ID
-    __declspec(dllexport) double gm_audio_stop(double idd) {
-        int id = (int)idd;
-        std::lock_guard<std::mutex> lock(gMutex);
-        auto it = gSounds.find(id);
-        if (it == gSounds.end()) return 0.0;
-        ma_sound_stop(it->second);
-        schedule_sound_delete(it->second);
-        gSounds.erase(it);
-        gPausedFrame.erase(id);
-        return 1.0;
+static void stem_mix_process(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut) {
+    StemGroup* g = ((StemMixNode*)pNode)->group;
+    const ma_uint32 ch = ma_node_get_output_channels(pNode, 0);
+    const ma_uint32 frames = (*pFrameCountIn < *pFrameCountOut) ? *pFrameCountIn : *pFrameCountOut;
+    float* out = ppFramesOut[0];
+    memset(out, 0, (size_t)frames * ch * sizeof(float));
+
+    const float x = g->intensity.load(std::memory_order_relaxed);
+    const float k = g->smooth.load(std::memory_order_relaxed);
+    const ma_uint32 n = g->count.load(std::memory_order_acquire);
+    const bool snap = g->snapGains.exchange(false, std::memory_order_acquire);
+    for (ma_uint32 s = 0; s < n; ++s) {
+        const float target = stem_curve_gain(g->curves[s], x);
+        const float* in = ppFramesIn[s];
+        float gain = snap ? target : g->gains[s];
+        if (gain == target) {
+            if (gain == 0.0f) continue;
+            for (ma_uint32 i = 0; i < frames * ch; ++i) out[i] += in[i] * gain;
+            continue;
+        }
+        for (ma_uint32 f = 0; f < frames; ++f) {
+            gain += (target - gain) * k;
+            for (ma_uint32 c = 0; c < ch; ++c) out[f * ch + c] += in[f * ch + c] * gain;
+        }
+        // cerca del objetivo se fija para volver al camino rapido
+        if (std::fabs(target - gain) < 1e-4f) gain = target;
+        g->gains[s] = gain;
     }
+    *pFrameCountIn = frames;
+    *pFrameCountOut = frames;
+}
 
+static ma_node_vtable gStemMixVtable = { stem_mix_process, NULL, kMaxStems, 1, 0 };
 
-    // Pausa guarda la posicion en frames y para el sonido
+// Coeficiente de suavizado para una constante de tiempo en segundos (0 = inmediato)
+static float stem_smooth_coeff(double seconds) {
+    if (seconds <= 0.0) return 1.0f;
+    return (float)(1.0 - std::exp(-1.0 / (seconds * (double)ma_engine_get_sample_rate(&gEngine))));
+}
+
+// Margen para arrancar stems en el mismo frame: dos periodos del dispositivo (0 offline)
+static ma_uint64 stem_start_lead() {
+    ma_device* dev = ma_engine_get_device(&gEngine);
+    return dev ? 2 * (ma_uint64)dev->playback.internalPeriodSizeInFrames : 0;
+}
+
+// Arranca los stems de un grupo pendiente en cuanto todos tienen datos en su posicion: en
+// g.startFrame o, si algun seek acaba tarde, en el primer frame alcanzable. En ese caso todos entran
+// igual de tarde (siguen alineados a la muestra) y startBeat se corre lo mismo (el caller debe tomar gMutex)
+static void stem_group_try_start_unlocked(StemGroup& g) {
+    if (!g.startPending) return;
+    const ma_uint32 n = g.count.load();
+    for (ma_uint32 s = 0; s < n; ++s) {
+        if (!sound_data_ready_unlocked(g.stems[s])) return;
+    }
+    const ma_uint64 earliest = ma_engine_get_time_in_pcm_frames(&gEngine) + stem_start_lead();
+    ma_uint64 frame = g.startFrame;
+    if (earliest > frame) {
+        if (gTransport.playing.load()) {
+            g.startBeat = transport_advance(gTransport, g.startBeat, (double)(earliest - frame) / (double)ma_engine_get_sample_rate(&gEngine));
+        }
+        frame = earliest;
+    }
+    for (ma_uint32 s = 0; s < n; ++s) ma_sound_set_start_time_in_pcm_frames(g.stems[s], frame);
+    for (ma_uint32 s = 0; s < n; ++s) ma_sound_start(g.stems[s]);
+    g.startPending = false;
+}
+
+// Prepara todos los stems del grupo para arrancar en startFrame, 'sec' segundos dentro de la musica
+// (en loop). Los seeks se hacen ya, y el arranque espera a que acaben todos (stem_group_try_start_unlocked,
+// aqui mismo o en el tick): un stream que arrancase con su seek a medias se quedaria detras de los demas
+static void stem_group_start_unlocked(StemGroup& g, ma_uint64 startFrame, double sec) {
+    const ma_uint32 n = g.count.load();
+    // los stems entran con la ganancia de la intensidad actual, sin rampa desde la de antes
+    g.snapGains.store(true, std::memory_order_release);
+    for (ma_uint32 s = 0; s < n; ++s) {
+        ma_uint32 sr = 0;
+        ma_uint64 len = 0;
+        ma_sound_get_data_format(g.stems[s], NULL, NULL, &sr, NULL, 0);
+        ma_sound_get_length_in_pcm_frames(g.stems[s], &len);
+        ma_uint64 pos = (ma_uint64)(sec * (double)sr);
+        if (len > 0) pos %= len;
+        ma_sound_stop(g.stems[s]);
+        sound_seek_stopped_unlocked(g.stems[s], pos);
+        // el seek del hilo de audio al arrancar ya no tiene nada que hacer, pero deja el tiempo del sonido en pos
+        ma_sound_seek_to_pcm_frame(g.stems[s], pos);
+    }
+    g.playing = (n > 0);
+    g.startPending = g.playing;
+    g.startFrame = startFrame;
+    stem_group_try_start_unlocked(g);
+}
+
+// Lleva un grupo que esta sonando a la posicion de 'beat' del transport t
+// Antes de startBeat los stems esperan (parados en su principio) hasta el frame de startBeat
+static void stem_group_seek_unlocked(StemGroup& g, const Transport& t, double beat) {
+    const double sr = (double)ma_engine_get_sample_rate(&gEngine);
+    const ma_uint64 lead = stem_start_lead();
+    ma_uint64 startFrame = ma_engine_get_time_in_pcm_frames(&gEngine) + lead;
+    const double startAt = t.playing.load() ? transport_advance(t, beat, (double)lead / sr) : beat;
+    if (startAt < g.startBeat) {
+        startFrame += (ma_uint64)(transport_seconds_between(t, startAt, g.startBeat) * sr + 0.5);
+        stem_group_start_unlocked(g, startFrame, 0.0);
+    }
+    else {
+        stem_group_start_unlocked(g, startFrame, transport_seconds_between(t, g.startBeat, startAt));
+    }
+}
+
+// Para y libera los stems y el nodo de un grupo (el caller debe tomar gMutex)
+// Los sonidos se desconectan y uninit aqui mismo: el nodo se libera justo despues
+static void stem_group_release_unlocked(StemGroup& g) {
+    for (ma_uint32 s = 0; s < g.count.load(); ++s) {
+        if (g.stems[s]) {
+            ma_sound_stop(g.stems[s]);
+            ma_sound_uninit(g.stems[s]);
+            loop_source_release(g.stems[s]);
+            delete g.stems[s];
+            g.stems[s] = nullptr;
+        }
+    }
+    g.count.store(0);
+    g.playing = false;
+    g.startPending = false;
+    if (g.nodeReady) ma_node_uninit(&g.node.base, NULL);
+    g.nodeReady = false;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// PLAYLISTS
+// - cada pista se abre en streaming; la siguiente se abre asincrona (el job thread de miniaudio
+//   decodifica sus primeras paginas) en cuanto empieza la actual
+// - en cuanto se conoce su longitud se programa con start time en el frame en que acaba la actual:
+//   el cambio lo hace el hilo de audio, el tick solo tiene que haber pasado antes
+// - con crossfade la siguiente entra xf frames antes con fade in y la actual sale con fade out
+////////////////////////////////////////////////////////////////////////////////////////
+
+struct PlaylistTrack {
+    ma_sound* sound = nullptr;
+    int index = -1;                 // posicion en la lista
+    bool scheduled = false;
+    ma_uint64 startFrame = 0;       // frames del engine
+    ma_uint64 endFrame = 0;
+};
+
+struct Playlist {
+    std::vector<std::string> paths;
+    bool loop = false;
+    bool playing = false;
+    double crossfadeSec = 0.0;
+    int lastIndex = -1;             // ultima pista abierta
+    PlaylistTrack cur, next;
+};
+
+static std::unordered_map<int, std::unique_ptr<Playlist>> gPlaylists;
+
+// Para y manda a borrar el sonido de una pista (el caller debe tomar gMutex)
+static void playlist_close_track_unlocked(PlaylistTrack& t) {
+    if (t.sound) {
+        ma_sound_stop(t.sound);
+        schedule_sound_delete(t.sound);
+    }
+    t = PlaylistTrack{};
+}
+
+// Abre en t la pista que sigue a la ultima abierta. Devuelve false si no quedan pistas
+// Si el archivo no se puede abrir t.sound queda a nullptr (se probara la siguiente)
+static bool playlist_open_following_unlocked(Playlist& p, PlaylistTrack& t, bool async) {
+    if (p.paths.empty()) return false;
+    int idx = p.lastIndex + 1;
+    if (idx >= (int)p.paths.size()) {
+        if (!p.loop) return false;
+        idx = 0;
+    }
+    p.lastIndex = idx;
+    t = PlaylistTrack{};
+    t.index = idx;
+    ma_sound* s = new ma_sound;
+    // sin pitch: el resampler lineal del sonido retrasa un frame el principio y se come el ultimo, y el
+    // resource manager ya decodifica a la frecuencia del engine
+    ma_uint32 flags = MA_SOUND_FLAG_STREAM | MA_SOUND_FLAG_NO_SPATIALIZATION | MA_SOUND_FLAG_NO_PITCH;
+    if (async) flags |= MA_SOUND_FLAG_ASYNC;
+    if (ma_sound_init_from_file(&gEngine, p.paths[idx].c_str(), flags, NULL, NULL, s) != MA_SUCCESS) {
+        delete s;
+        return true;
+    }
+    t.sound = s;
+    return true;
+}
+
+// Longitud de la pista en frames del engine. MA_BUSY mientras se sigue abriendo
+static ma_result playlist_track_length(const PlaylistTrack& t, ma_uint64& out) {
+    ma_result r = ma_sound_get_length_in_pcm_frames(t.sound, &out);
+    if (r != MA_SUCCESS) return r;
+    return (out > 0) ? MA_SUCCESS : MA_INVALID_DATA;
+}
+
+// Avanza la playlist: promociona la siguiente cuando acaba la actual, abre la que viene y la programa
+// en cuanto esta lista (el caller debe tomar gMutex)
+static void playlist_update_unlocked(Playlist& p) {
+    if (!p.playing) return;
+    const ma_uint64 now = ma_engine_get_time_in_pcm_frames(&gEngine);
+    const ma_uint64 lead = stem_start_lead();
+
+    // Pista actual (como mucho unas pocas pistas rotas o ya acabadas por tick)
+    for (int n = 0;; ++n) {
+        if (n == 8) return;
+        if (!p.cur.sound) {
+            if (p.next.sound) {
+                p.cur = p.next;
+                p.next = PlaylistTrack{};
+            }
+            else if (!playlist_open_following_unlocked(p, p.cur, true)) {
+                p.playing = false;
+                return;
+            }
+            if (!p.cur.sound) continue;
+        }
+        if (!p.cur.scheduled) {
+            ma_uint64 len = 0;
+            const ma_result r = playlist_track_length(p.cur, len);
+            if (r == MA_BUSY) return;
+            if (r != MA_SUCCESS) {
+                playlist_close_track_unlocked(p.cur);
+                continue;
+            }
+            p.cur.startFrame = now + lead;
+            p.cur.endFrame = p.cur.startFrame + len;
+            p.cur.scheduled = true;
+            sound_schedule_start(p.cur.sound, p.cur.startFrame);
+        }
+        if (now < p.cur.endFrame) break;
+        playlist_close_track_unlocked(p.cur);
+    }
+
+    // Siguiente pista: se abre en segundo plano y se programa al final de la actual
+    if (!p.next.sound) {
+        if (!playlist_open_following_unlocked(p, p.next, true) || !p.next.sound) return;
+    }
+    if (p.next.scheduled) return;
+    ma_uint64 len = 0;
+    const ma_result r = playlist_track_length(p.next, len);
+    if (r == MA_BUSY) return;
+    if (r != MA_SUCCESS) {
+        playlist_close_track_unlocked(p.next);
+        return;
+    }
+    ma_uint64 xf = (ma_uint64)(p.crossfadeSec * (double)ma_engine_get_sample_rate(&gEngine));
+    xf = std::min(xf, std::min(len, p.cur.endFrame - p.cur.startFrame));
+    p.next.startFrame = std::max(p.cur.endFrame - xf, now + lead);
+    p.next.endFrame = p.next.startFrame + len;
+    p.next.scheduled = true;
+    sound_schedule_start(p.next.sound, p.next.startFrame);
+    if (xf > 0) {
+        // el fade in empieza en el primer frame que procesa la pista (su start time)
+        ma_sound_set_fade_in_pcm_frames(p.next.sound, 0.0f, 1.0f, xf);
+        ma_sound_set_stop_time_with_fade_in_pcm_frames(p.cur.sound, p.cur.endFrame, xf);
+    }
+}
+
+static bool json_extract_bool(const std::string& txt, const char* key, bool& out) {
+    std::regex re(std::string("\"") + key + R"("\s*:\s*(true|false))", std::regex::icase);
+    std::smatch m;
+    if (std::regex_search(txt, m, re) && m.size() >= 2) {
+        std::string v = m[1].str();
+        out = (v == "true" || v == "TRUE");
+        return true;
+    }
+    return false;
+}
+
+static bool json_extract_int(const std::string& txt, const char* key, int& out) {
+    std::regex re(std::string("\"") + key + R"("\s*:\s*(-?\d+))");
+    std::smatch m;
+    if (std::regex_search(txt, m, re) && m.size() >= 2) {
+        out = std::stoi(m[1].str());
+        return true;
+    }
+    return false;
+}
+
+static bool json_extract_number(const std::string& txt, const char* key, double& out) {
+    std::regex re(std::string("\"") + key + R"("\s*:\s*([-+]?\d*\.?\d+(?:[eE][-+]?\d+)?))");
+    std::smatch m;
+    if (std::regex_search(txt, m, re) && m.size() >= 2) {
+        out = std::stod(m[1].str());
+        return true;
+    }
+    return false;
+}
+
+static bool json_extract_events(const std::string& txt, std::vector<SongEvent>& out) {
+    out.clear();
+    const std::regex reFile(R"(\{\s*\"file\"\s*:\s*\"([^\"]+)\"\s*,\s*\"beat\"\s*:\s*([-+]?\d*\.?\d+)\s*(?:,\s*\"dur\"\s*:\s*([-+]?\d*\.?\d+))?\s*(?:,\s*\"vel\"\s*:\s*([-+]?\d*\.?\d+))?\s*\})");
+    const std::regex reNote(R"(\{\s*\"note\"\s*:\s*\"([A-Ga-g][#b]?\-?\d+)\"\s*,\s*\"beat\"\s*:\s*([-+]?\d*\.?\d+)\s*(?:,\s*\"dur\"\s*:\s*([-+]?\d*\.?\d+))?\s*(?:,\s*\"vel\"\s*:\s*([-+]?\d*\.?\d+))?\s*\})");
+    for (auto it = std::sregex_iterator(txt.begin(), txt.end(), reFile); it != std::sregex_iterator(); ++it) {
+        SongEvent ev;
+        ev.path = (*it)[1].str();
+        ev.offsetBeat = std::stod((*it)[2].str());
+        if ((*it).size() >= 3 && (*it)[3].matched) ev.dur = std::stod((*it)[3].str());
+        if ((*it).size() >= 4 && (*it)[4].matched) ev.vel = (float)std::stod((*it)[4].str());
+        out.push_back(ev);
+    }
+    for (auto it = std::sregex_iterator(txt.begin(), txt.end(), reNote); it != std::sregex_iterator(); ++it) {
+        SongEvent ev;
+        ev.path = std::string("NOTE:") + (*it)[1].str();
+        ev.offsetBeat = std::stod((*it)[2].str());
+        if ((*it).size() >= 3 && (*it)[3].matched) ev.dur = std::stod((*it)[3].str());
+        if ((*it).size() >= 4 && (*it)[4].matched) ev.vel = (float)std::stod((*it)[4].str());
+        out.push_back(ev);
+    }
+    return !out.empty();
+}
+
+// Localiza el array "key": [ ... ] con corchetes balanceados (sin contar los que van dentro de
+// cadenas). beg/end delimitan desde "key" hasta el ']' incluido. false si no esta
+static bool json_find_array(const std::string& txt, const char* key, size_t& beg, size_t& end) {
+    std::regex re(std::string("\"") + key + R"("\s*:\s*\[)");
+    std::smatch m;
+    if (!std::regex_search(txt, m, re)) return false;
+    beg = (size_t)m.position(0);
+    int depth = 0;
+    bool inStr = false;
+    for (size_t i = beg + (size_t)m.length(0) - 1; i < txt.size(); ++i) {
+        const char c = txt[i];
+        if (inStr) {
+            if (c == '\\') ++i;
+            else if (c == '"') inStr = false;
+            continue;
+        }
+        if (c == '"') inStr = true;
+        else if (c == '[' || c == '{') ++depth;
+        else if ((c == ']' || c == '}') && --depth == 0) {
+            end = i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Objetos {...} de primer nivel dentro de txt[beg, end)
+static void json_split_objects(const std::string& txt, size_t beg, size_t end, std::vector<std::string>& out) {
+    out.clear();
+    int depth = 0;
+    bool inStr = false;
+    size_t objBeg = 0;
+    for (size_t i = beg; i < end; ++i) {
+        const char c = txt[i];
+        if (inStr) {
+            if (c == '\\') ++i;
+            else if (c == '"') inStr = false;
+            continue;
+        }
+        if (c == '"') inStr = true;
+        else if (c == '{') {
+            if (depth++ == 1) objBeg = i;
+        }
+        else if (c == '[') ++depth;
+        else if (c == '}' || c == ']') {
+            if (--depth == 1 && c == '}') out.push_back(txt.substr(objBeg, i + 1 - objBeg));
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// PUNTOS DE LOOP
+// - loopStart/loopEnd en frames del archivo (a su frecuencia propia, como el chunk smpl). El resource
+//   manager decodifica a la del engine: al aplicarlos se pasan a frames del engine
+// - cada sonido de archivo va envuelto en una fuente propia
+//   (LoopSource) sobre el data source del resource manager que hace ella misma el salto
+//   loopEnd -> loopStart al leer: sin voces extra, sin polling y con miniaudio.h sin tocar
+// - decodificado el salto es un seek. En streaming el seek del stream es asincrono (job thread) y
+//   dejaria un hueco, asi que la fuente sirve desde memoria el principio del loop (ya decodificado al
+//   poner los puntos) mientras el stream hace el seek a lo que viene despues
+// - cambiar los puntos publica una region nueva. La vieja se libera en cuanto el hilo de audio no
+//   puede estar leyendola: al momento si no hay una lectura en curso y si no en el siguiente tick
+// - metadatos al crear el sonido: <archivo>.loop.json al lado del audio o, si no hay, el
+//   chunk smpl del WAV. Un sonido con metadatos de loop queda en loop
+// - sin puntos de loop el loop de todo el archivo lo sigue haciendo el data source de dentro
+////////////////////////////////////////////////////////////////////////////////////////
+struct LoopRegion {
+    ma_uint64 id = 0;               // unico: el hilo de audio compara regiones por id, no por puntero
+    ma_uint64 beg = 0;
+    ma_uint64 end = 0;
+    std::vector<float> head;        // streaming: frames [beg, beg + headFrames) ya decodificados
+    ma_uint64 headFrames = 0;
+};
+
+struct LoopMeta {
+    bool found = false;
+    ma_uint64 beg = 0;
+    ma_uint64 end = 0;
+    std::shared_ptr<const LoopRegion> streamRegion;     // con cabeza, compartida por los streams del archivo
+    ma_uint32 nativeRate = 0;                           // frecuencia propia del archivo (0 = sin mirar)
+};
+
+// Metadatos ya leidos por ruta (se lee el disco una vez por archivo)
+static std::unordered_map<std::string, LoopMeta> gLoopMeta;
+
+struct LoopSource {
+    ma_data_source_base base;
+    ma_resource_manager_data_source inner;
+    std::string path;
+    bool stream = false;
+    ma_uint32 channels = 0;
+    ma_uint32 sampleRate = 0;
+    std::atomic<const LoopRegion*> region{ nullptr };
+    std::shared_ptr<const LoopRegion> current;                  // la publicada en 'region'
+    // sustituidas que el hilo de audio aun podia estar leyendo, con readEpoch al sustituirlas
+    std::vector<std::pair<std::shared_ptr<const LoopRegion>, ma_uint32>> retired;
+    std::atomic<ma_uint32> readEpoch{ 0 };                      // +1 al entrar y al salir de cada lectura: impar = leyendo
+    std::atomic<ma_uint64> cursor{ 0 };                         // posicion logica (la que ve ma_sound_get_cursor)
+    const LoopRegion* headRegion = nullptr;                     // sirviendo la cabeza de esta region (solo hilo de audio)
+    ma_uint64 headId = 0;                                       // id de headRegion (solo hilo de audio)
+};
+
+// Fuente de cada sonido creado con sound_init_from_file_looped (gMutex)
+static std::unordered_map<ma_sound*, std::unique_ptr<LoopSource>> gLoopSources;
+// Fuentes con regiones sustituidas pendientes de liberar (gMutex)
+static int gLoopRetiring = 0;
+static std::atomic<ma_uint64> gNextLoopRegionId{ 1 };
+
+// Salta al principio del loop. El stream se mueve ya a lo que sigue a la cabeza
+static void loop_source_jump(LoopSource* ls, const LoopRegion* rg) {
+    ls->headRegion = (rg->headFrames > 0) ? rg : nullptr;
+    ls->headId = rg->id;
+    ma_data_source_seek_to_pcm_frame(&ls->inner, rg->beg + rg->headFrames);
+    ls->cursor.store(rg->beg, std::memory_order_relaxed);
+}
+
+static ma_result loop_source_read(ma_data_source* pDataSource, void* pFramesOut, ma_uint64 frameCount, ma_uint64* pFramesRead) {
+    LoopSource* ls = (LoopSource*)pDataSource;
+    // seq_cst con el exchange de loop_source_set_region: si alli se ve la epoca par, esta lectura ve la region nueva
+    ls->readEpoch.fetch_add(1);
+    const LoopRegion* rg = ls->region.load();
+    const bool loop = rg != nullptr && ma_data_source_is_looping(pDataSource);
+    float* out = (float*)pFramesOut;
+    ma_uint64 total = 0;
+    ma_result result = MA_SUCCESS;
+    int emptyLoops = 0;
+    // cambiaron los puntos sirviendo la cabeza de los anteriores: el stream vuelve a donde iba. Por id:
+    // headRegion puede estar ya liberada (solo se lee dentro de la lectura que la vio publicada)
+    if (ls->headRegion != nullptr && (rg == nullptr || ls->headId != rg->id)) {
+        ls->headRegion = nullptr;
+        ma_data_source_seek_to_pcm_frame(&ls->inner, ls->cursor.load(std::memory_order_relaxed));
+    }
+    while (total < frameCount) {
+        const ma_uint64 cur = ls->cursor.load(std::memory_order_relaxed);
+        if (loop && cur >= rg->end) {
+            loop_source_jump(ls, rg);
+            continue;
+        }
+        ma_uint64 want = frameCount - total;
+        if (loop) want = std::min(want, rg->end - cur);
+        float* dst = out ? out + total * ls->channels : nullptr;
+        if (ls->headRegion != nullptr) {
+            const LoopRegion* hr = ls->headRegion;
+            if (cur >= hr->beg && cur - hr->beg < hr->headFrames) {
+                const ma_uint64 n = std::min(want, hr->headFrames - (cur - hr->beg));
+                if (dst) memcpy(dst, hr->head.data() + (cur - hr->beg) * ls->channels, (size_t)(n * ls->channels) * sizeof(float));
+                total += n;
+                ls->cursor.store(cur + n, std::memory_order_relaxed);
+                continue;
+            }
+            ls->headRegion = nullptr;   // cabeza acabada: el stream ya esta en lo que sigue
+        }
+        ma_uint64 got = 0;
+        result = ma_data_source_read_pcm_frames(&ls->inner, dst, want, &got);
+        total += got;
+        ma_uint64 c = 0;
+        if (ma_data_source_get_cursor_in_pcm_frames(&ls->inner, &c) != MA_SUCCESS) c = cur + got;
+        ls->cursor.store(c, std::memory_order_relaxed);
+        if (result == MA_AT_END && loop) {
+            // archivo mas corto que loopEnd. Dos vueltas seguidas sin datos: no hay nada que repetir
+            if (got == 0 && ++emptyLoops > 1) break;
+            result = MA_SUCCESS;
+            loop_source_jump(ls, rg);
+            continue;
+        }
+        if (result != MA_SUCCESS || got == 0) break;
+    }
+    if (pFramesRead) *pFramesRead = total;
+    if (result == MA_AT_END && total > 0) result = MA_SUCCESS;
+    ls->readEpoch.fetch_add(1, std::memory_order_release);
+    return result;
+}
+
+// Seek del hilo de audio (ma_sound_seek_to_pcm_frame) o con el sonido parado
+static ma_result loop_source_seek(ma_data_source* pDataSource, ma_uint64 frameIndex) {
+    LoopSource* ls = (LoopSource*)pDataSource;
+    ls->headRegion = nullptr;
+    ls->cursor.store(frameIndex, std::memory_order_relaxed);
+    return ma_data_source_seek_to_pcm_frame(&ls->inner, frameIndex);
+}
+
+static ma_result loop_source_get_data_format(ma_data_source* pDataSource, ma_format* pFormat, ma_uint32* pChannels, ma_uint32* pSampleRate, ma_channel* pChannelMap, size_t channelMapCap) {
+    return ma_data_source_get_data_format(&((LoopSource*)pDataSource)->inner, pFormat, pChannels, pSampleRate, pChannelMap, channelMapCap);
+}
+
+// Parada justo en loopEnd (la lectura acaba ahi y el salto se hace en la siguiente) es loopStart
+static ma_result loop_source_get_cursor(ma_data_source* pDataSource, ma_uint64* pCursor) {
+    LoopSource* ls = (LoopSource*)pDataSource;
+    const LoopRegion* rg = ls->region.load(std::memory_order_acquire);
+    ma_uint64 c = ls->cursor.load(std::memory_order_relaxed);
+    if (rg != nullptr && c >= rg->end && ma_data_source_is_looping(pDataSource)) c = rg->beg;
+    *pCursor = c;
+    return MA_SUCCESS;
+}
+
+static ma_result loop_source_get_length(ma_data_source* pDataSource, ma_uint64* pLength) {
+    return ma_data_source_get_length_in_pcm_frames(&((LoopSource*)pDataSource)->inner, pLength);
+}
+
+// Sin puntos de loop el data source de dentro repite el archivo entero (un stream sin hueco)
+static ma_result loop_source_set_looping(ma_data_source* pDataSource, ma_bool32 isLooping) {
+    return ma_data_source_set_looping(&((LoopSource*)pDataSource)->inner, isLooping);
+}
+
+// Rango y puntos de loop los gestiona la propia fuente: ma_data_source_read_pcm_frames no los aplica
+static ma_data_source_vtable gLoopSourceVtable = {
+    loop_source_read, loop_source_seek, loop_source_get_data_format, loop_source_get_cursor,
+    loop_source_get_length, loop_source_set_looping, MA_DATA_SOURCE_SELF_MANAGED_RANGE_AND_LOOP_POINT
+};
+
+// Abre 'path' en el resource manager con los flags del sonido (MA_SOUND_FLAG_STREAM, _DECODE, _ASYNC)
+static bool loop_source_init(LoopSource& ls, const char* path, ma_uint32 flags) {
+    ma_resource_manager_data_source_config rc = ma_resource_manager_data_source_config_init();
+    rc.pFilePath = path;
+    // como ma_sound_init_from_file: el sonido necesita ya el formato
+    rc.flags = flags | MA_RESOURCE_MANAGER_DATA_SOURCE_FLAG_WAIT_INIT;
+    if (ma_resource_manager_data_source_init_ex(ma_engine_get_resource_manager(&gEngine), &rc, &ls.inner) != MA_SUCCESS) return false;
+    ma_format format = ma_format_unknown;
+    ma_data_source_get_data_format(&ls.inner, &format, &ls.channels, &ls.sampleRate, NULL, 0);
+    ma_data_source_config dc = ma_data_source_config_init();
+    dc.vtable = &gLoopSourceVtable;
+    if (format != ma_format_f32 || ma_data_source_init(&dc, &ls.base) != MA_SUCCESS) {
+        ma_resource_manager_data_source_uninit(&ls.inner);
+        return false;
+    }
+    ls.path = path;
+    ls.stream = (flags & MA_SOUND_FLAG_STREAM) != 0;
+    return true;
+}
+
+// Libera la fuente de un sonido despues de su ma_sound_uninit (el caller debe tomar gMutex)
+static void loop_source_release(ma_sound* s) {
+    auto it = gLoopSources.find(s);
+    if (it == gLoopSources.end()) return;
+    if (!it->second->retired.empty()) gLoopRetiring--;
+    ma_resource_manager_data_source_uninit(&it->second->inner);
+    ma_data_source_uninit(&it->second->base);
+    gLoopSources.erase(it);
+}
+
+// Apagado, antes de ma_engine_uninit: a estas alturas todos los sonidos de archivo estan liberados y
+// gLoopSources deberia estar vacio. Si queda alguna fuente (un sonido que no paso por
+// loop_source_release) se libera aqui: no puede sobrevivir al resource manager de este engine, y su
+// entrada apuntaria a un ma_sound* que un init posterior podria reutilizar (el caller debe tomar gMutex)
+static void loop_sources_clear_unlocked() {
+    for (auto& kv : gLoopSources) {
+        ma_resource_manager_data_source_uninit(&kv.second->inner);
+        ma_data_source_uninit(&kv.second->base);
+    }
+    gLoopSources.clear();
+    gLoopRetiring = 0;
+}
+
+// Mueve un sonido ya parado a 'pos' desde el hilo del juego: un stream empieza a decodificar alli en
+// el job thread sin esperar a que el sonido arranque (el seek de ma_sound lo haria el hilo de audio al
+// arrancar, y el stream daria MA_BUSY hasta que acabe). Antes espera a que acabe una lectura en curso
+static void sound_seek_stopped_unlocked(ma_sound* s, ma_uint64 pos) {
+    auto it = gLoopSources.find(s);
+    if (it != gLoopSources.end()) {
+        while (it->second->readEpoch.load() & 1) std::this_thread::yield();
+    }
+    ma_data_source_seek_to_pcm_frame(ma_sound_get_data_source(s), pos);
+}
+
+// true si el sonido puede sonar ya desde su posicion: un stream cuando su seek ha acabado y tiene
+// la primera pagina decodificada. Los sonidos decodificados lo estan siempre
+static bool sound_data_ready_unlocked(ma_sound* s) {
+    auto it = gLoopSources.find(s);
+    if (it == gLoopSources.end() || !it->second->stream) return true;
+    ma_uint64 avail = 0;
+    return ma_resource_manager_data_source_get_available_frames(&it->second->inner, &avail) == MA_SUCCESS && avail > 0;
+}
+
+// Region de loop [beg, end). Para un stream decodifica aqui (fuera del hilo de audio) su cabeza
+static std::shared_ptr<const LoopRegion> loop_region_make(const LoopSource& ls, ma_uint64 beg, ma_uint64 end) {
+    std::shared_ptr<LoopRegion> r = std::make_shared<LoopRegion>();
+    r->id = gNextLoopRegionId.fetch_add(1, std::memory_order_relaxed);
+    r->beg = beg;
+    r->end = end;
+    if (!ls.stream) return r;
+    // mismo formato que decodifica el resource manager: los frames de la cabeza son los del stream
+    ma_decoder_config dc = ma_decoder_config_init(ma_format_f32, ls.channels, ls.sampleRate);
+    ma_decoder dec;
+    if (ma_decoder_init_file(ls.path.c_str(), &dc, &dec) != MA_SUCCESS) return r;
+    const ma_uint64 want = std::min<ma_uint64>(ls.sampleRate / 4, end - beg);
+    r->head.resize((size_t)(want * ls.channels));
+    ma_uint64 got = 0;
+    if (ma_decoder_seek_to_pcm_frame(&dec, beg) == MA_SUCCESS) ma_decoder_read_pcm_frames(&dec, r->head.data(), want, &got);
+    ma_decoder_uninit(&dec);
+    r->head.resize((size_t)(got * ls.channels));
+    r->headFrames = got;
+    return r;
+}
+
+// Libera las regiones sustituidas que el hilo de audio ya no puede estar leyendo: las de una epoca
+// par (no habia lectura en curso) o de una lectura que ya acabo (el caller debe tomar gMutex)
+static void loop_source_collect(LoopSource& ls) {
+    if (ls.retired.empty()) return;
+    const ma_uint32 epoch = ls.readEpoch.load(std::memory_order_acquire);
+    auto done = [epoch](const std::pair<std::shared_ptr<const LoopRegion>, ma_uint32>& p) {
+        return (p.second & 1) == 0 || p.second != epoch;
+    };
+    ls.retired.erase(std::remove_if(ls.retired.begin(), ls.retired.end(), done), ls.retired.end());
+    if (ls.retired.empty()) gLoopRetiring--;
+}
+
+// Tick: regiones sustituidas mientras el hilo de audio estaba en una lectura (el caller debe tomar gMutex)
+static void loop_sources_collect_unlocked() {
+    if (gLoopRetiring == 0) return;
+    for (auto& kv : gLoopSources) loop_source_collect(*kv.second);
+}
+
+// Publica la region para el hilo de audio y la deja tambien en los puntos de loop del data source
+// (ma_data_source_get_loop_point_in_pcm_frames). El cambio se oye en la siguiente lectura
+static void loop_source_set_region(LoopSource& ls, std::shared_ptr<const LoopRegion> r) {
+    ma_data_source_set_loop_point_in_pcm_frames(&ls.base, r->beg, r->end);
+    ls.region.exchange(r.get());
+    std::shared_ptr<const LoopRegion> old = std::move(ls.current);
+    ls.current = std::move(r);
+    if (!old) return;
+    if (ls.retired.empty()) gLoopRetiring++;
+    ls.retired.emplace_back(std::move(old), ls.readEpoch.load());
+    loop_source_collect(ls);
+}
+
+// Primer loop del chunk smpl de un WAV (el final del chunk es inclusivo)
+static bool wav_read_smpl_loop(const char* path, ma_uint64& beg, ma_uint64& end) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    auto u32 = [](const unsigned char* p) {
+        return (ma_uint32)p[0] | ((ma_uint32)p[1] << 8) | ((ma_uint32)p[2] << 16) | ((ma_uint32)p[3] << 24);
+    };
+    bool found = false;
+    unsigned char hdr[12];
+    if (fread(hdr, 1, 12, f) == 12 && memcmp(hdr, "RIFF", 4) == 0 && memcmp(hdr + 8, "WAVE", 4) == 0) {
+        unsigned char chunk[8];
+        while (fread(chunk, 1, 8, f) == 8) {
+            const ma_uint32 size = u32(chunk + 4);
+            if (memcmp(chunk, "smpl", 4) == 0) {
+                // 36 bytes de cabecera (numSampleLoops en +28) y 24 por loop (start en +8, end en +12)
+                unsigned char smpl[36 + 24];
+                if (size >= sizeof(smpl) && fread(smpl, 1, sizeof(smpl), f) == sizeof(smpl) && u32(smpl + 28) > 0) {
+                    beg = u32(smpl + 36 + 8);
+                    end = (ma_uint64)u32(smpl + 36 + 12) + 1;
+                    found = (end > beg);
+                }
+                break;
+            }
+            if (fseek(f, (long)(size + (size & 1)), SEEK_CUR) != 0) break;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+// <archivo>.loop.json: loopStart/loopEnd en frames del archivo (fileFrames = true) o
+// loopStartBeat/loopEndBeat con el bpm del archivo, ya en frames de 'sampleRate'. Sin loopEnd el loop
+// llega hasta el final
+static bool loop_sidecar_read(const char* path, ma_uint32 sampleRate, ma_uint64& beg, ma_uint64& end, bool& fileFrames) {
+    std::string txt;
+    if (!readTextFile((std::string(path) + ".loop.json").c_str(), txt)) return false;
+    double a = 0.0, b = 0.0, bpm = 0.0;
+    if (json_extract_number(txt, "loopStart", a)) {
+        json_extract_number(txt, "loopEnd", b);
+        fileFrames = true;
+    }
+    else if (json_extract_number(txt, "loopStartBeat", a) && json_extract_bpm(txt, bpm) && bpm > 0.0) {
+        fileFrames = false;
+        const double framesPerBeat = 60.0 / bpm * (double)sampleRate;
+        a *= framesPerBeat;
+        if (json_extract_number(txt, "loopEndBeat", b)) b *= framesPerBeat;
+    }
+    else {
+        return false;
+    }
+    if (a < 0.0 || b < 0.0) return false;
+    beg = (ma_uint64)(a + 0.5);
+    end = (ma_uint64)(b + 0.5);
+    return true;
+}
+
+// Frecuencia propia de un archivo con un decoder de prueba (el resource manager no la guarda). 0 si falla
+static ma_uint32 file_native_sample_rate(const std::string& path) {
+    ma_decoder_config dc = ma_decoder_config_init(ma_format_f32, 0, 0);
+    ma_decoder dec;
+    if (ma_decoder_init_file(path.c_str(), &dc, &dec) != MA_SUCCESS) return 0;
+    const ma_uint32 sr = dec.outputSampleRate;
+    ma_decoder_uninit(&dec);
+    return sr;
+}
+
+// Frecuencia propia del archivo de unos metadatos: se mira una vez por archivo
+static ma_uint32 loop_meta_native_rate(LoopMeta& m, const std::string& path) {
+    if (m.nativeRate == 0) m.nativeRate = file_native_sample_rate(path);
+    return m.nativeRate;
+}
+
+// Frames del archivo a 'nativeRate' -> frames del engine (nativeRate 0: sin cambio)
+static ma_uint64 loop_file_to_engine_frames(ma_uint64 frames, ma_uint32 nativeRate) {
+    const ma_uint32 engineRate = ma_engine_get_sample_rate(&gEngine);
+    if (nativeRate == 0 || nativeRate == engineRate) return frames;
+    return (ma_uint64)((double)frames * (double)engineRate / (double)nativeRate + 0.5);
+}
+
+// Frames del archivo de un sonido -> frames del engine (sonidos sin LoopSource: sin cambio)
+static ma_uint64 sound_file_to_engine_frames(ma_sound* s, ma_uint64 frames) {
+    auto it = gLoopSources.find(s);
+    if (it == gLoopSources.end()) return frames;
+    auto itMeta = gLoopMeta.find(it->second->path);
+    if (itMeta == gLoopMeta.end()) return frames;
+    return loop_file_to_engine_frames(frames, loop_meta_native_rate(itMeta->second, it->second->path));
+}
+
+// Final del loop: 0 es el final del archivo (su longitud real)
+static ma_uint64 sound_loop_end(ma_data_source* ds, ma_uint64 end) {
+    ma_uint64 len = 0;
+    if (end == 0 && ma_data_source_get_length_in_pcm_frames(ds, &len) == MA_SUCCESS && len > 0) return len;
+    return (end == 0) ? ~(ma_uint64)0 : end;
+}
+
+// Aplica los puntos de loop al sonido (end 0 = final del archivo)
+static bool sound_set_loop_points(ma_sound* s, ma_uint64 beg, ma_uint64 end) {
+    end = sound_loop_end(ma_sound_get_data_source(s), end);
+    if (end <= beg) return false;
+    auto it = gLoopSources.find(s);
+    if (it == gLoopSources.end()) {
+        return ma_data_source_set_loop_point_in_pcm_frames(ma_sound_get_data_source(s), beg, end) == MA_SUCCESS;
+    }
+    loop_source_set_region(*it->second, loop_region_make(*it->second, beg, end));
+    return true;
+}
+
+// Crea un sonido desde archivo sobre su LoopSource con los puntos de loop de sus metadatos (si tiene
+// queda en loop). La region de un stream (con su cabeza) se guarda con los metadatos del archivo
+static ma_result sound_init_from_file_looped(ma_sound* s, const char* path, ma_uint32 flags) {
+    std::unique_ptr<LoopSource> ls(new LoopSource());
+    if (!loop_source_init(*ls, path, flags)) return MA_ERROR;
+    auto it = gLoopMeta.find(path);
+    if (it == gLoopMeta.end()) {
+        LoopMeta m;
+        bool fileFrames = true;
+        m.found = loop_sidecar_read(path, ls->sampleRate, m.beg, m.end, fileFrames) || wav_read_smpl_loop(path, m.beg, m.end);
+        if (m.found && fileFrames) {
+            const ma_uint32 native = loop_meta_native_rate(m, path);
+            m.beg = loop_file_to_engine_frames(m.beg, native);
+            if (m.end != 0) m.end = loop_file_to_engine_frames(m.end, native);
+        }
+        m.end = sound_loop_end(&ls->inner, m.end);
+        m.found = m.found && m.end > m.beg;
+        it = gLoopMeta.emplace(path, m).first;
+    }
+    LoopMeta& m = it->second;
+    if (m.found) {
+        if (!ls->stream) {
+            loop_source_set_region(*ls, loop_region_make(*ls, m.beg, m.end));
+        }
+        else {
+            if (!m.streamRegion) m.streamRegion = loop_region_make(*ls, m.beg, m.end);
+            loop_source_set_region(*ls, m.streamRegion);
+        }
+    }
+    ma_sound_config cfg = ma_sound_config_init_2(&gEngine);
+    cfg.pDataSource = &ls->base;
+    cfg.flags = flags;
+    const ma_result r = ma_sound_init_ex(&gEngine, &cfg, s);
+    if (r != MA_SUCCESS) {
+        ma_resource_manager_data_source_uninit(&ls->inner);
+        ma_data_source_uninit(&ls->base);
+        return r;
+    }
+    if (m.found) ma_sound_set_looping(s, MA_TRUE);
+    gLoopSources[s] = std::move(ls);
+    return MA_SUCCESS;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// MUSICA CON TRANSPORT
+// - dos ranuras (la pista que sale y la que entra) en streaming y en loop, conectadas a un nodo que
+//   las mezcla con ganancias cos/sin segun el frame del engine: el crossfade no depende del tick
+// - las pistas van en fase con el transport 0: su frame 0 corresponde al beat 0
+// - si se pide otra transicion con un crossfade en curso, la pista que estaba saliendo se corta
+////////////////////////////////////////////////////////////////////////////////////////
+
+struct MusicPlayer;
+
+// Crossfade hacia la ranura 'to' en [start, start + len) (frames del engine). Inmutable una vez
+// publicado: el hilo de audio siempre ve los cuatro campos de la misma transicion
+struct MusicFade {
+    ma_uint64 start = 0;
+    ma_uint64 len = 0;
+    int to = 0;
+    bool toSilence = false;
+};
+
+struct MusicXfadeNode {
+    ma_node_base base;
+    MusicPlayer* player;
+};
+
+struct MusicPlayer {
+    MusicXfadeNode node;
+    bool nodeReady = false;
+    ma_sound* slots[2] = {};
+    std::string paths[2];
+    int active = -1;                            // ranura de la ultima pista pedida (-1 = silencio)
+    bool silent = true;                         // la ultima transicion fue a silencio (stop)
+    // crossfade publicado con un puntero atomico (nullptr = ranura 0 sin fundido). Para liberar el
+    // anterior se espera a que el hilo de audio no lo este leyendo (fadeBusy)
+    std::atomic<const MusicFade*> fade{ nullptr };
+    std::atomic<bool> fadeBusy{ false };
+    // posicion del hilo de audio dentro del bloque del endpoint (solo hilo de audio)
+    ma_uint64 blockBase = ~(ma_uint64)0;
+    ma_uint64 blockOffset = 0;
+};
+
+static MusicPlayer gMusic;
+
+static void music_xfade_process(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut) {
+    MusicPlayer* m = ((MusicXfadeNode*)pNode)->player;
+    const ma_uint32 ch = ma_node_get_output_channels(pNode, 0);
+    const ma_uint32 frames = (*pFrameCountIn < *pFrameCountOut) ? *pFrameCountIn : *pFrameCountOut;
+    float* out = ppFramesOut[0];
+
+    // El grafo puede partir un bloque del endpoint en varias llamadas: el tiempo del engine solo
+    // avanza entre bloques, asi que se lleva la cuenta de lo ya procesado dentro del bloque
+    const ma_uint64 base = ma_engine_get_time_in_pcm_frames(&gEngine);
+    if (base != m->blockBase) {
+        m->blockBase = base;
+        m->blockOffset = 0;
+    }
+    const ma_uint64 t0 = base + m->blockOffset;
+    m->blockOffset += frames;
+
+    MusicFade fade;
+    m->fadeBusy.store(true);
+    if (const MusicFade* pub = m->fade.load()) fade = *pub;
+    m->fadeBusy.store(false);
+    const ma_uint64 beg = fade.start;
+    const ma_uint64 len = fade.len;
+    const int to = fade.to;
+    const float toScale = fade.toSilence ? 0.0f : 1.0f;
+    const float* in = ppFramesIn[to];
+    const float* inFrom = ppFramesIn[1 - to];
+    const float halfPi = 1.5707963f;
+    for (ma_uint32 f = 0; f < frames; ++f) {
+        const ma_uint64 t = t0 + f;
+        float x = 1.0f;
+        if (t < beg) x = 0.0f;
+        else if (t < beg + len) x = (float)(t - beg) / (float)len;
+        const float gIn = (x >= 1.0f) ? toScale : std::sin(x * halfPi) * toScale;
+        const float gOut = (x >= 1.0f) ? 0.0f : std::cos(x * halfPi);
+        for (ma_uint32 c = 0; c < ch; ++c) out[f * ch + c] = in[f * ch + c] * gIn + inFrom[f * ch + c] * gOut;
+    }
+    *pFrameCountIn = frames;
+    *pFrameCountOut = frames;
+}
+
+static ma_node_vtable gMusicXfadeVtable = { music_xfade_process, NULL, 2, 1, 0 };
+
+// Publica una transicion para el hilo de audio, que la aplica desde su siguiente bloque (el caller debe tomar gMutex)
+static void music_fade_publish_unlocked(ma_uint64 start, ma_uint64 len, int to, bool toSilence) {
+    MusicFade* f = new MusicFade();
+    f->start = start;
+    f->len = len;
+    f->to = to;
+    f->toSilence = toSilence;
+    const MusicFade* old = gMusic.fade.exchange(f);
+    // el hilo de audio puede estar copiando la anterior
+    while (gMusic.fadeBusy.load()) std::this_thread::yield();
+    delete old;
+}
+
+// Crea el nodo de mezcla la primera vez (el caller debe tomar gMutex)
+static bool music_node_ready_unlocked() {
+    if (gMusic.nodeReady) return true;
+    gMusic.node.player = &gMusic;
+    const ma_uint32 channels = ma_engine_get_channels(&gEngine);
+    const ma_uint32 inChannels[2] = { channels, channels };
+    ma_node_config nc = ma_node_config_init();
+    nc.vtable = &gMusicXfadeVtable;
+    nc.pInputChannels = inChannels;
+    nc.pOutputChannels = &channels;
+    if (ma_node_init(ma_engine_get_node_graph(&gEngine), &nc, NULL, &gMusic.node) != MA_SUCCESS) return false;
+    ma_node_attach_output_bus(&gMusic.node, 0, ma_engine_get_endpoint(&gEngine), 0);
+    gMusic.nodeReady = true;
+    return true;
+}
+
+// Para y libera la pista de una ranura. 'now' = uninit aqui (con el nodo a punto de liberarse)
+static void music_slot_release_unlocked(int slot, bool now) {
+    ma_sound* s = gMusic.slots[slot];
+    if (!s) return;
+    gMusic.slots[slot] = nullptr;
+    ma_sound_stop(s);
+    if (!now) {
+        schedule_sound_delete(s);
+        return;
+    }
+    ma_sound_uninit(s);
+    loop_source_release(s);
+    delete s;
+}
+
+// Abre 'path' en una ranura (en streaming y en loop) y la conecta a su entrada del nodo
+static bool music_slot_open_unlocked(int slot, const std::string& path) {
+    music_slot_release_unlocked(slot, false);
+    ma_sound* s = new ma_sound;
+    if (sound_init_from_file_looped(s, path.c_str(), MA_SOUND_FLAG_STREAM | MA_SOUND_FLAG_NO_SPATIALIZATION) != MA_SUCCESS) {
+        delete s;
+        return false;
+    }
+    ma_sound_set_looping(s, MA_TRUE);
+    ma_node_attach_output_bus(s, 0, &gMusic.node, (ma_uint32)slot);
+    gMusic.slots[slot] = s;
+    gMusic.paths[slot] = path;
+    return true;
+}
+
+// Arranca la pista (recien abierta) de la ranura en startFrame, en la posicion que le toca al transport en 'beat'
+static void music_slot_start_unlocked(int slot, const Transport& t, ma_uint64 startFrame, double beat) {
+    ma_sound* s = gMusic.slots[slot];
+    ma_uint64 len = 0, loopBeg = 0, loopEnd = 0;
+    ma_sound_get_length_in_pcm_frames(s, &len);
+    ma_data_source_get_loop_point_in_pcm_frames(ma_sound_get_data_source(s), &loopBeg, &loopEnd);
+    if (loopEnd > len) loopEnd = len;
+    // el resource manager decodifica a la frecuencia del engine
+    ma_uint64 pos = (ma_uint64)(transport_seconds_between(t, 0.0, beat) * (double)ma_engine_get_sample_rate(&gEngine) + 0.5);
+    if (pos >= loopEnd && loopEnd > loopBeg) pos = loopBeg + (pos - loopBeg) % (loopEnd - loopBeg);
+    // Como el sonido aun no ha arrancado se puede mover ya desde aqui: el stream empieza a decodificar
+    // en pos en el job thread. El seek de ma_sound se hace en el hilo de audio al arrancar y en un stream
+    // deja la pista muda hasta que acaba el job (y desfasada ese tiempo)
+    ma_data_source_seek_to_pcm_frame(ma_sound_get_data_source(s), pos);
+    sound_schedule_start(s, startFrame, pos);
+}
+
+// Primer limite de la rejilla de 'quantize' beats que se puede alcanzar desde ahora (con el margen
+// de arranque) y su frame del engine. quantize <= 0: sin cuantizar
+static double music_next_boundary(const Transport& t, double quantize, ma_uint64& frame) {
+    const double sr = (double)ma_engine_get_sample_rate(&gEngine);
+    const ma_uint64 now = ma_engine_get_time_in_pcm_frames(&gEngine);
+    const ma_uint64 lead = stem_start_lead();
+    const double beatNow = transport_get_beat_unlocked(t);
+    const double earliest = transport_advance(t, beatNow, (double)lead / sr);
+    double target = earliest;
+    if (quantize > 0.0) target = std::max(0.0, std::ceil(earliest / quantize - 1e-9) * quantize);
+    frame = now + (ma_uint64)(transport_seconds_between(t, beatNow, target) * sr + 0.5);
+    if (frame < now + lead) frame = now + lead;
+    return target;
+}
+
+// Lleva la musica que suena a la posicion de 'beat' (seek del transport 0): la misma pista se abre
+// en la otra ranura ya en su sitio y la sustituye sin fundido. Un crossfade en curso se da por terminado
+static void music_seek_unlocked(const Transport& t, double beat) {
+    if (gMusic.active < 0 || gMusic.silent) return;
+    const int slot = 1 - gMusic.active;
+    if (!music_slot_open_unlocked(slot, gMusic.paths[gMusic.active])) return;
+    const double sr = (double)ma_engine_get_sample_rate(&gEngine);
+    const ma_uint64 lead = stem_start_lead();
+    const ma_uint64 frame = ma_engine_get_time_in_pcm_frames(&gEngine) + lead;
+    const double startAt = t.playing.load() ? transport_advance(t, beat, (double)lead / sr) : beat;
+    music_slot_start_unlocked(slot, t, frame, startAt);
+    ma_sound_set_stop_time_in_pcm_frames(gMusic.slots[gMusic.active], frame);
+    music_fade_publish_unlocked(frame, 0, slot, false);
+    gMusic.active = slot;
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// FILTRO PASO BAJO POR SONIDO
+// - opcional: la salida del sonido pasa por un ma_lpf_node (2o orden) antes del endpoint
+// - solo el hilo de audio recalcula los coeficientes (entre dos bloques, con el filtro parado): la API,
+//   la automatizacion y los LFOs escriben 'cutoff' y el hilo de audio lo aplica si ha cambiado
+////////////////////////////////////////////////////////////////////////////////////////
+struct SoundFilter {
+    ma_lpf_node node;
+    std::atomic<float> cutoff{ 0.0f };
+    float applied = 0.0f;       // corte con el que estan calculados los coeficientes (solo hilo de audio)
+};
+
+static std::unordered_map<int, std::unique_ptr<SoundFilter>> gSoundFilters;
+
+// Frecuencia de corte valida para el filtro (10 Hz .. 0.45 * frecuencia de muestreo)
+static inline float sound_filter_clamp(float hz, ma_uint32 sampleRate) {
+    return std::min(0.45f * (float)sampleRate, std::max(10.0f, hz));
+}
+
+// Filtro del sonido id. La primera vez lo crea abierto del todo y lo intercala entre el sonido y el
+// nodo al que estuviera conectado (el caller debe publicar la automatizacion para que el hilo de
+// audio lo vea)
+static SoundFilter* sound_filter_get_unlocked(int id, ma_sound* s) {
+    auto it = gSoundFilters.find(id);
+    if (it != gSoundFilters.end()) return it->second.get();
+    const ma_uint32 sr = ma_engine_get_sample_rate(&gEngine);
+    const float hz = sound_filter_clamp(20000.0f, sr);
+    std::unique_ptr<SoundFilter> f(new SoundFilter());
+    ma_lpf_node_config cfg = ma_lpf_node_config_init(ma_node_get_output_channels(s, 0), sr, hz, 2);
+    if (ma_lpf_node_init(ma_engine_get_node_graph(&gEngine), &cfg, NULL, &f->node) != MA_SUCCESS) return nullptr;
+    f->cutoff.store(hz);
+    f->applied = hz;
+    const ma_node_output_bus& bus = ((ma_node_base*)s)->pOutputBuses[0];
+    ma_node* dest = bus.pInputNode;
+    const ma_uint32 destBus = dest ? bus.inputNodeInputBusIndex : 0;
+    if (!dest) dest = ma_engine_get_endpoint(&gEngine);
+    ma_node_attach_output_bus(&f->node, 0, dest, destBus);
+    ma_node_attach_output_bus(s, 0, &f->node, 0);
+    SoundFilter* out = f.get();
+    gSoundFilters[id] = std::move(f);
+    return out;
+}
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// DELAY SINCRONIZADO
+// - nodo de bus: los sonidos que se envian a el se mezclan en su entrada y se procesan una sola vez
+//   (salida = entrada * dry + eco * wet, hacia el endpoint)
+// - el tiempo es una fraccion de beat: la automatizacion recalcula en cada bloque los frames que
+//   son con el tempo actual del transport y el hilo de audio desliza el retardo hacia ese valor
+//   (unos 50 ms), como una cinta, en vez de saltar y hacer clic
+// - la realimentacion pasa por un paso bajo de un polo (tono): cada repeticion suena mas oscura
+// - el anillo se reserva al crear el delay (kDelayMaxSec) y el hilo de audio no reserva nada
+////////////////////////////////////////////////////////////////////////////////////////
+static const double kDelayMaxSec = 4.0;
+
+struct DelayBus;
+
+// Nodo del delay: ma_node_base tiene que ser el primer miembro
+struct DelayNode {
+    ma_node_base base;
+    DelayBus* bus;
+};
+
+struct DelayBus {
+    DelayNode node;
+    int transport = 0;
+    ma_uint32 channels = 0;
+    ma_uint32 ringFrames = 0;
+    std::vector<float> ring;                // entrelazado, ringFrames * channels
+    std::vector<float> tone;                // estado del paso bajo por canal (solo hilo de audio)
+    ma_uint32 writePos = 0;                 // solo hilo de audio
+    double curDelay = 0.0;                  // retardo actual en frames (solo hilo de audio)
+    float glide = 1.0f;                     // coeficiente del deslizamiento por muestra
+    std::atomic<double> beats{ 0.75 };
+    std::atomic<double> targetFrames{ 1.0 };
+    std::atomic<float> feedback{ 0.35f };
+    std::atomic<float> toneCoeff{ 1.0f };
+    std::atomic<float> dry{ 1.0f };
+    std::atomic<float> wet{ 0.35f };
+};
+
+static std::unordered_map<int, std::unique_ptr<DelayBus>> gDelayBuses;
+
+// Frames de 'beats' a 'beatsPerFrame', dentro del anillo
+static inline double delay_bus_frames(const DelayBus& d, double beats, double beatsPerFrame) {
+    const double frames = (beatsPerFrame > 0.0) ? beats / beatsPerFrame : 1.0;
+    return std::min((double)d.ringFrames - 2.0, std::max(1.0, frames));
+}
+
+// Coeficiente del paso bajo de un polo para un corte en Hz
+static inline float delay_tone_coeff(double hz) {
+    const double sr = (double)ma_engine_get_sample_rate(&gEngine);
+    return (float)(1.0 - std::exp(-2.0 * 3.14159265358979 * std::min(0.45 * sr, std::max(10.0, hz)) / sr));
+}
+
+static void delay_bus_process(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut) {
+    DelayBus* d = ((DelayNode*)pNode)->bus;
+    const ma_uint32 ch = d->channels;
+    const ma_uint32 frames = (*pFrameCountIn < *pFrameCountOut) ? *pFrameCountIn : *pFrameCountOut;
+    const float* in = ppFramesIn[0];
+    float* out = ppFramesOut[0];
+    const double target = d->targetFrames.load(std::memory_order_relaxed);
+    const float fb = d->feedback.load(std::memory_order_relaxed);
+    const float k = d->toneCoeff.load(std::memory_order_relaxed);
+    const double glide = d->glide;
+    const ma_uint32 size = d->ringFrames;
+    float* ring = d->ring.data();
+    float* lp = d->tone.data();
+    double delay = d->curDelay;
+    ma_uint32 w = d->writePos;
+
+    // eco: lectura fraccionaria del anillo con el retardo deslizandose hacia el objetivo (recursivo,
+    // muestra a muestra). El eco filtrado se deja en 'out'. La cola decae por fb en cada vuelta: el
+    // filtro se lleva a 0 por debajo de 1e-20 en cada muestra para que ni el ni lo que escribe en el
+    // anillo lleguen a denormales (el hilo de audio no tiene FTZ/DAZ activos)
+    for (ma_uint32 f = 0; f < frames; ++f) {
+        delay += (target - delay) * glide;
+        double rp = (double)w - delay;
+        if (rp < 0.0) rp += (double)size;
+        const ma_uint32 i0 = (ma_uint32)rp;
+        const float fr = (float)(rp - (double)i0);
+        const ma_uint32 i1 = (i0 + 1 == size) ? 0 : i0 + 1;
+        const float* a = ring + (size_t)i0 * ch;
+        const float* b = ring + (size_t)i1 * ch;
+        float* wr = ring + (size_t)w * ch;
+        for (ma_uint32 c = 0; c < ch; ++c) {
+            const float y = a[c] + (b[c] - a[c]) * fr;
+            const float v = lp[c] + (y - lp[c]) * k;
+            lp[c] = (std::fabs(v) < 1e-20f) ? 0.0f : v;
+            wr[c] = in[f * ch + c] + lp[c] * fb;
+            out[f * ch + c] = lp[c];
+        }
+        if (++w == size) w = 0;
+    }
+    d->curDelay = (std::fabs(target - delay) < 1e-3) ? target : delay;
+    d->writePos = w;
+
+    // mezcla dry/wet (vectorizable)
+    const float dry = d->dry.load(std::memory_order_relaxed);
+    const float wet = d->wet.load(std::memory_order_relaxed);
+    const size_t n = (size_t)frames * ch;
+    size_t i = 0;
+#ifdef GMAUDIO_SSE2
+    const __m128 vd = _mm_set1_ps(dry), vw = _mm_set1_ps(wet);
+    for (; i + 4 <= n; i += 4) {
+        const __m128 x = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i), vd), _mm_mul_ps(_mm_loadu_ps(out + i), vw));
+        _mm_storeu_ps(out + i, x);
+    }
+#endif
+    for (; i < n; ++i) out[i] = in[i] * dry + out[i] * wet;
+    *pFrameCountIn = frames;
+    *pFrameCountOut = frames;
+}
+
+// Se procesa aunque no le llegue nada: las repeticiones siguen sonando al parar los envios
+static ma_node_vtable gDelayBusVtable = { delay_bus_process, NULL, 1, 1, MA_NODE_FLAG_CONTINUOUS_PROCESSING };
+
+// Nodo por el que sale el sonido id (su filtro si lo tiene)
+static ma_node* sound_output_node_unlocked(int id, ma_sound* s) {
+    auto it = gSoundFilters.find(id);
+    if (it != gSoundFilters.end()) return &it->second->node;
+    return s;
+}
+
+// Devuelve al endpoint los sonidos que se envian al delay (antes de destruirlo)
+static void delay_bus_unroute_unlocked(DelayBus& d) {
+    for (auto& kv : gSounds) {
+        ma_node* out = sound_output_node_unlocked(kv.first, kv.second);
+        if (((ma_node_base*)out)->pOutputBuses[0].pInputNode == (ma_node*)&d.node) {
+            ma_node_attach_output_bus(out, 0, ma_engine_get_endpoint(&gEngine), 0);
+        }
+    }
+}
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// AUTOMATIZACION Y LFOS
+// - carriles de puntos (beat, valor) contra un transport; cada punto dice la curva del tramo hasta el
+//   siguiente: lineal, exponencial o bezier. Antes del primer punto vale el primero y despues del
+//   ultimo, el ultimo
+// - LFOs (seno, triangulo, cuadrada, sample and hold) con el periodo en beats del transport: siguen
+//   sus cambios de tempo y seeks. Sobre el mismo parametro que un carril, manda el LFO
+// - destinos: volumen, pan, pitch y corte del filtro de un sonido, intensidad y volumen de un grupo
+//   de stems y, con el handle 0, el volumen master o el del bus de musica (gm_audio_music_*)
+// - el hilo de audio los evalua en cada bloque (al final de un bloque, para el siguiente) con el
+//   reloj publicado del transport: sin llamadas por frame desde GML
+// - carriles, LFOs y filtros se copian a un AutoSet inmutable que se publica con un puntero atomico.
+//   Para liberar el anterior se espera a que el hilo de audio no este evaluando (gAutoBusy)
+// - los carriles de una cancion (JSON) cuentan desde el inicio de la cancion y se repiten con ella
+////////////////////////////////////////////////////////////////////////////////////////
+enum AutoParam : ma_uint8 {
+    AUTO_VOLUME = 0,
+    AUTO_PAN = 1,
+    AUTO_PITCH = 2,
+    AUTO_INTENSITY = 3,
+    AUTO_MUSIC = 4,     // volumen del bus de musica (handle 0)
+    AUTO_CUTOFF = 5,    // corte del filtro paso bajo del sonido (Hz)
+};
+
+enum AutoCurve : ma_uint8 {
+    AUTO_LINEAR = 0,
+    AUTO_EXP = 1,
+    AUTO_BEZIER = 2,
+};
+
+struct AutoPoint {
+    double beat;
+    float value;
+    ma_uint8 curve;     // curva del tramo que empieza en este punto
+    float c1, c2;       // puntos de control de la bezier (fraccion del salto; 1/3 y 2/3 = lineal)
+};
+
+enum LfoShape : ma_uint8 {
+    LFO_SINE = 0,
+    LFO_TRIANGLE = 1,
+    LFO_SQUARE = 2,
+    LFO_SAMPLE_HOLD = 3,    // un valor aleatorio por periodo (el mismo para el mismo periodo del transport)
+};
+
+struct AutoLane {
+    int target = 0;             // handle del sonido o grupo de stems (0 = engine)
+    ma_uint8 param = AUTO_VOLUME;
+    int transport = 0;
+    double loopBeats = 0.0;     // > 0: el carril se repite cada loopBeats beats
+    int song = -1;              // cancion que lo cargo (-1 = creado por API)
+    bool dead = false;          // su destino se destruyo
+    std::vector<AutoPoint> points;
+};
+
+// Valor = center + depth * onda(beat / periodBeats + phase), onda en [-1, 1]
+struct AutoLfo {
+    int target = 0;
+    ma_uint8 param = AUTO_VOLUME;
+    int transport = 0;
+    bool configured = false;    // no se aplica hasta el primer gm_audio_lfo_set
+    bool dead = false;
+    ma_uint8 shape = LFO_SINE;
+    double periodBeats = 1.0;
+    double phase = 0.0;         // en ciclos
+    float center = 0.0f;
+    float depth = 0.0f;
+};
+
+// Destino resuelto al publicar (punteros validos mientras el AutoSet este publicado)
+struct AutoTarget {
+    ma_uint8 param;
+    ma_sound* sound;
+    ma_node* node;
+    StemGroup* stems;
+    SoundFilter* filter;
+};
+
+struct AutoLaneRT {
+    AutoTarget target;
+    const Transport* transport;
+    double origin;
+    double loopBeats;
+    size_t first, count;        // tramo de AutoSet::points
+};
+
+struct AutoLfoRT {
+    AutoTarget target;
+    const Transport* transport;
+    ma_uint8 shape;
+    ma_uint32 seed;
+    double periodBeats;
+    double phase;
+    float center, depth;
+};
+
+struct AutoDelayRT {
+    DelayBus* bus;
+    const Transport* transport;
+};
+
+struct AutoSet {
+    std::vector<AutoPoint> points;
+    std::vector<AutoLaneRT> lanes;
+    std::vector<AutoLfoRT> lfos;
+    std::vector<SoundFilter*> filters;
+    std::vector<AutoDelayRT> delays;
+};
+
+static std::unordered_map<int, std::unique_ptr<AutoLane>> gAutoLanes;
+static std::unordered_map<int, std::unique_ptr<AutoLfo>> gAutoLfos;
+static std::atomic<AutoSet*> gAutoSet{ nullptr };
+static std::atomic<bool> gAutoBusy{ false };
+
+// Valor de un carril en 'beat' (beat relativo al origen del carril)
+static float automation_value(const AutoPoint* p, size_t n, double beat) {
+    if (beat <= p[0].beat) return p[0].value;
+    if (beat >= p[n - 1].beat) return p[n - 1].value;
+    const AutoPoint* b = std::upper_bound(p, p + n, beat, [](double x, const AutoPoint& q) { return x < q.beat; });
+    const AutoPoint& a = *(b - 1);
+    const float x = (float)((beat - a.beat) / (b->beat - a.beat));
+    switch (a.curve) {
+    case AUTO_EXP:
+        // exponencial solo entre valores del mismo signo y distintos de 0 (si no, lineal)
+        if (a.value * b->value > 0.0f) return a.value * std::pow(b->value / a.value, x);
+        break;
+    case AUTO_BEZIER: {
+        const float u = 1.0f - x;
+        return a.value + (b->value - a.value) * (3.0f * u * u * x * a.c1 + 3.0f * u * x * x * a.c2 + x * x * x);
+    }
+    default:
+        break;
+    }
+    return a.value + (b->value - a.value) * x;
+}
+
+// Onda del LFO en 'pos' ciclos. El sample and hold sale de un hash del numero de ciclo: repetible tras un seek
+static float lfo_wave(ma_uint8 shape, double pos, ma_uint32 seed) {
+    const double cycle = std::floor(pos);
+    const float p = (float)(pos - cycle);
+    switch (shape) {
+    case LFO_TRIANGLE:
+        if (p < 0.25f) return 4.0f * p;
+        if (p < 0.75f) return 2.0f - 4.0f * p;
+        return 4.0f * p - 4.0f;
+    case LFO_SQUARE:
+        return (p < 0.5f) ? 1.0f : -1.0f;
+    case LFO_SAMPLE_HOLD: {
+        ma_uint64 x = ((ma_uint64)seed << 32) ^ (ma_uint64)(ma_int64)cycle;
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        x ^= x >> 31;
+        return (float)((double)(x >> 11) / 9007199254740992.0) * 2.0f - 1.0f;
+    }
+    default:
+        return std::sin(p * 6.2831853f);
+    }
+}
+
+static void auto_target_apply(const AutoTarget& t, float v) {
+    switch (t.param) {
+    case AUTO_VOLUME:
+    case AUTO_MUSIC:
+        v = std::max(0.0f, v);
+        if (t.sound) ma_sound_set_volume(t.sound, v);
+        else ma_node_set_output_bus_volume(t.node, 0, v);
+        break;
+    case AUTO_PAN:
+        ma_sound_set_pan(t.sound, std::min(1.0f, std::max(-1.0f, v)));
+        break;
+    case AUTO_PITCH:
+        if (v > 0.0f) ma_sound_set_pitch(t.sound, v);
+        break;
+    case AUTO_INTENSITY:
+        t.stems->intensity.store(v, std::memory_order_relaxed);
+        break;
+    case AUTO_CUTOFF:
+        t.filter->cutoff.store(sound_filter_clamp(v, t.filter->node.lpf.sampleRate), std::memory_order_relaxed);
+        break;
+    default:
+        break;
+    }
+}
+
+// Evalua carriles y LFOs publicados en el frame de inicio del bloque siguiente (hilo de audio),
+// recalcula los filtros cuyo corte ha cambiado y el tiempo de los delays con el tempo actual
+static void automation_process() {
+    gAutoBusy.store(true);
+    const AutoSet* set = gAutoSet.load();
+    if (set) {
+        const ma_uint64 frame = ma_engine_get_time_in_pcm_frames(&gEngine);
+        for (const AutoLaneRT& l : set->lanes) {
+            double beat = transport_clock_beat(*l.transport, frame) - l.origin;
+            if (beat < 0.0) continue;
+            if (l.loopBeats > 0.0) beat = std::fmod(beat, l.loopBeats);
+            auto_target_apply(l.target, automation_value(&set->points[l.first], l.count, beat));
+        }
+        for (const AutoLfoRT& o : set->lfos) {
+            const double pos = transport_clock_beat(*o.transport, frame) / o.periodBeats + o.phase;
+            auto_target_apply(o.target, o.center + o.depth * lfo_wave(o.shape, pos, o.seed));
+        }
+        for (SoundFilter* f : set->filters) {
+            const float hz = f->cutoff.load(std::memory_order_relaxed);
+            if (hz == f->applied) continue;
+            const ma_lpf_config cfg = ma_lpf_config_init(ma_format_f32, f->node.lpf.channels, f->node.lpf.sampleRate, hz, 2);
+            ma_lpf_node_reinit(&cfg, &f->node);
+            f->applied = hz;
+        }
+        for (const AutoDelayRT& dl : set->delays) {
+            // beats por frame en este punto del reloj; parado, los del bpm del transport
+            const double b0 = transport_clock_beat(*dl.transport, frame);
+            double rate = (transport_clock_beat(*dl.transport, frame + 1024) - b0) / 1024.0;
+            if (!(rate > 0.0)) rate = dl.transport->bpm.load(std::memory_order_relaxed) / 60.0 / (double)ma_engine_get_sample_rate(&gEngine);
+            dl.bus->targetFrames.store(delay_bus_frames(*dl.bus, dl.bus->beats.load(std::memory_order_relaxed), rate), std::memory_order_relaxed);
+        }
+    }
+    gAutoBusy.store(false);
+}
+
+// Parametro por nombre para un destino: "volume", "pan", "pitch", "cutoff", "intensity" o "music"
+static bool automation_param_parse(int target, const std::string& name, ma_uint8& out) {
+    if (name == "volume") out = AUTO_VOLUME;
+    else if (name == "pan") out = AUTO_PAN;
+    else if (name == "pitch") out = AUTO_PITCH;
+    else if (name == "cutoff") out = AUTO_CUTOFF;
+    else if (name == "intensity") out = AUTO_INTENSITY;
+    else if (name == "music" && target == 0) out = AUTO_MUSIC;
+    else return false;
+    return true;
+}
+
+// Prepara lo que necesita un destino (el filtro del sonido, el nodo de musica) y comprueba que
+// existe y admite el parametro
+static bool automation_target_prepare_unlocked(int target, ma_uint8 param) {
+    if (param == AUTO_MUSIC && !music_node_ready_unlocked()) return false;
+    if (param == AUTO_CUTOFF) {
+        auto it = gSounds.find(target);
+        if (it == gSounds.end() || !sound_filter_get_unlocked(target, it->second)) return false;
+    }
+    return true;
+}
+
+// Resuelve el destino de un carril o LFO. false si ya no existe
+static bool automation_resolve_unlocked(int target, ma_uint8 param, AutoTarget& out) {
+    out = AutoTarget{ param, nullptr, nullptr, nullptr, nullptr };
+    if (target == 0) {
+        if (param == AUTO_VOLUME) out.node = ma_engine_get_endpoint(&gEngine);
+        else if (param == AUTO_MUSIC && gMusic.nodeReady) out.node = &gMusic.node;
+        return out.node != nullptr;
+    }
+    auto itS = gSounds.find(target);
+    if (itS != gSounds.end()) {
+        out.sound = itS->second;
+        if (param == AUTO_CUTOFF) {
+            auto itF = gSoundFilters.find(target);
+            out.filter = (itF != gSoundFilters.end()) ? itF->second.get() : nullptr;
+            return out.filter != nullptr;
+        }
+        return param == AUTO_VOLUME || param == AUTO_PAN || param == AUTO_PITCH;
+    }
+    auto itG = gStemGroups.find(target);
+    if (itG != gStemGroups.end()) {
+        out.stems = itG->second.get();
+        out.node = &itG->second->node;
+        return param == AUTO_VOLUME || param == AUTO_INTENSITY;
+    }
+    return false;
+}
+
+// Copia carriles, LFOs, filtros y delays vivos a un AutoSet nuevo y lo publica (el caller debe tomar gMutex)
+// Hay que llamarlo antes de liberar cualquier destino al que apunte el conjunto publicado
+static void automation_publish_unlocked() {
+    AutoSet* set = nullptr;
+    if ((!gAutoLanes.empty() || !gAutoLfos.empty() || !gSoundFilters.empty() || !gDelayBuses.empty()) && gEngineIniciado) {
+        set = new AutoSet();
+        for (auto& kv : gAutoLanes) {
+            const AutoLane& l = *kv.second;
+            AutoLaneRT rt;
+            if (l.dead || l.points.empty() || !automation_resolve_unlocked(l.target, l.param, rt.target)) continue;
+            rt.origin = 0.0;
+            rt.loopBeats = l.loopBeats;
+            int th = l.transport;
+            if (l.song >= 0) {
+                const Song* s = song_find_unlocked(l.song);
+                if (!s || !s->playing) continue;
+                rt.origin = s->startBeat;
+                rt.loopBeats = s->loop ? s->lengthBeats : 0.0;
+                th = s->transport;
+            }
+            const Transport* t = transport_find_unlocked(th);
+            rt.transport = t ? t : &gTransport;
+            rt.first = set->points.size();
+            rt.count = l.points.size();
+            set->points.insert(set->points.end(), l.points.begin(), l.points.end());
+            set->lanes.push_back(rt);
+        }
+        for (auto& kv : gAutoLfos) {
+            const AutoLfo& o = *kv.second;
+            AutoLfoRT rt;
+            if (o.dead || !o.configured || !automation_resolve_unlocked(o.target, o.param, rt.target)) continue;
+            const Transport* t = transport_find_unlocked(o.transport);
+            rt.transport = t ? t : &gTransport;
+            rt.shape = o.shape;
+            rt.seed = (ma_uint32)kv.first;
+            rt.periodBeats = o.periodBeats;
+            rt.phase = o.phase;
+            rt.center = o.center;
+            rt.depth = o.depth;
+            set->lfos.push_back(rt);
+        }
+        for (auto& kv : gSoundFilters) set->filters.push_back(kv.second.get());
+        for (auto& kv : gDelayBuses) {
+            const Transport* t = transport_find_unlocked(kv.second->transport);
+            set->delays.push_back(AutoDelayRT{ kv.second.get(), t ? t : &gTransport });
+        }
+    }
+    AutoSet* old = gAutoSet.exchange(set);
+    // el hilo de audio puede estar evaluando el conjunto anterior
+    while (gAutoBusy.load()) std::this_thread::yield();
+    delete old;
+}
+
+// Los carriles y LFOs que apuntan a 'target' dejan de aplicarse y su filtro se libera (se llama
+// antes de destruirlo)
+static void automation_target_gone_unlocked(int target) {
+    bool any = false;
+    for (auto& kv : gAutoLanes) {
+        if (kv.second->target == target && !kv.second->dead) {
+            kv.second->dead = true;
+            any = true;
+        }
+    }
+    for (auto& kv : gAutoLfos) {
+        if (kv.second->target == target && !kv.second->dead) {
+            kv.second->dead = true;
+            any = true;
+        }
+    }
+    auto itF = gSoundFilters.find(target);
+    std::unique_ptr<SoundFilter> filter;
+    if (itF != gSoundFilters.end()) {
+        filter = std::move(itF->second);
+        gSoundFilters.erase(itF);
+        any = true;
+    }
+    if (any) automation_publish_unlocked();
+    if (filter) ma_lpf_node_uninit(&filter->node, NULL);
+}
+
+// Quita carriles, LFOs, filtros y delays (apagado del engine)
+static void automation_clear_unlocked() {
+    gAutoLanes.clear();
+    gAutoLfos.clear();
+    for (auto& kv : gDelayBuses) delay_bus_unroute_unlocked(*kv.second);
+    std::unordered_map<int, std::unique_ptr<SoundFilter>> filters;
+    filters.swap(gSoundFilters);
+    std::unordered_map<int, std::unique_ptr<DelayBus>> delays;
+    delays.swap(gDelayBuses);
+    automation_publish_unlocked();
+    for (auto& kv : filters) ma_lpf_node_uninit(&kv.second->node, NULL);
+    for (auto& kv : delays) ma_node_uninit(&kv.second->node, NULL);
+}
+
+// Vuelve a publicar si hay carriles de canciones (el inicio o el loop de alguna ha cambiado)
+static void automation_songs_changed_unlocked() {
+    for (auto& kv : gAutoLanes) {
+        if (kv.second->song >= 0) {
+            automation_publish_unlocked();
+            return;
+        }
+    }
+}
+
+// Inserta un punto manteniendo el orden por beat (un punto en el mismo beat se sustituye)
+static void automation_add_point(AutoLane& l, const AutoPoint& p) {
+    auto it = std::lower_bound(l.points.begin(), l.points.end(), p.beat,
+        [](const AutoPoint& q, double b) { return q.beat < b; });
+    if (it != l.points.end() && std::fabs(it->beat - p.beat) < 1e-9) *it = p;
+    else l.points.insert(it, p);
+}
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// CHARTS Y JUICIO DE ENTRADA
+// - un chart guarda las notas de cada carril ordenadas por beat: la nota de una pulsacion y el
+//   principio de la ventana visible se buscan con una busqueda binaria. Cada carril indexa aparte sus
+//   notas largas con una tabla de maximos de su final: las que empiezan antes de la ventana y siguen
+//   dentro salen en O(log L + k) (L notas largas en el carril, k las que se devuelven)
+// - archivos: JSON { "notes": [ { "beat": 4, "lane": 1, "length": 2 }, ... ] } (length opcional) o
+//   binario: "GMCH", u32 version, u32 numero de notas y por nota f64 beat, f32 length, u32 lane
+//   (little endian). gm_audio_chart_save_file escribe el binario, que carga sin parsear texto
+// - el timestamp de la entrada (us del reloj de gm_audio_time_us) se pasa al frame del engine que
+//   sonaba en ese instante: ancla del callback - latencia de salida - calibracion del jugador. Ese
+//   frame se convierte en beat con el reloj publicado del transport, sin depender del Step de GML
+// - offline el timestamp es directamente el tiempo del engine en us (sin latencia)
+// - cada nota se juzga una vez; gm_audio_judge_reset las vuelve a dejar pendientes
+////////////////////////////////////////////////////////////////////////////////////////
+struct ChartNote {
+    double beat;
+    float length;   // beats de la nota larga (0 = nota simple)
+    bool judged;
+};
+
+struct ChartLane {
+    std::vector<ChartNote> notes;       // ordenadas por beat
+    std::vector<ma_uint32> longNotes;   // indices en notes de las notas largas, en orden
+    std::vector<double> longEnd;        // beat + length de cada una
+    // tabla dispersa: longMax[k][i] = posicion en longNotes del mayor longEnd de [i, i + 2^k)
+    std::vector<std::vector<ma_uint32>> longMax;
+};
+
+struct Chart {
+    std::vector<ChartLane> lanes;
+};
+
+static const int kMaxChartLanes = 64;
+static const char kChartMagic[4] = { 'G', 'M', 'C', 'H' };
+static const ma_uint32 kChartVersion = 1;
+static std::unordered_map<int, std::unique_ptr<Chart>> gCharts;
+
+enum JudgeResult {
+    JUDGE_NONE = -1,    // ninguna nota pendiente dentro de la ventana de miss
+    JUDGE_PERFECT = 0,
+    JUDGE_GREAT = 1,
+    JUDGE_GOOD = 2,
+    JUDGE_MISS = 3,     // dentro de la ventana de miss pero fuera de good: la nota se pierde
+};
+
+struct JudgeState {
+    int chart = 0;
+    int transport = 0;
+    double windowsMs[4] = { 25.0, 50.0, 90.0, 135.0 };   // perfect, great, good, miss (+-)
+    double calibrationMs = 0.0;     // positivo = el jugador oye el audio mas tarde
+    double lastOffsetMs = 0.0;      // de la ultima nota juzgada (negativo = antes de tiempo)
+    double lastBeat = -1.0;
+};
+
+static JudgeState gJudge;
+
+// Latencia de salida del dispositivo en segundos (lo que tarda un bloque mezclado en sonar)
+static double output_latency_sec() {
+    ma_device* dev = ma_engine_get_device(&gEngine);
+    if (!dev || dev->playback.internalSampleRate == 0) return 0.0;
+    return (double)dev->playback.internalPeriodSizeInFrames * (double)dev->playback.internalPeriods /
+        (double)dev->playback.internalSampleRate;
+}
+
+// Frame del engine (fraccionario) que se oia en el instante timestampUs
+static double judge_heard_frame(double timestampUs) {
+    const double sr = (double)ma_engine_get_sample_rate(&gEngine);
+    double us = timestampUs - gJudge.calibrationMs * 1000.0;
+    if (!gEngineOffline) {
+        if (!gAudioAnchorValid.load(std::memory_order_acquire)) return -1.0;
+        us -= gAudioAnchorUs.load(std::memory_order_relaxed) + output_latency_sec() * 1e6;
+    }
+    return us * sr / 1e6;
+}
+
+// Nota pendiente mas cercana a 'beat' en un carril a menos de windowSec segundos segun el transport
+// (nullptr si no hay ninguna). Las notas ya juzgadas se saltan solo dentro de la ventana: el coste
+// es la busqueda binaria mas las notas de la ventana, no las juzgadas desde el principio del carril
+static ChartNote* chart_nearest_pending(std::vector<ChartNote>& lane, const Transport& t, double beat, double windowSec) {
+    auto it = std::lower_bound(lane.begin(), lane.end(), beat,
+        [](const ChartNote& n, double b) { return n.beat < b; });
+    ChartNote* next = nullptr;
+    for (auto after = it; after != lane.end(); ++after) {
+        if (transport_seconds_between(t, beat, after->beat) > windowSec) break;
+        if (!after->judged) {
+            next = &*after;
+            break;
+        }
+    }
+    ChartNote* prev = nullptr;
+    for (auto before = it; before != lane.begin();) {
+        --before;
+        if (transport_seconds_between(t, before->beat, beat) > windowSec) break;
+        if (!before->judged) {
+            prev = &*before;
+            break;
+        }
+    }
+    if (!prev) return next;
+    if (!next) return prev;
+    return (beat - prev->beat <= next->beat - beat) ? prev : next;
+}
+
+// Rehace el indice de notas largas de un carril desde la nota 'from' (la primera que ha cambiado).
+// De la tabla de maximos solo se recalculan las entradas cuyo rango llega a la primera larga cambiada
+static void chart_lane_index(ChartLane& l, size_t from = 0) {
+    const size_t j = (size_t)(std::lower_bound(l.longNotes.begin(), l.longNotes.end(), (ma_uint32)from) - l.longNotes.begin());
+    l.longNotes.resize(j);
+    l.longEnd.resize(j);
+    for (ma_uint32 i = (ma_uint32)from; i < (ma_uint32)l.notes.size(); ++i) {
+        const ChartNote& n = l.notes[i];
+        if (n.length <= 0.0f) continue;
+        l.longNotes.push_back(i);
+        l.longEnd.push_back(n.beat + (double)n.length);
+    }
+    const size_t n = l.longNotes.size();
+    size_t levels = 0;
+    while (((size_t)1 << levels) <= n) ++levels;
+    l.longMax.resize(levels);
+    for (size_t k = 0; k < levels; ++k) {
+        const size_t width = (size_t)1 << k;
+        std::vector<ma_uint32>& level = l.longMax[k];
+        level.resize(n - width + 1);
+        for (size_t i = (j + 1 > width) ? j + 1 - width : 0; i < level.size(); ++i) {
+            if (k == 0) {
+                level[i] = (ma_uint32)i;
+                continue;
+            }
+            const ma_uint32 a = l.longMax[k - 1][i];
+            const ma_uint32 b = l.longMax[k - 1][i + width / 2];
+            level[i] = (l.longEnd[b] > l.longEnd[a]) ? b : a;
+        }
+    }
+}
+
+// Posicion en longNotes de la nota larga que mas lejos llega en [lo, hi) (no vacio): dos entradas de la tabla
+static ma_uint32 chart_lane_max_end(const ChartLane& l, ma_uint32 lo, ma_uint32 hi) {
+    const int k = std::ilogb((double)(hi - lo));
+    const ma_uint32 a = l.longMax[k][lo];
+    const ma_uint32 b = l.longMax[k][hi - ((ma_uint32)1 << k)];
+    return (l.longEnd[b] > l.longEnd[a]) ? b : a;
+}
+
+// Inserta una nota en su carril manteniendo el orden (en el mismo beat se sustituye la longitud)
+static bool chart_add_note(Chart& c, int lane, double beat, double length) {
+    if (lane < 0 || lane >= kMaxChartLanes || beat < 0.0 || length < 0.0) return false;
+    if ((int)c.lanes.size() <= lane) c.lanes.resize(lane + 1);
+    ChartLane& l = c.lanes[lane];
+    auto it = std::lower_bound(l.notes.begin(), l.notes.end(), beat,
+        [](const ChartNote& n, double b) { return n.beat < b; });
+    const size_t at = (size_t)(it - l.notes.begin());
+    if (it != l.notes.end() && std::fabs(it->beat - beat) < 1e-9) it->length = (float)length;
+    else l.notes.insert(it, ChartNote{ beat, (float)length, false });
+    chart_lane_index(l, at);
+    return true;
+}
+
+// Agrega una nota sin ordenar (cargas); chart_finalize ordena despues
+static bool chart_push_note(Chart& c, int lane, double beat, double length) {
+    if (lane < 0 || lane >= kMaxChartLanes || beat < 0.0 || !(length >= 0.0)) return false;
+    if ((int)c.lanes.size() <= lane) c.lanes.resize(lane + 1);
+    c.lanes[lane].notes.push_back(ChartNote{ beat, (float)length, false });
+    return true;
+}
+
+// Ordena los carriles, quita notas repetidas en el mismo beat (gana la ultima) y los indexa
+static void chart_finalize(Chart& c) {
+    for (ChartLane& l : c.lanes) {
+        std::stable_sort(l.notes.begin(), l.notes.end(),
+            [](const ChartNote& a, const ChartNote& b) { return a.beat < b.beat; });
+        size_t w = 0;
+        for (size_t i = 0; i < l.notes.size(); ++i) {
+            if (w > 0 && std::fabs(l.notes[w - 1].beat - l.notes[i].beat) < 1e-9) l.notes[w - 1] = l.notes[i];
+            else l.notes[w++] = l.notes[i];
+        }
+        l.notes.resize(w);
+        chart_lane_index(l);
+    }
+}
+
+// Numero de un objeto JSON plano sin regex (un chart puede tener decenas de miles de notas)
+static bool chart_json_number(const std::string& obj, const char* key, double& out) {
+    const std::string k = std::string("\"") + key + "\"";
+    size_t p = obj.find(k);
+    if (p == std::string::npos) return false;
+    p = obj.find(':', p + k.size());
+    if (p == std::string::npos) return false;
+    const char* s = obj.c_str() + p + 1;
+    char* e = nullptr;
+    out = std::strtod(s, &e);
+    return e != s;
+}
+
+static bool chart_load_json(const std::string& txt, Chart& c) {
+    size_t beg = 0, end = 0;
+    if (!json_find_array(txt, "notes", beg, end)) return false;
+    std::vector<std::string> objs;
+    json_split_objects(txt, beg, end, objs);
+    for (const std::string& o : objs) {
+        double beat = 0.0, lane = 0.0, length = 0.0;
+        if (!chart_json_number(o, "beat", beat) || !chart_json_number(o, "lane", lane)) continue;
+        chart_json_number(o, "length", length);
+        chart_push_note(c, (int)lane, beat, length);
+    }
+    chart_finalize(c);
+    return true;
+}
+
+static bool chart_load_binary(const std::string& data, Chart& c) {
+    if (data.size() < 12 || memcmp(data.data(), kChartMagic, 4) != 0) return false;
+    ma_uint32 version = 0, count = 0;
+    memcpy(&version, data.data() + 4, 4);
+    memcpy(&count, data.data() + 8, 4);
+    if (version != kChartVersion || (data.size() - 12) / 16 < count) return false;
+    const char* p = data.data() + 12;
+    for (ma_uint32 i = 0; i < count; ++i, p += 16) {
+        double beat;
+        float length;
+        ma_uint32 lane;
+        memcpy(&beat, p, 8);
+        memcpy(&length, p + 8, 4);
+        memcpy(&lane, p + 12, 4);
+        chart_push_note(c, (int)lane, beat, length);
+    }
+    chart_finalize(c);
+    return true;
+}
+
+static bool chart_save_binary(const Chart& c, const char* path) {
+    ma_uint32 count = 0;
+    for (const ChartLane& l : c.lanes) count += (ma_uint32)l.notes.size();
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(kChartMagic, 1, 4, f) == 4 && fwrite(&kChartVersion, 4, 1, f) == 1 && fwrite(&count, 4, 1, f) == 1;
+    for (ma_uint32 lane = 0; ok && lane < (ma_uint32)c.lanes.size(); ++lane) {
+        for (const ChartNote& n : c.lanes[lane].notes) {
+            char rec[16];
+            memcpy(rec, &n.beat, 8);
+            memcpy(rec + 8, &n.length, 4);
+            memcpy(rec + 12, &lane, 4);
+            if (fwrite(rec, 1, 16, f) != 16) {
+                ok = false;
+                break;
+            }
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+// Rango de longNotes por expandir o, con emit, nota que reportar
+struct ChartSpan {
+    ma_uint32 lo;
+    ma_uint32 hi;
+    bool emit;
+};
+
+// Pila de chart_lane_long: se reutiliza entre consultas (gMutex)
+static std::vector<ChartSpan> gChartSpans;
+
+// Llama a fn(nota) con las notas largas del carril que empiezan antes de 'limit' y terminan en o
+// despues de 'from', en orden de beat. Del rango de las que empiezan antes (busqueda binaria) se toma
+// la que mas lejos llega: si no llega a 'from' no llega ninguna y el rango se descarta; si llega se
+// reporta entre sus dos lados. Cada rango expandido reporta una nota: O(log L + k). 'expanded' (si
+// no es null) suma los rangos mirados. Devuelve false si fn paro
+template <typename Fn>
+static bool chart_lane_long(const ChartLane& l, double from, double limit, Fn fn, size_t* expanded = nullptr) {
+    const double before = std::min(from, limit);
+    const ma_uint32 count = (ma_uint32)(std::lower_bound(l.longNotes.begin(), l.longNotes.end(), before,
+        [&l](ma_uint32 i, double b) { return l.notes[i].beat < b; }) - l.longNotes.begin());
+    if (count == 0) return true;
+    gChartSpans.clear();
+    gChartSpans.push_back(ChartSpan{ 0, count, false });
+    while (!gChartSpans.empty()) {
+        const ChartSpan s = gChartSpans.back();
+        gChartSpans.pop_back();
+        if (s.emit) {
+            if (!fn(l.notes[l.longNotes[s.lo]])) return false;
+            continue;
+        }
+        if (expanded) ++*expanded;
+        const ma_uint32 m = chart_lane_max_end(l, s.lo, s.hi);
+        if (l.longEnd[m] < from) continue;
+        // pila: primero el lado izquierdo, luego m, luego el derecho
+        if (m + 1 < s.hi) gChartSpans.push_back(ChartSpan{ m + 1, s.hi, false });
+        gChartSpans.push_back(ChartSpan{ m, m, true });
+        if (s.lo < m) gChartSpans.push_back(ChartSpan{ s.lo, m, false });
+    }
+    return true;
+}
+
+// Llama a fn(lane, nota) con cada nota visible en [from, to): empieza antes de 'to' y termina en o
+// despues de 'from'. Si fn devuelve false se para ahi. Por carril, primero las largas que empezaron
+// antes de 'from' (chart_lane_long) y luego las que empiezan dentro (busqueda binaria y recorrido)
+template <typename Fn>
+static void chart_visible(const Chart& c, double from, double to, Fn fn) {
+    for (size_t lane = 0; lane < c.lanes.size(); ++lane) {
+        const ChartLane& l = c.lanes[lane];
+        if (!chart_lane_long(l, from, to, [&](const ChartNote& n) { return fn((int)lane, n); })) return;
+        auto it = std::lower_bound(l.notes.begin(), l.notes.end(), from,
+            [](const ChartNote& n, double b) { return n.beat < b; });
+        for (; it != l.notes.end() && it->beat < to; ++it) {
+            if (!fn((int)lane, *it)) return;
+        }
+    }
+}
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// ANALISIS EN SEGUNDO PLANO
+// - un hilo de trabajo decodifica los archivos con su propio ma_decoder (sin engine ni hilo de audio)
+//   y deja los resultados en caches por ruta y parametros
+// - no usa gMutex: un analisis puede tardar segundos y no debe frenar la API. La cola y las caches van
+//   con gAnalysisMutex (si hacen falta los dos, primero gMutex)
+// - las consultas no esperan: devuelven 0 mientras el job esta pendiente
+// - con gm_audio_analysis_set_cache_dir los resultados tambien se guardan en disco y se reutilizan
+//   mientras el archivo de audio no cambie (tamano y fecha)
+////////////////////////////////////////////////////////////////////////////////////////
+enum AnalysisState {
+    ANALYSIS_PENDING = 0,
+    ANALYSIS_READY = 1,
+    ANALYSIS_FAILED = -1,
+};
+
+struct WaveformPeaks {
+    int state = ANALYSIS_PENDING;
+    std::vector<float> minmax;      // min y max por columna
+};
+
+struct TempoAnalysis {
+    int state = ANALYSIS_PENDING;
+    double bpm = 0.0;
+    double offsetSec = 0.0;         // primer beat de la rejilla
+    std::vector<float> onsets;      // segundos
+};
+
+struct RmsEnvelope {
+    int state = ANALYSIS_PENDING;
+    double rateHz = 100.0;          // valores por segundo
+    double sampleRate = 0.0;        // del archivo. El cursor de un sonido va en frames del engine: hay que convertirlo
+    std::vector<float> values;      // RMS de todos los canales en cada ventana de 1/rateHz s
+};
+
+static std::mutex gAnalysisMutex;
+static std::condition_variable gAnalysisCv;
+static std::deque<std::function<void()>> gAnalysisJobs;
+// Puntero sin destruir a proposito: si la DLL se descarga sin gm_audio_shutdown, un std::thread global
+// aun unido llamaria a std::terminate
+static std::thread* gAnalysisThread = nullptr;
+static std::atomic<bool> gAnalysisStop{ false };
+static std::string gAnalysisCacheDir;
+static std::unordered_map<std::string, std::unique_ptr<WaveformPeaks>> gWaveforms;   // "ruta#columnas"
+static std::unordered_map<std::string, std::unique_ptr<RmsEnvelope>> gEnvelopes;     // por ruta
+static std::unordered_map<std::string, std::unique_ptr<TempoAnalysis>> gTempoAnalyses; // por ruta
+
+static const ma_uint32 kAnalysisChunkFrames = 4096;
+
+static void analysis_worker() {
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lk(gAnalysisMutex);
+            gAnalysisCv.wait(lk, [] { return gAnalysisStop.load() || !gAnalysisJobs.empty(); });
+            if (gAnalysisStop.load()) return;
+            job = std::move(gAnalysisJobs.front());
+            gAnalysisJobs.pop_front();
+        }
+        job();
+    }
+}
+
+// Encola un job (el caller debe tomar gAnalysisMutex). El hilo arranca con el primer job
+static void analysis_enqueue_locked(std::function<void()> job) {
+    gAnalysisJobs.push_back(std::move(job));
+    if (!gAnalysisThread) {
+        gAnalysisStop.store(false);
+        gAnalysisThread = new std::thread(analysis_worker);
+    }
+    gAnalysisCv.notify_one();
+}
+
+// Quita de las caches lo que estaba pendiente (el caller debe tomar gAnalysisMutex)
+static void analysis_drop_pending_locked() {
+    for (auto it = gWaveforms.begin(); it != gWaveforms.end();) {
+        if (it->second->state == ANALYSIS_PENDING) it = gWaveforms.erase(it);
+        else ++it;
+    }
+    for (auto it = gEnvelopes.begin(); it != gEnvelopes.end();) {
+        if (it->second->state == ANALYSIS_PENDING) it = gEnvelopes.erase(it);
+        else ++it;
+    }
+    for (auto it = gTempoAnalyses.begin(); it != gTempoAnalyses.end();) {
+        if (it->second->state == ANALYSIS_PENDING) it = gTempoAnalyses.erase(it);
+        else ++it;
+    }
+}
+
+// Para el hilo: el job en curso se cancela en su siguiente bloque y los pendientes se descartan
+// (se pueden volver a pedir). Lo ya calculado se queda en las caches
+static void analysis_stop() {
+    {
+        std::lock_guard<std::mutex> lk(gAnalysisMutex);
+        if (!gAnalysisThread) return;
+        gAnalysisStop.store(true);
+        gAnalysisJobs.clear();
+    }
+    gAnalysisCv.notify_all();
+    gAnalysisThread->join();
+    delete gAnalysisThread;
+    std::lock_guard<std::mutex> lk(gAnalysisMutex);
+    gAnalysisThread = nullptr;
+    analysis_drop_pending_locked();
+}
+
+// Abre un decoder f32 con los canales y la frecuencia del archivo y averigua su longitud
+// (si el formato no la da, se cuenta decodificando y se vuelve al principio)
+static bool analysis_open(const std::string& path, ma_decoder& dec, ma_uint64& length) {
+    ma_decoder_config cfg = ma_decoder_config_init(ma_format_f32, 0, 0);
+    if (ma_decoder_init_file(path.c_str(), &cfg, &dec) != MA_SUCCESS) return false;
+    length = 0;
+    if (ma_decoder_get_length_in_pcm_frames(&dec, &length) != MA_SUCCESS || length == 0) {
+        std::vector<float> tmp((size_t)kAnalysisChunkFrames * dec.outputChannels);
+        ma_uint64 read = 0;
+        length = 0;
+        while (!gAnalysisStop.load() && ma_decoder_read_pcm_frames(&dec, tmp.data(), kAnalysisChunkFrames, &read) == MA_SUCCESS && read > 0) {
+            length += read;
+        }
+        ma_decoder_seek_to_pcm_frame(&dec, 0);
+    }
+    if (length == 0 || gAnalysisStop.load()) {
+        ma_decoder_uninit(&dec);
+        return false;
+    }
+    return true;
+}
+
+// Archivo de cache de un resultado: <dir>/<hash de la ruta>.<tag>. Cabecera "GMAN", u32 version,
+// u64 tamano y i64 fecha del audio, u32 numero de floats y los floats
+static const ma_uint32 kAnalysisCacheVersion = 1;
+
+static bool analysis_cache_path(const std::string& path, const std::string& tag, std::string& out, ma_uint64& size, ma_int64& mtime) {
+    struct stat st;
+    if (gAnalysisCacheDir.empty() || stat(path.c_str(), &st) != 0) return false;
+    ma_uint64 h = 1469598103934665603ull;   // FNV-1a
+    for (unsigned char c : path) h = (h ^ c) * 1099511628211ull;
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.", (unsigned long long)h);
+    out = gAnalysisCacheDir + "/" + name + tag;
+    size = (ma_uint64)st.st_size;
+    mtime = (ma_int64)st.st_mtime;
+    return true;
+}
+
+static bool analysis_cache_load(const std::string& path, const std::string& tag, std::vector<float>& data) {
+    std::string file;
+    ma_uint64 size = 0;
+    ma_int64 mtime = 0;
+    {
+        std::lock_guard<std::mutex> lk(gAnalysisMutex);
+        if (!analysis_cache_path(path, tag, file, size, mtime)) return false;
+    }
+    FILE* f = fopen(file.c_str(), "rb");
+    if (!f) return false;
+    char magic[4];
+    ma_uint32 version = 0, count = 0;
+    ma_uint64 fsize = 0;
+    ma_int64 fmtime = 0;
+    bool ok = fread(magic, 1, 4, f) == 4 && memcmp(magic, "GMAN", 4) == 0 &&
+        fread(&version, 4, 1, f) == 1 && version == kAnalysisCacheVersion &&
+        fread(&fsize, 8, 1, f) == 1 && fread(&fmtime, 8, 1, f) == 1 && fsize == size && fmtime == mtime &&
+        fread(&count, 4, 1, f) == 1;
+    if (ok) {
+        data.resize(count);
+        ok = count == 0 || fread(data.data(), sizeof(float), count, f) == count;
+    }
+    fclose(f);
+    return ok;
+}
+
+static void analysis_cache_save(const std::string& path, const std::string& tag, const std::vector<float>& data) {
+    std::string file;
+    ma_uint64 size = 0;
+    ma_int64 mtime = 0;
+    {
+        std::lock_guard<std::mutex> lk(gAnalysisMutex);
+        if (!analysis_cache_path(path, tag, file, size, mtime)) return;
+    }
+    FILE* f = fopen(file.c_str(), "wb");
+    if (!f) return;
+    const ma_uint32 count = (ma_uint32)data.size();
+    fwrite("GMAN", 1, 4, f);
+    fwrite(&kAnalysisCacheVersion, 4, 1, f);
+    fwrite(&size, 8, 1, f);
+    fwrite(&mtime, 8, 1, f);
+    fwrite(&count, 4, 1, f);
+    if (count) fwrite(data.data(), sizeof(float), count, f);
+    fclose(f);
+}
+
+// Minimo y maximo de n floats (acumula sobre mn/mx). Con SSE2, 4 muestras por instruccion
+static void minmax_f32(const float* p, size_t n, float& mn, float& mx) {
+    size_t i = 0;
+#ifdef GMAUDIO_SSE2
+    if (n >= 8) {
+        __m128 vmin = _mm_set1_ps(mn), vmax = _mm_set1_ps(mx);
+        for (; i + 8 <= n; i += 8) {
+            const __m128 a = _mm_loadu_ps(p + i);
+            const __m128 b = _mm_loadu_ps(p + i + 4);
+            vmin = _mm_min_ps(vmin, _mm_min_ps(a, b));
+            vmax = _mm_max_ps(vmax, _mm_max_ps(a, b));
+        }
+        float lo[4], hi[4];
+        _mm_storeu_ps(lo, vmin);
+        _mm_storeu_ps(hi, vmax);
+        for (int k = 0; k < 4; ++k) {
+            mn = std::min(mn, lo[k]);
+            mx = std::max(mx, hi[k]);
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        mn = std::min(mn, p[i]);
+        mx = std::max(mx, p[i]);
+    }
+}
+
+// Job de picos: la columna b cubre los frames con floor(frame * columnas / longitud) == b
+static void waveform_job(const std::string& path, ma_uint32 buckets, const std::string& key) {
+    const std::string tag = "peaks" + std::to_string(buckets);
+    std::vector<float> out;
+    bool ok = analysis_cache_load(path, tag, out) && out.size() == (size_t)buckets * 2;
+    if (!ok) {
+        ma_decoder dec;
+        ma_uint64 length = 0;
+        if (analysis_open(path, dec, length)) {
+            const ma_uint32 ch = dec.outputChannels;
+            std::vector<float> chunk((size_t)kAnalysisChunkFrames * ch);
+            out.assign((size_t)buckets * 2, 0.0f);
+            ma_uint32 b = 0;
+            float mn = INFINITY, mx = -INFINITY;
+            ma_uint64 pos = 0, read = 0;
+            while (!gAnalysisStop.load() && ma_decoder_read_pcm_frames(&dec, chunk.data(), kAnalysisChunkFrames, &read) == MA_SUCCESS && read > 0) {
+                ma_uint64 done = 0;
+                while (done < read) {
+                    // frames que quedan en la columna b (la ultima se queda con lo que sobre)
+                    const ma_uint64 end = (b + 1 < buckets) ? ((ma_uint64)(b + 1) * length + buckets - 1) / buckets : ~(ma_uint64)0;
+                    const ma_uint64 take = std::min(read - done, end - pos);
+                    minmax_f32(chunk.data() + done * ch, (size_t)(take * ch), mn, mx);
+                    done += take;
+                    pos += take;
+                    if (pos >= end) {
+                        if (mn <= mx) {
+                            out[b * 2] = mn;
+                            out[b * 2 + 1] = mx;
+                        }
+                        mn = INFINITY;
+                        mx = -INFINITY;
+                        ++b;
+                    }
+                }
+            }
+            if (b < buckets && mn <= mx) {
+                out[b * 2] = mn;
+                out[b * 2 + 1] = mx;
+            }
+            ma_decoder_uninit(&dec);
+            ok = !gAnalysisStop.load();
+            if (ok) analysis_cache_save(path, tag, out);
+        }
+    }
+    if (gAnalysisStop.load()) return;
+    std::lock_guard<std::mutex> lk(gAnalysisMutex);
+    auto it = gWaveforms.find(key);
+    if (it == gWaveforms.end()) return;
+    it->second->state = ok ? ANALYSIS_READY : ANALYSIS_FAILED;
+    it->second->minmax.swap(out);
+}
+
+// Suma de los cuadrados de n floats. Con SSE2, 4 muestras por instruccion
+static double sum_squares_f32(const float* p, size_t n) {
+    size_t i = 0;
+    double sum = 0.0;
+#ifdef GMAUDIO_SSE2
+    if (n >= 8) {
+        __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+        for (; i + 8 <= n; i += 8) {
+            const __m128 a = _mm_loadu_ps(p + i);
+            const __m128 b = _mm_loadu_ps(p + i + 4);
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(a, a));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(b, b));
+        }
+        float s[4];
+        _mm_storeu_ps(s, _mm_add_ps(acc0, acc1));
+        sum = (double)s[0] + s[1] + s[2] + s[3];
+    }
+#endif
+    for (; i < n; ++i) sum += (double)p[i] * p[i];
+    return sum;
+}
+
+// Job de la envolvente: la ventana k cubre los frames [k * sr / hz, (k + 1) * sr / hz). En la cache
+// se guarda la frecuencia del archivo delante de los valores
+static void envelope_job(const std::string& path, double hz) {
+    const std::string tag = "rms" + std::to_string((int)std::lround(hz * 100.0));
+    std::vector<float> data;
+    bool ok = analysis_cache_load(path, tag, data) && !data.empty();
+    if (!ok) {
+        ma_decoder dec;
+        ma_uint64 length = 0;
+        if (analysis_open(path, dec, length)) {
+            const ma_uint32 ch = dec.outputChannels;
+            const double sr = (double)dec.outputSampleRate;
+            const double hop = sr / hz;
+            data.assign(1, (float)sr);
+            data.reserve(1 + (size_t)((double)length / hop) + 1);
+            std::vector<float> chunk((size_t)kAnalysisChunkFrames * ch);
+            ma_uint64 pos = 0, read = 0, winBeg = 0;
+            ma_uint64 winEnd = (ma_uint64)std::ceil(hop);
+            double acc = 0.0;
+            while (!gAnalysisStop.load() && ma_decoder_read_pcm_frames(&dec, chunk.data(), kAnalysisChunkFrames, &read) == MA_SUCCESS && read > 0) {
+                ma_uint64 done = 0;
+                while (done < read) {
+                    const ma_uint64 take = std::min(read - done, winEnd - pos);
+                    acc += sum_squares_f32(chunk.data() + done * ch, (size_t)(take * ch));
+                    done += take;
+                    pos += take;
+                    if (pos == winEnd) {
+                        data.push_back((float)std::sqrt(acc / (double)((winEnd - winBeg) * ch)));
+                        acc = 0.0;
+                        winBeg = winEnd;
+                        winEnd = (ma_uint64)std::ceil((double)(data.size()) * hop);
+                        if (winEnd <= winBeg) winEnd = winBeg + 1;
+                    }
+                }
+            }
+            if (pos > winBeg) data.push_back((float)std::sqrt(acc / (double)((pos - winBeg) * ch)));
+            ma_decoder_uninit(&dec);
+            ok = !gAnalysisStop.load();
+            if (ok) analysis_cache_save(path, tag, data);
+        }
+    }
+    if (gAnalysisStop.load()) return;
+    std::lock_guard<std::mutex> lk(gAnalysisMutex);
+    auto it = gEnvelopes.find(path);
+    if (it == gEnvelopes.end()) return;
+    RmsEnvelope& e = *it->second;
+    e.state = ok ? ANALYSIS_READY : ANALYSIS_FAILED;
+    if (ok) {
+        e.sampleRate = data[0];
+        e.values.assign(data.begin() + 1, data.end());
+    }
+}
+
+// Deteccion de onsets y tempo: mono a 22050 Hz, ventanas Hann de 1024 con salto de 256 (~86 valores
+// por segundo). El flujo espectral (aumento del log de la magnitud por bin) se reparte por tramos
+// entre varios hilos; los onsets son sus picos sobre una media local. El tempo sale de la
+// autocorrelacion del flujo entre 60 y 200 bpm (con preferencia suave por ~120) y la fase, de la
+// rejilla de ese periodo que mas flujo acumula; los dos se afinan con una recta por los onsets
+static const ma_uint32 kTempoSampleRate = 22050;
+static const ma_uint32 kTempoFftSize = 1024;
+static const ma_uint32 kTempoHop = 256;
+static const double kTwoPi = 6.283185307179586;
+
+// FFT compleja radix 2 in situ (n potencia de 2) con tablas precalculadas
+struct Fft {
+    ma_uint32 n = 0;
+    std::vector<ma_uint32> rev;
+    std::vector<float> cosT, sinT;
+
+    explicit Fft(ma_uint32 size) : n(size), rev(size), cosT(size / 2), sinT(size / 2) {
+        ma_uint32 bits = 0;
+        while ((1u << bits) < n) ++bits;
+        for (ma_uint32 i = 0; i < n; ++i) {
+            ma_uint32 r = 0;
+            for (ma_uint32 b = 0; b < bits; ++b) r |= ((i >> b) & 1u) << (bits - 1 - b);
+            rev[i] = r;
+        }
+        for (ma_uint32 i = 0; i < n / 2; ++i) {
+            cosT[i] = (float)std::cos(kTwoPi * i / n);
+            sinT[i] = (float)-std::sin(kTwoPi * i / n);
+        }
+    }
+
+    void run(float* re, float* im) const {
+        for (ma_uint32 i = 0; i < n; ++i) {
+            if (i < rev[i]) {
+                std::swap(re[i], re[rev[i]]);
+                std::swap(im[i], im[rev[i]]);
+            }
+        }
+        for (ma_uint32 len = 2; len <= n; len <<= 1) {
+            const ma_uint32 half = len >> 1, step = n / len;
+            for (ma_uint32 i = 0; i < n; i += len) {
+                for (ma_uint32 j = 0; j < half; ++j) {
+                    const float wr = cosT[j * step], wi = sinT[j * step];
+                    const ma_uint32 a = i + j, b = a + half;
+                    const float xr = re[b] * wr - im[b] * wi;
+                    const float xi = re[b] * wi + im[b] * wr;
+                    re[b] = re[a] - xr;
+                    im[b] = im[a] - xi;
+                    re[a] += xr;
+                    im[a] += xi;
+                }
+            }
+        }
+    }
+};
+
+// Flujo espectral de las ventanas [f0, f1) (la f0 se compara con la anterior, que se recalcula)
+static void spectral_flux_range(const Fft& fft, const std::vector<float>& window, const std::vector<float>& pcm,
+                                size_t f0, size_t f1, float* flux) {
+    const ma_uint32 n = fft.n, bins = n / 2;
+    std::vector<float> re(n), im(n), prev(bins, 0.0f), cur(bins);
+    auto spectrum = [&](size_t frame, std::vector<float>& mag) {
+        const size_t beg = frame * kTempoHop;
+        for (ma_uint32 i = 0; i < n; ++i) {
+            re[i] = (beg + i < pcm.size()) ? pcm[beg + i] * window[i] : 0.0f;
+            im[i] = 0.0f;
+        }
+        fft.run(re.data(), im.data());
+        for (ma_uint32 k = 0; k < bins; ++k) mag[k] = std::log1p(10.0f * std::sqrt(re[k] * re[k] + im[k] * im[k]));
+    };
+    if (f0 > 0) spectrum(f0 - 1, prev);
+    for (size_t f = f0; f < f1 && !gAnalysisStop.load(); ++f) {
+        spectrum(f, cur);
+        float sum = 0.0f;
+        for (ma_uint32 k = 0; k < bins; ++k) sum += std::max(0.0f, cur[k] - prev[k]);
+        flux[f] = (f == 0) ? 0.0f : sum;
+        prev.swap(cur);
+    }
+}
+
+static bool tempo_detect(const std::string& path, double& bpm, double& offsetSec, std::vector<float>& onsets) {
+    ma_decoder_config cfg = ma_decoder_config_init(ma_format_f32, 1, kTempoSampleRate);
+    ma_decoder dec;
+    if (ma_decoder_init_file(path.c_str(), &cfg, &dec) != MA_SUCCESS) return false;
+    std::vector<float> pcm;
+    std::vector<float> chunk(kAnalysisChunkFrames);
+    ma_uint64 read = 0;
+    while (!gAnalysisStop.load() && ma_decoder_read_pcm_frames(&dec, chunk.data(), kAnalysisChunkFrames, &read) == MA_SUCCESS && read > 0) {
+        pcm.insert(pcm.end(), chunk.begin(), chunk.begin() + (size_t)read);
+    }
+    ma_decoder_uninit(&dec);
+    const double fps = (double)kTempoSampleRate / kTempoHop;
+    if (gAnalysisStop.load() || pcm.size() < kTempoFftSize * 4) return false;
+
+    // Flujo espectral en paralelo
+    const size_t frames = (pcm.size() - kTempoFftSize) / kTempoHop + 1;
+    std::vector<float> flux(frames, 0.0f);
+    const Fft fft(kTempoFftSize);
+    std::vector<float> window(kTempoFftSize);
+    for (ma_uint32 i = 0; i < kTempoFftSize; ++i) window[i] = (float)(0.5 - 0.5 * std::cos(kTwoPi * i / kTempoFftSize));
+    const unsigned hw = std::thread::hardware_concurrency();
+    const size_t nThreads = std::max<size_t>(1, std::min<size_t>({ (size_t)(hw > 1 ? hw - 1 : 1), 4, frames / 512 + 1 }));
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < nThreads; ++t) {
+        workers.emplace_back(spectral_flux_range, std::cref(fft), std::cref(window), std::cref(pcm),
+            frames * t / nThreads, frames * (t + 1) / nThreads, flux.data());
+    }
+    spectral_flux_range(fft, window, pcm, 0, frames / nThreads, flux.data());
+    for (auto& w : workers) w.join();
+    if (gAnalysisStop.load()) return false;
+
+    // Onsets: maximos locales (+-3 ventanas) por encima de la media de +-0.1 s mas un margen
+    const float peak = *std::max_element(flux.begin(), flux.end());
+    if (!(peak > 0.0f)) return false;
+    const size_t w = (size_t)(0.1 * fps);
+    const double centerSec = 0.5 * kTempoFftSize / kTempoSampleRate;
+    std::vector<double> prefix(frames + 1, 0.0);
+    for (size_t f = 0; f < frames; ++f) prefix[f + 1] = prefix[f] + flux[f];
+    size_t lastOnset = 0;
+    for (size_t f = 1; f < frames; ++f) {
+        const size_t a = (f > w) ? f - w : 0, b = std::min(frames, f + w + 1);
+        const double mean = (prefix[b] - prefix[a]) / (double)(b - a);
+        if (flux[f] < mean + 0.05 * peak) continue;
+        bool isMax = true;
+        for (size_t k = (f > 3 ? f - 3 : 0); k < std::min(frames, f + 4) && isMax; ++k) {
+            if (flux[k] > flux[f] || (flux[k] == flux[f] && k < f)) isMax = false;
+        }
+        if (!isMax || (!onsets.empty() && f - lastOnset < 3)) continue;
+        onsets.push_back((float)(f / fps + centerSec));
+        lastOnset = f;
+    }
+
+    // Tempo: autocorrelacion del flujo sin media
+    const double mean = prefix[frames] / (double)frames;
+    std::vector<float> odf(frames);
+    for (size_t f = 0; f < frames; ++f) odf[f] = (float)std::max(0.0, flux[f] - mean);
+    const size_t lagMin = (size_t)std::floor(fps * 60.0 / 200.0), lagMax = (size_t)std::ceil(fps * 60.0 / 60.0);
+    if (frames < lagMax * 2) return false;
+    std::vector<double> score(lagMax + 2, 0.0);
+    for (size_t lag = lagMin; lag <= lagMax + 1; ++lag) {
+        double ac = 0.0;
+        for (size_t f = lag; f < frames; ++f) ac += (double)odf[f] * odf[f - lag];
+        const double b = 60.0 * fps / (double)lag;
+        const double oct = std::log2(b / 120.0);
+        score[lag] = ac / (double)(frames - lag) * std::exp(-0.5 * oct * oct);
+    }
+    size_t best = lagMin;
+    for (size_t lag = lagMin; lag <= lagMax; ++lag) {
+        if (score[lag] > score[best]) best = lag;
+    }
+    double lag = (double)best;
+    if (best > lagMin) {
+        const double y0 = score[best - 1], y1 = score[best], y2 = score[best + 1];
+        const double den = y0 - 2.0 * y1 + y2;
+        if (den < 0.0) lag += 0.5 * (y0 - y2) / den;
+    }
+    bpm = 60.0 * fps / lag;
+
+    // Fase: desfase de la rejilla (en ventanas) que acumula mas flujo
+    double bestSum = -1.0, bestPhase = 0.0;
+    for (double phase = 0.0; phase < lag; phase += 0.25) {
+        double sum = 0.0;
+        for (double x = phase; x < (double)frames; x += lag) {
+            const size_t i = (size_t)x;
+            const double fr = x - (double)i;
+            sum += odf[i] * (1.0 - fr) + ((i + 1 < frames) ? odf[i + 1] * fr : 0.0);
+        }
+        if (sum > bestSum) {
+            bestSum = sum;
+            bestPhase = phase;
+        }
+    }
+    offsetSec = bestPhase / fps + centerSec;
+
+    // Ajuste fino: recta por minimos cuadrados de los onsets que caen cerca de un beat de la rejilla
+    // (el periodo de la autocorrelacion va en ventanas enteras y un error pequeno se acumula)
+    double period = 60.0 / bpm;
+    for (int pass = 0; pass < 2; ++pass) {
+        double sk = 0.0, st = 0.0, skk = 0.0, skt = 0.0, cnt = 0.0;
+        for (float t : onsets) {
+            const double k = std::floor((t - offsetSec) / period + 0.5);
+            if (k < 0.0 || std::fabs(t - (offsetSec + k * period)) > 0.25 * period) continue;
+            sk += k;
+            st += t;
+            skk += k * k;
+            skt += k * t;
+            cnt += 1.0;
+        }
+        const double den = cnt * skk - sk * sk;
+        if (cnt < 8.0 || den <= 0.0) break;
+        const double p = (cnt * skt - sk * st) / den;
+        if (std::fabs(p - period) > 0.02 * period) break;
+        period = p;
+        offsetSec = (st - period * sk) / cnt;
+    }
+    bpm = 60.0 / period;
+    offsetSec = std::fmod(offsetSec, period);
+    if (offsetSec < 0.0) offsetSec += period;
+    return true;
+}
+
+// Job de tempo. En la cache: bpm, offset y los onsets
+static void tempo_job(const std::string& path) {
+    std::vector<float> data;
+    double bpm = 0.0, offsetSec = 0.0;
+    std::vector<float> onsets;
+    bool ok = analysis_cache_load(path, "tempo", data) && data.size() >= 2;
+    if (ok) {
+        bpm = data[0];
+        offsetSec = data[1];
+        onsets.assign(data.begin() + 2, data.end());
+    }
+    else {
+        ok = tempo_detect(path, bpm, offsetSec, onsets);
+        if (ok && !gAnalysisStop.load()) {
+            data.assign({ (float)bpm, (float)offsetSec });
+            data.insert(data.end(), onsets.begin(), onsets.end());
+            analysis_cache_save(path, "tempo", data);
+        }
+    }
+    if (gAnalysisStop.load()) return;
+    std::lock_guard<std::mutex> lk(gAnalysisMutex);
+    auto it = gTempoAnalyses.find(path);
+    if (it == gTempoAnalyses.end()) return;
+    TempoAnalysis& a = *it->second;
+    a.state = ok ? ANALYSIS_READY : ANALYSIS_FAILED;
+    a.bpm = bpm;
+    a.offsetSec = offsetSec;
+    a.onsets.swap(onsets);
+}
+
+// Analisis de tempo listo de un archivo (nullptr si no). El caller debe tomar gAnalysisMutex
+static const TempoAnalysis* tempo_ready_locked(const char* path) {
+    if (path == nullptr) return nullptr;
+    auto it = gTempoAnalyses.find(path);
+    return (it != gTempoAnalyses.end() && it->second->state == ANALYSIS_READY) ? it->second.get() : nullptr;
+}
+
+// Valor de la envolvente en el frame 'frame' del archivo, interpolado entre ventanas (centro de cada
+// ventana). O(1). El caller debe tomar gAnalysisMutex
+static double envelope_value_locked(const RmsEnvelope& e, double frame) {
+    if (e.values.empty()) return 0.0;
+    const double x = std::max(0.0, frame * e.rateHz / e.sampleRate - 0.5);
+    const size_t i = (size_t)x;
+    if (i + 1 >= e.values.size()) return e.values.back();
+    const double f = x - (double)i;
+    return e.values[i] + (e.values[i + 1] - e.values[i]) * f;
+}
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// GRABACION DE LLAMADAS (record)
+// - cada funcion exportada escribe su opcode, un timestamp en us y sus argumentos
+// - formato: cabecera "GMAR" + u32 version, y por registro:
+//     u8 op, u32 seq, u64 tUs, u8 argc, args (u8 'd' + f64 | u8 's' + u16 len + bytes)
+// - las llamadas que crean handles escriben ademas un REC_RESULT con el id devuelto
+//   (seq del registro original) para poder remapear los ids en el replay
+// - los opcodes son parte del formato: no renumerar, solo anadir al final
+// - las funciones de diagnostico (record, replay, stats, bench) no se graban, ni las llamadas que
+//   replay y los bench hacen a las funciones exportadas (RecMute)
+////////////////////////////////////////////////////////////////////////////////////////
+enum RecOp : ma_uint8 {
+    REC_INIT = 1,
+    REC_INIT_OFFLINE = 2,
+    REC_SHUTDOWN = 3,
+    REC_PLAY = 4,
+    REC_STOP = 5,
+    REC_PAUSE = 6,
+    REC_RESUME = 7,
+    REC_SET_VOLUME = 8,
+    REC_SET_LOOP = 9,
+    REC_TRANSPORT_PLAY = 10,
+    REC_TRANSPORT_PAUSE = 11,
+    REC_TRANSPORT_STOP = 12,
+    REC_SET_TEMPO = 13,
+    REC_GET_BEAT = 14,
+    REC_LOAD_PRESET = 15,
+    REC_PLAY_ON_BEAT = 16,
+    REC_TICK = 17,
+    REC_SONG_LOAD = 18,
+    REC_SONG_PLAY = 19,
+    REC_SONG_STOP = 20,
+    REC_SONG_SET_LOOP = 21,
+    REC_SET_LOAD_MODE = 22,
+    REC_TRANSPORT_CREATE = 23,
+    REC_TRANSPORT_DESTROY = 24,
+    REC_TRANSPORT_PLAY_H = 25,
+    REC_TRANSPORT_PAUSE_H = 26,
+    REC_TRANSPORT_STOP_H = 27,
+    REC_TRANSPORT_SET_TEMPO_H = 28,
+    REC_TRANSPORT_GET_BEAT_H = 29,
+    REC_TRANSPORT_TEMPO_POINT_H = 30,
+    REC_TRANSPORT_CLEAR_TEMPO_MAP_H = 31,
+    REC_PLAY_ON_BEAT_H = 32,
+    REC_SONG_SET_TRANSPORT = 33,
+    REC_SONG_CREATE = 34,
+    REC_SONG_DESTROY = 35,
+    REC_SONG_PLAY_H = 36,
+    REC_SONG_STOP_H = 37,
+    REC_SONG_SET_LOOP_H = 38,
+    REC_SONG_SET_MUTE_H = 39,
+    REC_SONG_SET_VOLUME_H = 40,
+    REC_SONG_SET_TRANSPORT_H = 41,
+    REC_STEMS_CREATE = 42,
+    REC_STEMS_ADD = 43,
+    REC_STEMS_SET_CURVE = 44,
+    REC_STEMS_PLAY = 45,
+    REC_STEMS_STOP = 46,
+    REC_STEMS_SET_INTENSITY = 47,
+    REC_STEMS_DESTROY = 48,
+    REC_SET_LOOKAHEAD = 49,
+    REC_SONG_PLAY_QUANTIZED_H = 50,
+    REC_SONG_TRANSITION_H = 51,
+    REC_SONG_STINGER_H = 52,
+    REC_TRANSPORT_SEEK = 53,
+    REC_TRANSPORT_SEEK_H = 54,
+    REC_SET_LOOP_POINTS = 55,
+    REC_SET_LOOP_POINTS_BEATS = 56,
+    REC_PLAYLIST_CREATE = 57,
+    REC_PLAYLIST_ADD = 58,
+    REC_PLAYLIST_PLAY = 59,
+    REC_PLAYLIST_STOP = 60,
+    REC_PLAYLIST_SET_CROSSFADE = 61,
+    REC_PLAYLIST_SET_LOOP = 62,
+    REC_PLAYLIST_DESTROY = 63,
+    REC_PLAYLIST_GET_TRACK = 64,
+    REC_MUSIC_TRANSITION = 65,
+    REC_MUSIC_STOP = 66,
+    REC_PATTERN_CREATE = 67,
+    REC_PATTERN_SET_STEP = 68,
+    REC_PATTERN_CLEAR_STEP = 69,
+    REC_PATTERN_SET_VELOCITY = 70,
+    REC_AUTOMATION_CREATE = 71,
+    REC_AUTOMATION_ADD_POINT = 72,
+    REC_AUTOMATION_SET_LOOP = 73,
+    REC_AUTOMATION_CLEAR = 74,
+    REC_AUTOMATION_DESTROY = 75,
+    REC_LFO_CREATE = 76,
+    REC_LFO_SET = 77,
+    REC_LFO_SET_PHASE = 78,
+    REC_LFO_DESTROY = 79,
+    REC_SET_LOWPASS = 80,
+    REC_CHART_CREATE = 81,
+    REC_CHART_ADD_NOTE = 82,
+    REC_CHART_DESTROY = 83,
+    REC_JUDGE_SET_CHART = 84,
+    REC_JUDGE_SET_WINDOWS = 85,
+    REC_JUDGE_SET_CALIBRATION = 86,
+    REC_JUDGE_RESET = 87,
+    REC_JUDGE_INPUT = 88,
+    REC_CHART_LOAD = 89,
+    REC_CHART_SAVE = 90,
+    REC_ANALYSIS_SET_CACHE_DIR = 91,
+    REC_ENVELOPE_REQUEST = 92,
+    REC_TEMPO_ANALYZE = 93,
+    REC_TEMPO_APPLY_H = 94,
+    REC_DELAY_CREATE = 95,
+    REC_DELAY_SET = 96,
+    REC_DELAY_SET_MIX = 97,
+    REC_DELAY_SEND = 98,
+    REC_DELAY_DESTROY = 99,
+    REC_RESULT = 255
+};
+
+static const ma_uint32 kRecVersion = 1;
+
+// Argumento grabado: numero o cadena
+struct RecArg {
+    const char* s = nullptr;
+    double d = 0.0;
+    RecArg(double v) : d(v) {}
+    RecArg(const char* v) : s(v ? v : "") {}
+};
+
+static std::atomic<bool> gRecOn{ false };
+static std::mutex gRecMutex;            // independiente de gMutex: se graba antes de bloquear
+static FILE* gRecFile = nullptr;
+static std::vector<ma_uint8> gRecBuf;   // se vuelca a disco por bloques
+static ma_uint32 gRecSeq = 0;
+static std::chrono::steady_clock::time_point gRecT0;
+// Mientras sea > 0 no se graba nada, desde ningun hilo (los bench llaman desde hilos propios)
+static std::atomic<int> gRecMuted{ 0 };
+
+// Silencia la grabacion durante un replay o un bench: sus llamadas no son del juego
+struct RecMute {
+    RecMute() { gRecMuted.fetch_add(1); }
+    ~RecMute() { gRecMuted.fetch_sub(1); }
+};
+
+static void rec_put(const void* p, size_t n) {
+    const ma_uint8* b = (const ma_uint8*)p;
+    gRecBuf.insert(gRecBuf.end(), b, b + n);
+}
+
+static void rec_flush_unlocked() {
+    if (gRecFile && !gRecBuf.empty()) fwrite(gRecBuf.data(), 1, gRecBuf.size(), gRecFile);
+    gRecBuf.clear();
+}
+
+static void rec_write_unlocked(ma_uint8 op, ma_uint32 seq, std::initializer_list<RecArg> args) {
+    const ma_uint64 tUs = (ma_uint64)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - gRecT0).count();
+    const ma_uint8 argc = (ma_uint8)args.size();
+    rec_put(&op, 1);
+    rec_put(&seq, 4);
+    rec_put(&tUs, 8);
+    rec_put(&argc, 1);
+    for (const RecArg& a : args) {
+        if (a.s) {
+            const ma_uint8 tag = 's';
+            size_t len = strlen(a.s);
+            if (len > 0xFFFF) len = 0xFFFF;
+            const ma_uint16 len16 = (ma_uint16)len;
+            rec_put(&tag, 1);
+            rec_put(&len16, 2);
+            rec_put(a.s, len);
+        }
+        else {
+            const ma_uint8 tag = 'd';
+            rec_put(&tag, 1);
+            rec_put(&a.d, 8);
+        }
+    }
+    if (gRecBuf.size() >= 64 * 1024) rec_flush_unlocked();
+}
+
+// Graba una llamada. Devuelve su seq (0 si la grabacion esta apagada)
+static inline ma_uint32 rec_call(ma_uint8 op, std::initializer_list<RecArg> args = {}) {
+    if (!gRecOn.load(std::memory_order_relaxed) || gRecMuted.load(std::memory_order_relaxed) > 0) return 0;
+    std::lock_guard<std::mutex> lock(gRecMutex);
+    if (!gRecFile) return 0;
+    const ma_uint32 seq = ++gRecSeq;
+    rec_write_unlocked(op, seq, args);
+    return seq;
+}
+
+// Graba el handle devuelto por la llamada con numero seq
+static inline void rec_result(ma_uint32 seq, int id) {
+    if (seq == 0 || !gRecOn.load(std::memory_order_relaxed)) return;
+    std::lock_guard<std::mutex> lock(gRecMutex);
+    if (!gRecFile) return;
+    rec_write_unlocked(REC_RESULT, seq, { (double)id });
+}
+
+// Resetea las estructuras globales al arrancar el engine (el caller debe tomar gMutex)
+static void reset_state_unlocked() {
+    gSounds.clear();
+    gSoundPaths.clear();
+    gPausedFrame.clear();
+    gQueue.clear();
+
+    // Transport por defecto
+    gTransport.playing.store(false);
+    gTransport.bpm.store(120.0);
+    gTransport.baseBeat = 0.0;
+    gTransport.tempoMap.clear();
+    gTransports.clear();
+    gSong = Song{};
+    gSongs.clear();
+    gLoopMeta.clear();
+    automation_clear_unlocked();
+    gCharts.clear();
+    gJudge = JudgeState{};
+}
+
+// Bufer de trabajo de gm_audio_render (solo lo usa el hilo que renderiza)
+static std::vector<float> gRenderScratch;
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////
+// API C exportada para GameMaker
+////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////
+
+extern "C" {
+
+
+    // Inicializa miniaudio y limpia estados
+    __declspec(dllexport) double gm_audio_init() {
+        rec_call(REC_INIT);
+        MutexGuard lock;
+        if (gEngineIniciado) return 1.0;
+
+        ma_engine_config cfg = ma_engine_config_init();
+        cfg.onProcess = engine_on_process;
+        cfg.dataCallback = engine_data_callback;
+        rt_set_allocation_callbacks(cfg);
+        ma_result res = ma_engine_init(&cfg, &gEngine);
+        if (res == MA_SUCCESS) {
+            gClockNodeReady = clock_node_init();
+            gEngineIniciado = true;
+            gEngineOffline = false;
+            reset_state_unlocked();
+            return 1.0;
+        }
+        return 0.0;
+    }
+
+
+    // Inicializa miniaudio sin dispositivo (engine offline/null)
+    // El audio no suena: avanza solo al llamar a gm_audio_render. Util para replay, pruebas y perfiles
+    __declspec(dllexport) double gm_audio_init_offline(double sampleRate, double channels) {
+        rec_call(REC_INIT_OFFLINE, { sampleRate, channels });
+        MutexGuard lock;
+        if (gEngineIniciado) return gEngineOffline ? 1.0 : 0.0;
+        if (sampleRate <= 0.0) sampleRate = 48000.0;
+        if (channels <= 0.0) channels = 2.0;
+
+        ma_engine_config cfg = ma_engine_config_init();
+        cfg.noDevice = MA_TRUE;
+        cfg.sampleRate = (ma_uint32)sampleRate;
+        cfg.channels = (ma_uint32)channels;
+        cfg.onProcess = engine_on_process;
+        rt_set_allocation_callbacks(cfg);
+        if (ma_engine_init(&cfg, &gEngine) != MA_SUCCESS) return 0.0;
+        gClockNodeReady = clock_node_init();
+
+        gEngineIniciado = true;
+        gEngineOffline = true;
+        reset_state_unlocked();
+        return 1.0;
+    }
+
+
+    // Renderiza (y descarta) frames del engine offline. Hace de hilo de audio: no toma gMutex
+    // Devuelve los frames renderizados
+    __declspec(dllexport) double gm_audio_render(double frames) {
+        if (!gEngineIniciado || !gEngineOffline || frames <= 0.0) return 0.0;
+        const ma_uint32 channels = ma_engine_get_channels(&gEngine);
+        const ma_uint64 chunk = 1024;
+        if (gRenderScratch.size() < chunk * channels) gRenderScratch.resize(chunk * channels);
+        ma_uint64 remaining = (ma_uint64)frames;
+        ma_uint64 total = 0;
+        AudioThreadScope audioThread;
+        while (remaining > 0) {
+            const ma_uint64 n = (remaining < chunk) ? remaining : chunk;
+            ma_uint64 read = 0;
+            if (ma_engine_read_pcm_frames(&gEngine, gRenderScratch.data(), n, &read) != MA_SUCCESS || read == 0) break;
+            total += read;
+            remaining -= read;
+        }
+        return (double)total;
+    }
+
+    // Apaga el engine y libera todos los sonidos
+    __declspec(dllexport) double gm_audio_shutdown() {
+        rec_call(REC_SHUTDOWN);
+        MutexGuard lock;
+        analysis_stop();
+        if (!gEngineIniciado) return 1.0;
+        automation_clear_unlocked();
+        for (auto& kv : gSounds) {
+            schedule_sound_delete(kv.second);
+        }
+        gSounds.clear();
+        gSoundPaths.clear();
+        gPausedFrame.clear();
+        gQueue.clear();
+        gSong = Song{};
+        gSongs.clear();
+        voice_pools_clear_unlocked();
+        for (auto& kv : gStemGroups) stem_group_release_unlocked(*kv.second);
+        gStemGroups.clear();
+        for (auto& kv : gPlaylists) {
+            playlist_close_track_unlocked(kv.second->cur);
+            playlist_close_track_unlocked(kv.second->next);
+        }
+        gPlaylists.clear();
+        music_slot_release_unlocked(0, true);
+        music_slot_release_unlocked(1, true);
+        if (gMusic.nodeReady) ma_node_uninit(&gMusic.node.base, NULL);
+        gMusic.nodeReady = false;
+        delete gMusic.fade.exchange(nullptr);
+        gMusic.active = -1;
+        gMusic.silent = true;
+        gTransports.clear();
+        // Los sonidos pendientes se destruyen aqui: despues de ma_engine_uninit ya no se podrian liberar
+        // (y un init posterior, p.ej. en un replay, los liberaria contra un engine nuevo)
+        flush_pending_deletes_unlocked();
+        loop_sources_clear_unlocked();
+        clock_node_uninit();
+        ma_engine_uninit(&gEngine);
+        gEngineIniciado = false;
+        gEngineOffline = false;
+        return 1.0;
+    }
+
+
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // REPRODUCCION BASICA
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Crea y reproduce un sonido desde archivo
+    __declspec(dllexport) double gm_audio_play(const char* path) {
+        const ma_uint32 rseq = rec_call(REC_PLAY, { path });
+        if (!gEngineIniciado || path == nullptr) return 0.0;
+        MutexGuard lock;
+        ma_sound* s = new ma_sound();
+        ma_result res = sound_init_from_file_looped(s, path, gLoadFlags.load());
+        if (res != MA_SUCCESS) {
+            delete s;
+            return 0.0;
+        }
+        ma_sound_start(s);
+        int id = makeId();
+        gSounds[id] = s;
+        gSoundPaths[id] = path;
+        gPausedFrame.erase(id);
+        rec_result(rseq, id);
+        return (double)id;
+    }
+
+
+    // Detiene y destruye un sonido existente por ID
+    __declspec(dllexport) double gm_audio_stop(double idd) {
+        rec_call(REC_STOP, { idd });
+        int id = (int)idd;
+        MutexGuard lock;
+        auto it = gSounds.find(id);
+        if (it == gSounds.end()) return 0.0;
+        automation_target_gone_unlocked(id);
+        ma_sound_stop(it->second);
+        schedule_sound_delete(it->second);
+        gSounds.erase(it);
+        gSoundPaths.erase(id);
+        gPausedFrame.erase(id);
+        return 1.0;
+    }
+
+
+    // Pausa guarda la posicion en frames y para el sonido
     // Devuelve 1 si ok, 0 si el ID no existe o get_cursor falla
     __declspec(dllexport) double gm_audio_pause(double idd) {
+        rec_call(REC_PAUSE, { idd });
         int id = (int)idd;
-        std::lock_guard<std::mutex> lock(gMutex);
+        MutexGuard lock;
         auto it = gSounds.find(id);
         if (it == gSounds.end()) return 0.0;
         ma_uint64 frame = 0;
         if (ma_sound_get_cursor_in_pcm_frames(it->second, &frame) != MA_SUCCESS)
             return 0.0;
-        gPausedFrame[id] = frame;
-        ma_sound_stop(it->second);
+        gPausedFrame[id] = frame;
+        ma_sound_stop(it->second);
+        return 1.0;
+    }
+
+
+    // Resume si hay una posicion almacenada, hace seek y arranca
+    // Devuelve 1 si arranca, 0 si algo falla o no existe el ID
+    __declspec(dllexport) double gm_audio_resume(double idd) {
+        rec_call(REC_RESUME, { idd });
+        int id = (int)idd;
+        MutexGuard lock;
+        auto it = gSounds.find(id);
+        if (it == gSounds.end()) return 0.0;
+        ma_uint64 frame = 0;
+        auto itp = gPausedFrame.find(id);
+        if (itp != gPausedFrame.end()) frame = itp->second;
+        if (frame > 0) {
+            ma_sound_seek_to_pcm_frame(it->second, frame);
+        }
+        if (ma_sound_start(it->second) != MA_SUCCESS)
+            return 0.0;
+        gPausedFrame.erase(id);
+        return 1.0;
+    }
+
+
+    // Volumen de 0 a 1
+    __declspec(dllexport) double gm_audio_set_volume(double idd, double v) {
+        rec_call(REC_SET_VOLUME, { idd, v });
+        int id = (int)idd;
+        float vol = (float)v;
+        if (vol < 0.f) vol = 0.f;
+        if (vol > 1.f) vol = 1.f;
+        MutexGuard lock;
+        auto it = gSounds.find(id);
+        if (it == gSounds.end()) return 0.0;
+        ma_sound_set_volume(it->second, vol);
+        return 1.0;
+    }
+
+
+    // Modo de carga de los siguientes play / play_on_beat
+    // 0 por defecto (datos codificados en memoria), 1 decodificado completo, 2 streaming desde disco
+    __declspec(dllexport) double gm_audio_set_load_mode(double mode) {
+        rec_call(REC_SET_LOAD_MODE, { mode });
+        const int m = (int)mode;
+        if (m == 0) gLoadFlags.store(0);
+        else if (m == 1) gLoadFlags.store(MA_SOUND_FLAG_DECODE);
+        else if (m == 2) gLoadFlags.store(MA_SOUND_FLAG_STREAM);
+        else return 0.0;
+        return 1.0;
+    }
+
+
+    // Loop on/off
+    __declspec(dllexport) double gm_audio_set_loop(double idd, double flag) {
+        rec_call(REC_SET_LOOP, { idd, flag });
+        int id = (int)idd;
+        ma_bool32 loop = (flag != 0.0) ? MA_TRUE : MA_FALSE;
+        MutexGuard lock;
+        auto it = gSounds.find(id);
+        if (it == gSounds.end()) return 0.0;
+        ma_sound_set_looping(it->second, loop);
+        return 1.0;
+    }
+
+
+    // Puntos de loop en frames del archivo, a su frecuencia propia (endFrame <= 0 = final del archivo).
+    // El loop se activa con gm_audio_set_loop: lo anterior a startFrame (la intro) suena una vez y luego
+    // se repite start..end
+    __declspec(dllexport) double gm_audio_set_loop_points(double idd, double startFrame, double endFrame) {
+        rec_call(REC_SET_LOOP_POINTS, { idd, startFrame, endFrame });
+        if (startFrame < 0.0) return 0.0;
+        MutexGuard lock;
+        auto it = gSounds.find((int)idd);
+        if (it == gSounds.end()) return 0.0;
+        const ma_uint64 end = (endFrame > 0.0) ? sound_file_to_engine_frames(it->second, (ma_uint64)endFrame) : 0;
+        return sound_set_loop_points(it->second, sound_file_to_engine_frames(it->second, (ma_uint64)startFrame), end) ? 1.0 : 0.0;
+    }
+
+
+    // Puntos de loop en beats del archivo a 'bpm' (<= 0 usa el tempo actual del transport 0)
+    __declspec(dllexport) double gm_audio_set_loop_points_beats(double idd, double startBeat, double endBeat, double bpm) {
+        rec_call(REC_SET_LOOP_POINTS_BEATS, { idd, startBeat, endBeat, bpm });
+        if (startBeat < 0.0) return 0.0;
+        MutexGuard lock;
+        auto it = gSounds.find((int)idd);
+        if (it == gSounds.end()) return 0.0;
+        if (bpm <= 0.0) bpm = transport_bpm_at(gTransport, transport_get_beat_unlocked(gTransport));
+        ma_uint32 sr = 0;
+        ma_sound_get_data_format(it->second, NULL, NULL, &sr, NULL, 0);
+        const double framesPerBeat = 60.0 / bpm * (double)sr;
+        const ma_uint64 end = (endBeat > 0.0) ? (ma_uint64)(endBeat * framesPerBeat + 0.5) : 0;
+        return sound_set_loop_points(it->second, (ma_uint64)(startBeat * framesPerBeat + 0.5), end) ? 1.0 : 0.0;
+    }
+
+
+
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // TRANSPORT
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Pone el transport en marcha. Si ya estaba en play, no reinicia baseBeat
+    static double transport_play_unlocked(Transport& t) {
+        if (!gEngineIniciado) return 0.0;
+        if (!t.playing.load()) {
+            t.startTime = transport_now();
+            t.playing.store(true);
+            transport_clock_publish_unlocked(t);
+        }
+        return 1.0;
+    }
+
+
+    // Pausa el transport acumulando el beat actual en baseBeat
+    static double transport_pause_unlocked(Transport& t) {
+        if (!gEngineIniciado) return 0.0;
+        if (t.playing.load()) {
+            t.baseBeat = transport_get_beat_unlocked(t);
+            t.playing.store(false);
+            transport_clock_publish_unlocked(t);
+        }
+        return 1.0;
+    }
+
+
+    // Para el transport y resetea el contador a 0. El mapa de tempo se conserva
+    // Limpia los lanzamientos cuantizados de ese transport y reinicia la cancion si lo sigue
+    static double transport_stop_unlocked(int th, Transport& t) {
+        if (!gEngineIniciado) return 0.0;
+
+        // Para el transport y resetea el beat base a 0
+        t.playing.store(false);
+        t.baseBeat = 0.0;
+        transport_clock_publish_unlocked(t);
+
+        // Limpiar cola de lanzamientos cuantizados
+        gQueue.erase(std::remove_if(gQueue.begin(), gQueue.end(),
+            [th](const PendingLaunch& pl) { return pl.transport == th; }), gQueue.end());
+
+        // Parar voces y reiniciar las canciones de este transport: empezar desde el principio
+        for_each_song_unlocked([th](int songId, Song& s) {
+            if (s.transport != th) return;
+            song_clear_voices_unlocked(songId);
+            song_rewind(s, 0.0);
+        });
+        automation_songs_changed_unlocked();
+
+        return 1.0;
+    }
+
+
+    // Lleva el transport a 'beat' sin cambiar su estado de play
+    // Descarta los lanzamientos cuantizados de ese transport anteriores a 'beat', recoloca las
+    // canciones que lo siguen y, si es el transport 0, los grupos de stems y la musica que suenan
+    static double transport_seek_unlocked(int th, Transport& t, double beat) {
+        if (!gEngineIniciado || beat < 0.0) return 0.0;
+        t.baseBeat = beat;
+        if (t.playing.load()) t.startTime = transport_now();
+        transport_clock_publish_unlocked(t);
+
+        gQueue.erase(std::remove_if(gQueue.begin(), gQueue.end(),
+            [th, beat](const PendingLaunch& pl) { return pl.transport == th && pl.targetBeat < beat - 1e-9; }), gQueue.end());
+
+        for_each_song_unlocked([th, beat](int songId, Song& s) {
+            if (s.transport == th) song_seek_unlocked(songId, s, beat);
+        });
+
+        if (th == 0) {
+            for (auto& kv : gStemGroups) {
+                if (kv.second->playing) stem_group_seek_unlocked(*kv.second, t, beat);
+            }
+            music_seek_unlocked(t, beat);
+        }
+        return 1.0;
+    }
+
+
+    // Pone el transport en marcha. Si ya estaba en play, no reinicia baseBeat
+    __declspec(dllexport) double gm_audio_transport_play() {
+        rec_call(REC_TRANSPORT_PLAY);
+        MutexGuard lock;
+        return transport_play_unlocked(gTransport);
+    }
+
+
+    // Pausa el transport acumulando el beat actual en baseBeat
+    __declspec(dllexport) double gm_audio_transport_pause() {
+        rec_call(REC_TRANSPORT_PAUSE);
+        MutexGuard lock;
+        return transport_pause_unlocked(gTransport);
+    }
+
+
+    // Para el transport y resetea el contador a 0.
+    __declspec(dllexport) double gm_audio_transport_stop() {
+        rec_call(REC_TRANSPORT_STOP);
+        MutexGuard lock;
+        return transport_stop_unlocked(0, gTransport);
+    }
+
+
+    // Salta a un beat (>= 0) manteniendo el estado de play. Para modos de practica y checkpoints
+    __declspec(dllexport) double gm_audio_transport_seek(double beat) {
+        rec_call(REC_TRANSPORT_SEEK, { beat });
+        MutexGuard lock;
+        return transport_seek_unlocked(0, gTransport, beat);
+    }
+
+
+
+
+    // Cambia el BPM manteniendo la continuidad del beat
+    __declspec(dllexport) double gm_audio_set_tempo(double bpm) {
+        rec_call(REC_SET_TEMPO, { bpm });
+        MutexGuard lock;
+        if (bpm <= 0.0) return 0.0;
+        transport_set_tempo_unlocked(gTransport, bpm);
+        return 1.0;
+    }
+
+
+
+    // Devuelve el beat actual como double
+    __declspec(dllexport) double gm_audio_get_beat_position() {
+        rec_call(REC_GET_BEAT);
+        MutexGuard lock;
+        return transport_get_beat_unlocked();
+    }
+
+
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // TRANSPORTS POR HANDLE
+    // - cada transport tiene su bpm, su estado de play y su mapa de tempo
+    // - el handle 0 es el transport por defecto (el mismo que usa la API sin _h)
+    // - todos se avanzan en el mismo gm_audio_transport_tick
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Crea un transport nuevo (parado, 120 bpm). Devuelve su handle o 0 si falla
+    __declspec(dllexport) double gm_audio_transport_create() {
+        const ma_uint32 rseq = rec_call(REC_TRANSPORT_CREATE);
+        if (!gEngineIniciado) return 0.0;
+        MutexGuard lock;
+        int id = makeId();
+        gTransports[id] = std::unique_ptr<Transport>(new Transport());
+        rec_result(rseq, id);
+        return (double)id;
+    }
+
+
+    // Destruye un transport. Sus lanzamientos pendientes se descartan (los sonidos siguen existiendo)
+    // y las canciones y carriles de automatizacion que lo seguian vuelven al transport por defecto
+    __declspec(dllexport) double gm_audio_transport_destroy(double h) {
+        rec_call(REC_TRANSPORT_DESTROY, { h });
+        const int th = (int)h;
+        MutexGuard lock;
+        auto it = gTransports.find(th);
+        if (it == gTransports.end()) return 0.0;
+        transport_stop_unlocked(th, *it->second);
+        for_each_song_unlocked([th](int, Song& s) {
+            if (s.transport == th) {
+                s.transport = 0;
+                s.playing = false;
+            }
+        });
+        for (auto& kv : gAutoLanes) {
+            if (kv.second->transport == th) kv.second->transport = 0;
+        }
+        for (auto& kv : gAutoLfos) {
+            if (kv.second->transport == th) kv.second->transport = 0;
+        }
+        for (auto& kv : gDelayBuses) {
+            if (kv.second->transport == th) kv.second->transport = 0;
+        }
+        std::unique_ptr<Transport> dead = std::move(it->second);
+        gTransports.erase(it);
+        // el hilo de audio lee el reloj del transport: se republica antes de liberarlo
+        automation_publish_unlocked();
+        return 1.0;
+    }
+
+
+    __declspec(dllexport) double gm_audio_transport_play_h(double h) {
+        rec_call(REC_TRANSPORT_PLAY_H, { h });
+        MutexGuard lock;
+        Transport* t = transport_find_unlocked(h);
+        return t ? transport_play_unlocked(*t) : 0.0;
+    }
+
+
+    __declspec(dllexport) double gm_audio_transport_pause_h(double h) {
+        rec_call(REC_TRANSPORT_PAUSE_H, { h });
+        MutexGuard lock;
+        Transport* t = transport_find_unlocked(h);
+        return t ? transport_pause_unlocked(*t) : 0.0;
+    }
+
+
+    __declspec(dllexport) double gm_audio_transport_stop_h(double h) {
+        rec_call(REC_TRANSPORT_STOP_H, { h });
+        MutexGuard lock;
+        Transport* t = transport_find_unlocked(h);
+        return t ? transport_stop_unlocked((int)h, *t) : 0.0;
+    }
+
+
+    __declspec(dllexport) double gm_audio_transport_seek_h(double h, double beat) {
+        rec_call(REC_TRANSPORT_SEEK_H, { h, beat });
+        MutexGuard lock;
+        Transport* t = transport_find_unlocked(h);
+        return t ? transport_seek_unlocked((int)h, *t, beat) : 0.0;
+    }
+
+
+    // Cambia el BPM de un transport manteniendo la continuidad del beat
+    __declspec(dllexport) double gm_audio_transport_set_tempo_h(double h, double bpm) {
+        rec_call(REC_TRANSPORT_SET_TEMPO_H, { h, bpm });
+        MutexGuard lock;
+        Transport* t = transport_find_unlocked(h);
+        if (!t || bpm <= 0.0) return 0.0;
+        transport_set_tempo_unlocked(*t, bpm);
+        return 1.0;
+    }
+
+
+    // Beat actual de un transport (-1 si no existe)
+    __declspec(dllexport) double gm_audio_transport_get_beat_h(double h) {
+        rec_call(REC_TRANSPORT_GET_BEAT_H, { h });
+        MutexGuard lock;
+        Transport* t = transport_find_unlocked(h);
+        return t ? transport_get_beat_unlocked(*t) : -1.0;
+    }
+
+
+    // Anade (o sustituye) un punto al mapa de tempo: desde 'beat' el transport va a 'bpm'
+    // Si el punto cae antes del beat actual el beat se mantiene y el tempo cambia ya
+    __declspec(dllexport) double gm_audio_transport_tempo_point_h(double h, double beat, double bpm) {
+        rec_call(REC_TRANSPORT_TEMPO_POINT_H, { h, beat, bpm });
+        MutexGuard lock;
+        Transport* t = transport_find_unlocked(h);
+        if (!t || bpm <= 0.0 || beat < 0.0) return 0.0;
+        // el beat actual se calcula con el mapa anterior y se reancla para no saltar
+        const double current = transport_get_beat_unlocked(*t);
+        auto it = std::lower_bound(t->tempoMap.begin(), t->tempoMap.end(), beat,
+            [](const TempoPoint& p, double b) { return p.beat < b; });
+        if (it != t->tempoMap.end() && std::fabs(it->beat - beat) < 1e-9) it->bpm = bpm;
+        else t->tempoMap.insert(it, TempoPoint{ beat, bpm });
+        t->baseBeat = current;
+        if (t->playing.load()) t->startTime = transport_now();
+        transport_clock_publish_unlocked(*t);
+        return 1.0;
+    }
+
+
+    // Vacia el mapa de tempo dejando como bpm base el tempo vigente
+    __declspec(dllexport) double gm_audio_transport_clear_tempo_map_h(double h) {
+        rec_call(REC_TRANSPORT_CLEAR_TEMPO_MAP_H, { h });
+        MutexGuard lock;
+        Transport* t = transport_find_unlocked(h);
+        if (!t) return 0.0;
+        const double current = transport_get_beat_unlocked(*t);
+        t->bpm.store(transport_bpm_at(*t, current));
+        t->tempoMap.clear();
+        t->baseBeat = current;
+        if (t->playing.load()) t->startTime = transport_now();
+        transport_clock_publish_unlocked(*t);
+        return 1.0;
+    }
+
+
+    // Convierte 'count' beats (f64 en bufferIn, de buffer_get_address) a segundos desde el beat 0 del
+    // transport th siguiendo su mapa de tempo, y los escribe como f64 en bufferOut (puede ser el mismo)
+    // Para una autopista de notas: posicion = (t_nota - t_beat_actual) * velocidad con una sola llamada
+    // por frame. Devuelve los beats convertidos (0 si falla). No se graba: son punteros de la partida
+    __declspec(dllexport) double gm_audio_beats_to_times_h(double h, void* bufferIn, void* bufferOut, double count) {
+        if (bufferIn == nullptr || bufferOut == nullptr || !(count > 0.0)) return 0.0;
+        MutexGuard lock;
+        Transport* t = transport_find_unlocked(h);
+        if (!t) return 0.0;
+        const size_t n = (size_t)count;
+        transport_beats_to_seconds(*t, (const double*)bufferIn, (double*)bufferOut, n);
+        return (double)n;
+    }
+
+
+    // gm_audio_beats_to_times_h sobre el transport por defecto
+    __declspec(dllexport) double gm_audio_beats_to_times(void* bufferIn, void* bufferOut, double count) {
+        return gm_audio_beats_to_times_h(0.0, bufferIn, bufferOut, count);
+    }
+
+
+
+
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // Preset JSON
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Lee un archivo JSON y, si tiene bpm, actualiza el transport
+    // Mantiene continuidad del beat en play, resetea a 0 en stop/pausa inicial.
+    __declspec(dllexport) double gm_audio_load_preset_file(const char* path) {
+        rec_call(REC_LOAD_PRESET, { path });
+        if (!gEngineIniciado || path == nullptr) return 0.0;
+        MutexGuard lock;
+        std::string txt;
+        if (!readTextFile(path, txt)) return 0.0;
+        double bpm = gTransport.bpm.load();
+        double parsed = bpm;
+        if (json_extract_bpm(txt, parsed) && parsed > 0.0) {
+            bpm = parsed;
+        }
+
+        // Aplica bpm con la misma logica que set_tempo
+        const bool playing = gTransport.playing.load();
+        transport_set_tempo_unlocked(gTransport, bpm);
+        if (!playing) {
+            // Si estaba parado/pausado, empezamos desde 0 para reflejar preset nuevo
+            gTransport.baseBeat = 0.0;
+        }
+        return 1.0;
+    }
+
+
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // Lanzamiento cuantizado al beat
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Prepara un sonido y lo programa para el proximo multiplo de quant beats
+    // 1 negras, 0.5 corcheas, 0.25 semicorcheas...
+    static double play_on_beat_impl(ma_uint32 rseq, double h, const char* path, double quant_beats) {
+        if (!gEngineIniciado || path == nullptr) return 0.0;
+        if (quant_beats <= 0.0) quant_beats = 1.0;
+        MutexGuard lock;
+        Transport* t = transport_find_unlocked(h);
+        if (!t) return 0.0;
+        ma_sound* s = new ma_sound();
+        if (sound_init_from_file_looped(s, path, gLoadFlags.load()) != MA_SUCCESS) {
+            delete s;
+            return 0.0;
+        }
+        int id = makeId();
+        gSounds[id] = s;
+        gSoundPaths[id] = path;
+        gPausedFrame.erase(id);
+
+        // Calcula el siguiente grid en beats
+        const double nowBeat = transport_get_beat_unlocked(*t);
+        const double q = quant_beats;
+        const double next = std::ceil(nowBeat / q) * q;
+
+        // Encola el lanzamiento
+        gQueue.push_back({ id, next, (int)h });
+        rec_result(rseq, id);
+        return (double)id;
+    }
+
+    __declspec(dllexport) double gm_audio_play_on_beat(const char* path, double quant_beats) {
+        const ma_uint32 rseq = rec_call(REC_PLAY_ON_BEAT, { path, quant_beats });
+        return play_on_beat_impl(rseq, 0.0, path, quant_beats);
+    }
+
+
+    // play_on_beat contra un transport concreto
+    __declspec(dllexport) double gm_audio_play_on_beat_h(double h, const char* path, double quant_beats) {
+        const ma_uint32 rseq = rec_call(REC_PLAY_ON_BEAT_H, { h, path, quant_beats });
+        return play_on_beat_impl(rseq, h, path, quant_beats);
+    }
+
+
+
+
+
+    // Tick de todos los transports: revisa la cola y dispara los sonidos cuyo targetBeat llegue
+    __declspec(dllexport) double gm_audio_transport_tick() {
+        rec_call(REC_TICK);
+        MutexGuard lock;
+        if (!gEngineIniciado) return 0.0;
+
+        // Un solo calculo de beat por transport y tick, y el beat hasta el que llega el lookahead
+        gTickFrame = ma_engine_get_time_in_pcm_frames(&gEngine);
+        auto prepare = [](Transport& t) {
+            t.tickBeat = transport_get_beat_unlocked(t);
+            t.horizonBeat = t.playing.load() ? transport_advance(t, t.tickBeat, gLookaheadSec) : t.tickBeat;
+            transport_clock_publish_unlocked(t);
+        };
+        prepare(gTransport);
+        for (auto& kv : gTransports) prepare(*kv.second);
+
+        for (auto it = gQueue.begin(); it != gQueue.end();) {
+            const Transport* t = transport_find_unlocked(it->transport);
+            if (t && !t->playing.load()) {
+                ++it;
+                continue;
+            }
+            if (!t || t->horizonBeat + 1e-6 >= it->targetBeat) {
+                auto itS = gSounds.find(it->id);
+                if (itS != gSounds.end()) {
+                    sound_schedule_start(itS->second, t ? transport_beat_to_frame_unlocked(*t, it->targetBeat) : gTickFrame);
+                }
+                it = gQueue.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        // Canciones: una sola pasada para todas. Heap por beats que faltan desde el final del lookahead
+        // hasta el siguiente evento de cada una; se programan los que caen dentro en orden y la cancion
+        // vuelve al heap con su siguiente evento
+        gSongHeap.clear();
+        for_each_song_unlocked([](int songId, Song& s) {
+            if (!s.loaded) return;
+            const Transport* t = transport_find_unlocked(s.transport);
+            if (!t || !t->playing.load()) return;
+            if (s.rearm) song_rearm_unlocked(songId, s, *t);
+            song_apply_hold_unlocked(songId, s, *t);
+            if (s.playing && !s.events.empty()) gSongHeap.push_back(SongDue{ song_next_beat(s) - t->horizonBeat, songId, &s, t });
+        });
+        std::make_heap(gSongHeap.begin(), gSongHeap.end(), std::greater<SongDue>());
+        while (!gSongHeap.empty() && gSongHeap.front().remaining <= 1e-6) {
+            std::pop_heap(gSongHeap.begin(), gSongHeap.end(), std::greater<SongDue>());
+            SongDue due = gSongHeap.back();
+            gSongHeap.pop_back();
+            Song& s = *due.song;
+            song_fire_next_unlocked(due.id, s, *due.transport);
+            if (s.playing) {
+                due.remaining = song_next_beat(s) - due.transport->horizonBeat;
+                gSongHeap.push_back(due);
+                std::push_heap(gSongHeap.begin(), gSongHeap.end(), std::greater<SongDue>());
+            }
+        }
+
+        for (auto& kv : gStemGroups) stem_group_try_start_unlocked(*kv.second);
+        for (auto& kv : gPlaylists) playlist_update_unlocked(*kv.second);
+        loop_sources_collect_unlocked();
+
+        // Procesar destruccin diferida de ma_sound
+        if (!gPendingDelete.empty()) flush_pending_deletes_unlocked();
+
+        return 1.0;
+    }
+
+
+
+
+
+    // Carga una cancion desde JSON en 's' (el caller debe tomar gMutex)
+    // Los samples se piden a los pools compartidos. Si el JSON trae bpm se aplica al transport de la cancion
+    static bool song_load_unlocked(int songId, Song& s, const char* pathJson) {
+        std::string txt;
+        if (!readTextFile(pathJson, txt)) return false;
+        std::string baseDir = path_dirname(pathJson);
+
+
+        // Los arrays de automatizacion, compases y pistas se apartan del resto: sus claves (beatsPerBar, events...)
+        // no se deben confundir con las de primer nivel
+        std::string top = txt;
+        std::string sigText, tracksText, autoText;
+        size_t arrBeg = 0, arrEnd = 0;
+        if (json_find_array(top, "automation", arrBeg, arrEnd)) {
+            autoText = top.substr(arrBeg, arrEnd - arrBeg);
+            top.erase(arrBeg, arrEnd - arrBeg);
+        }
+        if (json_find_array(top, "tracks", arrBeg, arrEnd)) {
+            tracksText = top.substr(arrBeg, arrEnd - arrBeg);
+            top.erase(arrBeg, arrEnd - arrBeg);
+        }
+        if (json_find_array(top, "timeSignatures", arrBeg, arrEnd)) {
+            sigText = top.substr(arrBeg, arrEnd - arrBeg);
+            top.erase(arrBeg, arrEnd - arrBeg);
+        }
+
+        // Parametros por defecto
+        double beatsPerBar = 4.0;
+        int bars = 1;
+        bool loop = true;
+        json_extract_number(top, "beatsPerBar", beatsPerBar);
+        json_extract_int(top, "bars", bars);
+        json_extract_bool(top, "loop", loop);
+        if (beatsPerBar <= 0.0) beatsPerBar = 4.0;
+        if (bars <= 0) bars = 1;
+
+        Transport* songTransport = transport_find_unlocked(s.transport);
+        if (!songTransport) return false;
+        double parsedBpm;
+        if (json_extract_bpm(top, parsedBpm) && parsedBpm > 0.0) {
+            const bool playing = songTransport->playing.load();
+            transport_set_tempo_unlocked(*songTransport, parsedBpm);
+            if (!playing) songTransport->baseBeat = 0.0;
+        }
+
+        // Compases: cada cambio de compas ({ "bar": n, "beatsPerBar": b }) vale hasta el siguiente
+        std::vector<std::string> objs;
+        std::vector<std::pair<int, double>> sigs;
+        if (!sigText.empty()) json_split_objects(sigText, 0, sigText.size(), objs);
+        for (const std::string& o : objs) {
+            int bar = 0;
+            double bpb = 0.0;
+            json_extract_int(o, "bar", bar);
+            if (json_extract_number(o, "beatsPerBar", bpb) && bpb > 0.0 && bar >= 0) sigs.push_back({ bar, bpb });
+        }
+        std::stable_sort(sigs.begin(), sigs.end(), [](const std::pair<int, double>& x, const std::pair<int, double>& y) { return x.first < y.first; });
+        std::vector<double> barStarts;
+        barStarts.reserve((size_t)bars);
+        double lengthBeats = 0.0;
+        double barLen = beatsPerBar;
+        size_t sig = 0;
+        for (int b = 0; b < bars; ++b) {
+            while (sig < sigs.size() && sigs[sig].first <= b) barLen = sigs[sig++].second;
+            barStarts.push_back(lengthBeats);
+            lengthBeats += barLen;
+        }
+
+        // Instrumento para los eventos de nota (tuningHz se acepta pero no se usa: se afina por baseNote)
+        // Una pista puede traer el suyo. Con "zones" es multisample:
+        // "instrument": { "zones": [ { "file", "baseNote", "lo", "hi", "velLo", "velHi" }, ... ] }
+        // Devuelve false si el instrumento esta pero no se puede cargar
+        auto parseInstrument = [&](const std::string& t, Instrument& ins) -> bool {
+            size_t zBeg = 0, zEnd = 0;
+            if (json_find_array(t, "zones", zBeg, zEnd)) {
+                std::vector<std::string> zoneObjs;
+                json_split_objects(t, zBeg, zEnd, zoneObjs);
+                const std::regex reFile(R"(\"file\"\s*:\s*\"([^\"]+)\")");
+                Instrument parsed;
+                for (const std::string& zo : zoneObjs) {
+                    InstrumentZone z;
+                    std::smatch mFile;
+                    if (!std::regex_search(zo, mFile, reFile)) continue;
+                    z.file = mFile[1].str();
+                    double v = 0.0;
+                    json_extract_int(zo, "baseNote", z.baseNote);
+                    json_extract_int(zo, "lo", z.lo);
+                    json_extract_int(zo, "hi", z.hi);
+                    if (json_extract_number(zo, "velLo", v)) z.velLo = (float)v;
+                    if (json_extract_number(zo, "velHi", v)) z.velHi = (float)v;
+                    if (z.hi < z.lo || z.velHi < z.velLo) continue;
+                    parsed.zones.push_back(z);
+                }
+                if (!instrument_build_unlocked(parsed, baseDir)) return false;
+                ins = std::move(parsed);
+                return true;
+            }
+            std::regex reInstr(R"("instrument"\s*:\s*\{\s*\"file\"\s*:\s*\"([^\"]+)\"(?:\s*,\s*\"baseNote\"\s*:\s*([-]?\d+))?)", std::regex::icase);
+            std::smatch mInstr;
+            if (std::regex_search(t, mInstr, reInstr)) {
+                Instrument parsed;
+                parsed.zones.push_back(InstrumentZone());
+                parsed.zones[0].file = mInstr[1].str();
+                if (mInstr.size() >= 3 && mInstr[2].matched) parsed.zones[0].baseNote = std::stoi(mInstr[2].str());
+                if (!instrument_build_unlocked(parsed, baseDir)) return false;
+                ins = std::move(parsed);
+            }
+            return true;
+        };
+        Instrument globalInstr;
+        if (!parseInstrument(top, globalInstr)) return false;
+
+        // Pistas: los eventos de primer nivel son una pista de ciclo 'cycle' (por defecto la cancion entera)
+        // Un 'cycle' distinto de la duracion tiene que caer en la rejilla de 1/960 de beat y el mcm con la
+        // duracion no puede pasar de 64 canciones ni de 65536 eventos desplegados: si no, la carga falla
+        struct LoadTrack {
+            double cycle;
+            std::vector<SongEvent> events;
+        };
+        std::vector<LoadTrack> tracks;
+        auto loadTrack = [&](const std::string& t, const Instrument& instr) -> bool {
+            std::vector<SongEvent> evs;
+            json_extract_events(t, evs);
+            LoadTrack tr;
+            tr.cycle = lengthBeats;
+            json_extract_number(t, "cycle", tr.cycle);
+            if (tr.cycle <= 0.0) tr.cycle = lengthBeats;
+            for (auto& ev : evs) {
+                SongEvent sev;
+                sev.dur = ev.dur;
+                sev.vel = ev.vel;
+                // un offset fuera del ciclo se lleva a su posicion dentro del ciclo
+                sev.offsetBeat = std::fmod(ev.offsetBeat, tr.cycle);
+                if (sev.offsetBeat < 0.0) sev.offsetBeat += tr.cycle;
+                if (ev.path.rfind("NOTE:", 0) == 0) {
+                    if (instr.pools.empty()) return false;
+                    const int midi = note_name_to_midi(ev.path.substr(5));
+                    if (midi < 0 || midi > 127) continue;
+                    const KeyCell cell = instrument_lookup(instr, midi, ev.vel);
+                    sev.pool = cell.pool;
+                    sev.path = cell.pool->path;
+                    sev.pitch = cell.pitch;
+                }
+                else {
+                    sev.path = path_join(baseDir, ev.path);
+                    sev.pool = voice_pool_get_unlocked(sev.path);
+                }
+                if (!sev.pool) return false;
+                tr.events.push_back(sev);
+            }
+            if (!tr.events.empty()) tracks.push_back(std::move(tr));
+            return true;
+        };
+        if (!loadTrack(top, globalInstr)) return false;
+        if (!tracksText.empty()) json_split_objects(tracksText, 0, tracksText.size(), objs);
+        else objs.clear();
+        for (const std::string& o : objs) {
+            Instrument trackInstr;
+            if (!parseInstrument(o, trackInstr)) return false;
+            if (!loadTrack(o, trackInstr.pools.empty() ? globalInstr : trackInstr)) return false;
+        }
+        if (tracks.empty()) return false;
+
+        // Periodo de la timeline: el mcm de la duracion y los ciclos (en 1/960 de beat) para que cada
+        // pista siga su ciclo entre vueltas de la cancion (sin loop se para en lengthBeats igualmente).
+        // Si no cae en la rejilla o sale demasiado largo no se carga: reiniciar las pistas con cada
+        // vuelta cambiaria la musica sin avisar
+        double cycleBeats = lengthBeats;
+        bool polymetric = false;
+        for (const LoadTrack& tr : tracks) polymetric = polymetric || std::fabs(tr.cycle - lengthBeats) > 1e-9;
+        if (polymetric) {
+            const double q = 960.0;
+            const long long len = std::llround(lengthBeats * q);
+            const long long cap = 64 * len;
+            long long period = len;
+            bool exact = len > 0 && std::fabs((double)len - lengthBeats * q) < 1e-6;
+            for (const LoadTrack& tr : tracks) {
+                const long long c = std::llround(tr.cycle * q);
+                if (!exact || c <= 0 || std::fabs((double)c - tr.cycle * q) > 1e-6) {
+                    exact = false;
+                    break;
+                }
+                const long long g = std::gcd(period, c);
+                if (period / g > cap / c) {
+                    exact = false;
+                    break;
+                }
+                period = period / g * c;
+            }
+            size_t total = 0;
+            for (const LoadTrack& tr : tracks) total += tr.events.size() * (size_t)std::ceil((double)period / q / tr.cycle);
+            if (!exact || total > 65536) return false;
+            cycleBeats = (double)period / q;
+        }
+
+        // Despliegue de las pistas en la timeline
+        std::vector<SongEvent> loadedEvents;
+        for (const LoadTrack& tr : tracks) {
+            for (const SongEvent& ev : tr.events) {
+                for (double b = ev.offsetBeat; b < cycleBeats - 1e-9; b += tr.cycle) {
+                    loadedEvents.push_back(ev);
+                    loadedEvents.back().offsetBeat = b;
+                }
+            }
+        }
+        std::stable_sort(loadedEvents.begin(), loadedEvents.end(),
+            [](const SongEvent& x, const SongEvent& y) { return x.offsetBeat < y.offsetBeat; });
+        double tailSec = 0.0;
+        for (const SongEvent& ev : loadedEvents) {
+            float lenSec = 0.0f;
+            ma_sound_get_length_in_seconds(ev.pool->voices[0].sound, &lenSec);
+            tailSec = std::max(tailSec, (double)lenSec / (double)ev.pitch);
+        }
+
+        // Sustituye la cancion previa conservando su transport
+        song_clear_voices_unlocked(songId);
+        const int keepTransport = s.transport;
+        s = Song{};
+        s.transport = keepTransport;
+        s.baseDir = baseDir;
+        s.loaded = true;
+        s.loop = loop;
+        s.lengthBeats = lengthBeats;
+        s.cycleBeats = cycleBeats;
+        s.barStarts = std::move(barStarts);
+        s.events = std::move(loadedEvents);
+        s.tailSec = tailSec;
+
+        // Automatizacion: { "target": "master" | "music", "points": [ { "beat", "value", "curve", "c1", "c2" } ] }
+        // en beats de la cancion. Sustituye a la de la carga anterior
+        for (auto it = gAutoLanes.begin(); it != gAutoLanes.end();) {
+            if (it->second->song == songId) it = gAutoLanes.erase(it);
+            else ++it;
+        }
+        if (!autoText.empty()) json_split_objects(autoText, 0, autoText.size(), objs);
+        else objs.clear();
+        const std::regex reTarget(R"("target"\s*:\s*"(\w+))");
+        const std::regex reCurve(R"("curve"\s*:\s*"(\w+))");
+        for (const std::string& o : objs) {
+            std::smatch m;
+            if (!std::regex_search(o, m, reTarget)) continue;
+            std::unique_ptr<AutoLane> lane(new AutoLane());
+            lane->song = songId;
+            if (m[1].str() == "master") lane->param = AUTO_VOLUME;
+            else if (m[1].str() == "music" && music_node_ready_unlocked()) lane->param = AUTO_MUSIC;
+            else continue;
+            std::vector<std::string> pts;
+            if (json_find_array(o, "points", arrBeg, arrEnd)) json_split_objects(o, arrBeg, arrEnd, pts);
+            for (const std::string& po : pts) {
+                AutoPoint p{ 0.0, 0.0f, AUTO_LINEAR, 1.0f / 3.0f, 2.0f / 3.0f };
+                double v = 0.0, c = 0.0;
+                if (!json_extract_number(po, "beat", p.beat) || !json_extract_number(po, "value", v)) continue;
+                p.value = (float)v;
+                std::smatch mc;
+                if (std::regex_search(po, mc, reCurve)) {
+                    if (mc[1].str() == "exp") p.curve = AUTO_EXP;
+                    else if (mc[1].str() == "bezier") p.curve = AUTO_BEZIER;
+                }
+                if (json_extract_number(po, "c1", c)) p.c1 = (float)c;
+                if (json_extract_number(po, "c2", c)) p.c2 = (float)c;
+                automation_add_point(*lane, p);
+            }
+            if (!lane->points.empty()) gAutoLanes[makeId()] = std::move(lane);
+        }
+        automation_publish_unlocked();
+        return true;
+    }
+
+    static double song_play_unlocked(Song& s) {
+        if (!gEngineIniciado || !s.loaded) return 0.0;
+        Transport* t = transport_find_unlocked(s.transport);
+        if (!t) return 0.0;
+        transport_play_unlocked(*t);
+        const double nowBeat = transport_get_beat_unlocked(*t);
+        song_rewind(s, std::ceil(nowBeat));
+        s.playing = !s.events.empty();
+        automation_songs_changed_unlocked();
+        return 1.0;
+    }
+
+    static double song_stop_unlocked(int songId, Song& s) {
+        if (!s.loaded) return 1.0;
+        s.playing = false;
+        s.ended = false;
+        s.rearm = false;
+        song_clear_hold(s);
+        song_clear_voices_unlocked(songId);
+        automation_songs_changed_unlocked();
+        return 1.0;
+    }
+
+    // Asocia la cancion a un transport. Si estaba sonando se para
+    static double song_set_transport_unlocked(int songId, Song& s, double th) {
+        if (!transport_find_unlocked(th)) return 0.0;
+        if ((int)th == s.transport) return 1.0;
+        song_stop_unlocked(songId, s);
+        s.transport = (int)th;
+        return 1.0;
+    }
+
+    // Aplica el volumen de la cancion a las voces que estan sonando por ella
+    static void song_apply_volume_unlocked(int songId, const Song& s) {
+        for (auto& kv : gVoicePools) {
+            for (auto& v : kv.second->voices) {
+                if (v.song == songId) ma_sound_set_volume(v.sound, v.vel * s.volume);
+            }
+        }
+    }
+
+
+    // Carga una cancion desde JSON (ruta en disco). Pre-carga los wav en los pools de voces.
+    __declspec(dllexport) double gm_audio_song_load_file(const char* pathJson) {
+        rec_call(REC_SONG_LOAD, { pathJson });
+        if (!gEngineIniciado || pathJson == nullptr) return 0.0;
+        MutexGuard lock;
+        return song_load_unlocked(0, gSong, pathJson) ? 1.0 : 0.0;
+    }
+
+    __declspec(dllexport) double gm_audio_song_play() {
+        rec_call(REC_SONG_PLAY);
+        MutexGuard lock;
+        return song_play_unlocked(gSong);
+    }
+
+
+
+
+    // Para o limpia el estado de la cancion
+    __declspec(dllexport) double gm_audio_song_stop() {
+        rec_call(REC_SONG_STOP);
+        MutexGuard lock;
+        return song_stop_unlocked(0, gSong);
+    }
+
+
+
+
+    // Cambia el loop de la cancion
+    __declspec(dllexport) double gm_audio_song_set_loop(double flag) {
+        rec_call(REC_SONG_SET_LOOP, { flag });
+        MutexGuard lock;
+        if (!gSong.loaded) return 0.0;
+        gSong.loop = (flag != 0.0);
+        automation_songs_changed_unlocked();
+        return 1.0;
+    }
+
+
+    // Asocia la cancion a un transport (0 = por defecto). Si estaba sonando se para
+    __declspec(dllexport) double gm_audio_song_set_transport(double h) {
+        rec_call(REC_SONG_SET_TRANSPORT, { h });
+        MutexGuard lock;
+        return song_set_transport_unlocked(0, gSong, h);
+    }
+
+
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // CANCIONES POR HANDLE (capas)
+    // - varias canciones a la vez sobre el mismo transport (o distintos), cada una con su
+    //   loop, mute y volumen
+    // - la cancion 0 es la de la API sin handle
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Carga una cancion desde JSON asociada al transport th. Devuelve su handle o 0 si falla
+    __declspec(dllexport) double gm_audio_song_create(const char* pathJson, double th) {
+        const ma_uint32 rseq = rec_call(REC_SONG_CREATE, { pathJson, th });
+        if (!gEngineIniciado || pathJson == nullptr) return 0.0;
+        MutexGuard lock;
+        if (!transport_find_unlocked(th)) return 0.0;
+        int id = makeId();
+        std::unique_ptr<Song> s(new Song());
+        s->transport = (int)th;
+        if (!song_load_unlocked(id, *s, pathJson)) return 0.0;
+        gSongs[id] = std::move(s);
+        rec_result(rseq, id);
+        return (double)id;
+    }
+
+
+    // Para y destruye una cancion creada por handle
+    __declspec(dllexport) double gm_audio_song_destroy(double h) {
+        rec_call(REC_SONG_DESTROY, { h });
+        const int id = (int)h;
+        MutexGuard lock;
+        auto it = gSongs.find(id);
+        if (it == gSongs.end()) return 0.0;
+        song_stop_unlocked(id, *it->second);
+        for (auto& kv : gVoicePools) {
+            for (auto& v : kv.second->voices) {
+                if (v.song == id) v.song = -1;
+            }
+        }
+        gSongs.erase(it);
+        for (auto itL = gAutoLanes.begin(); itL != gAutoLanes.end();) {
+            if (itL->second->song == id) itL = gAutoLanes.erase(itL);
+            else ++itL;
+        }
+        automation_publish_unlocked();
+        return 1.0;
+    }
+
+
+    // Crea un patron vacio de 'steps' pasos de 'stepBeats' beats (0.25 = semicorcheas) en el transport th
+    // Es una cancion en loop: se reproduce y controla con las funciones gm_audio_song_*_h
+    // Devuelve su handle o 0 si falla
+    __declspec(dllexport) double gm_audio_pattern_create(double steps, double stepBeats, double th) {
+        const ma_uint32 rseq = rec_call(REC_PATTERN_CREATE, { steps, stepBeats, th });
+        if (!gEngineIniciado || steps < 1.0 || steps > 4096.0 || stepBeats <= 0.0) return 0.0;
+        MutexGuard lock;
+        if (!transport_find_unlocked(th)) return 0.0;
+        const size_t n = (size_t)steps;
+        std::unique_ptr<Song> s(new Song());
+        s->transport = (int)th;
+        s->loaded = true;
+        s->loop = true;
+        s->pattern = true;
+        s->lengthBeats = (double)n * stepBeats;
+        s->cycleBeats = s->lengthBeats;
+        s->events.resize(n);
+        for (size_t i = 0; i < n; ++i) s->events[i].offsetBeat = (double)i * stepBeats;
+        s->pendingEvents = s->events;
+        s->dirtySteps.reserve(n);
+        int id = makeId();
+        gSongs[id] = std::move(s);
+        rec_result(rseq, id);
+        return (double)id;
+    }
+
+
+    // Escribe un paso del patron: sample y nota MIDI (60 = el sample sin transponer), a velocidad 1
+    // Con el patron sonando se aplica al empezar su siguiente vuelta
+    __declspec(dllexport) double gm_audio_pattern_set_step(double h, double step, const char* path, double note) {
+        rec_call(REC_PATTERN_SET_STEP, { h, step, path, note });
+        if (!gEngineIniciado || path == nullptr) return 0.0;
+        MutexGuard lock;
+        Song* s = song_find_unlocked(h);
+        if (!s || !s->pattern || step < 0.0 || step >= (double)s->events.size()) return 0.0;
+        VoicePool* pool = voice_pool_get_unlocked(path);
+        if (!pool) return 0.0;
+        const ma_uint32 i = (ma_uint32)step;
+        SongEvent& ev = s->pendingEvents[i];
+        ev.pool = pool;
+        ev.path = path;
+        ev.vel = 1.0f;
+        ev.pitch = (float)pitch_from_semitones(note - 60.0, 0.0);
+        float lenSec = 0.0f;
+        ma_sound_get_length_in_seconds(pool->voices[0].sound, &lenSec);
+        s->tailSec = std::max(s->tailSec, (double)lenSec / (double)ev.pitch);
+        s->dirtySteps.push_back(i);
+        if (!s->playing) song_pattern_commit(*s);
+        return 1.0;
+    }
+
+
+    // Cambia la velocidad (0..1) de un paso ya escrito; va aparte de set_step porque GameMaker
+    // no admite mas de 4 argumentos en una llamada externa si alguno es una cadena
+    __declspec(dllexport) double gm_audio_pattern_set_velocity(double h, double step, double vel) {
+        rec_call(REC_PATTERN_SET_VELOCITY, { h, step, vel });
+        MutexGuard lock;
+        Song* s = song_find_unlocked(h);
+        if (!s || !s->pattern || step < 0.0 || step >= (double)s->events.size()) return 0.0;
+        const ma_uint32 i = (ma_uint32)step;
+        if (!s->pendingEvents[i].pool) return 0.0;
+        s->pendingEvents[i].vel = (float)std::max(0.0, vel);
+        s->dirtySteps.push_back(i);
+        if (!s->playing) song_pattern_commit(*s);
+        return 1.0;
+    }
+
+
+    // Vacia un paso del patron (igual que set_step, con el patron sonando vale desde la siguiente vuelta)
+    __declspec(dllexport) double gm_audio_pattern_clear_step(double h, double step) {
+        rec_call(REC_PATTERN_CLEAR_STEP, { h, step });
+        MutexGuard lock;
+        Song* s = song_find_unlocked(h);
+        if (!s || !s->pattern || step < 0.0 || step >= (double)s->events.size()) return 0.0;
+        const ma_uint32 i = (ma_uint32)step;
+        s->pendingEvents[i].pool = nullptr;
+        s->pendingEvents[i].path.clear();
+        s->dirtySteps.push_back(i);
+        if (!s->playing) song_pattern_commit(*s);
+        return 1.0;
+    }
+
+
+    // Arranca la cancion en el siguiente beat entero de su transport (y pone el transport en marcha)
+    __declspec(dllexport) double gm_audio_song_play_h(double h) {
+        rec_call(REC_SONG_PLAY_H, { h });
+        MutexGuard lock;
+        Song* s = song_find_unlocked(h);
+        return s ? song_play_unlocked(*s) : 0.0;
+    }
+
+
+    __declspec(dllexport) double gm_audio_song_stop_h(double h) {
+        rec_call(REC_SONG_STOP_H, { h });
+        MutexGuard lock;
+        Song* s = song_find_unlocked(h);
+        return s ? song_stop_unlocked((int)h, *s) : 0.0;
+    }
+
+
+    __declspec(dllexport) double gm_audio_song_set_loop_h(double h, double flag) {
+        rec_call(REC_SONG_SET_LOOP_H, { h, flag });
+        MutexGuard lock;
+        Song* s = song_find_unlocked(h);
+        if (!s || !s->loaded) return 0.0;
+        s->loop = (flag != 0.0);
+        automation_songs_changed_unlocked();
+        return 1.0;
+    }
+
+
+    // Mute: la cancion sigue avanzando pero no dispara notas. Corta las que estan sonando
+    __declspec(dllexport) double gm_audio_song_set_mute_h(double h, double flag) {
+        rec_call(REC_SONG_SET_MUTE_H, { h, flag });
+        MutexGuard lock;
+        Song* s = song_find_unlocked(h);
+        if (!s) return 0.0;
+        s->muted = (flag != 0.0);
+        if (s->muted) song_clear_voices_unlocked((int)h);
+        return 1.0;
+    }
+
+
+    // Volumen de la cancion de 0 a 1 (multiplica la velocidad de cada evento)
+    __declspec(dllexport) double gm_audio_song_set_volume_h(double h, double v) {
+        rec_call(REC_SONG_SET_VOLUME_H, { h, v });
+        float vol = (float)v;
+        if (vol < 0.f) vol = 0.f;
+        if (vol > 1.f) vol = 1.f;
+        MutexGuard lock;
+        Song* s = song_find_unlocked(h);
+        if (!s) return 0.0;
+        s->volume = vol;
+        song_apply_volume_unlocked((int)h, *s);
+        return 1.0;
+    }
+
+
+    __declspec(dllexport) double gm_audio_song_set_transport_h(double h, double th) {
+        rec_call(REC_SONG_SET_TRANSPORT_H, { h, th });
+        MutexGuard lock;
+        Song* s = song_find_unlocked(h);
+        return s ? song_set_transport_unlocked((int)h, *s, th) : 0.0;
+    }
+
+
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // TRANSICIONES Y STINGERS CUANTIZADOS AL COMPAS
+    // - el destino es el siguiente beat beatInBar (0 = downbeat) del compas (beatsPerBar)
+    // - el material nuevo ya esta cargado en los pools; el tick lo programa con start time
+    //   en el frame exacto cuando el destino entra en la ventana de lookahead
+    // - devuelven el beat del transport en que ocurre el cambio, o -1 si falla
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Ventana de lookahead del tick en segundos (por defecto 0.05). Tiene que cubrir el tiempo
+    // entre dos ticks: lo que cae dentro se programa en su frame exacto
+    __declspec(dllexport) double gm_audio_set_lookahead(double seconds) {
+        rec_call(REC_SET_LOOKAHEAD, { seconds });
+        if (seconds < 0.0 || seconds > 1.0) return 0.0;
+        MutexGuard lock;
+        gLookaheadSec = seconds;
+        return 1.0;
+    }
+
+
+    // Arranca la cancion en el siguiente beatInBar del compas del transport (en vez del siguiente beat)
+    __declspec(dllexport) double gm_audio_song_play_quantized_h(double h, double beatInBar) {
+        rec_call(REC_SONG_PLAY_QUANTIZED_H, { h, beatInBar });
+        MutexGuard lock;
+        Song* s = song_find_unlocked(h);
+        if (!gEngineIniciado || !s || !s->loaded || s->events.empty()) return -1.0;
+        Transport* t = transport_find_unlocked(s->transport);
+        if (!t) return -1.0;
+        transport_play_unlocked(*t);
+        song_clear_voices_unlocked((int)h);
+        s->playing = false;
+        const double target = song_next_bar_beat(*s, transport_get_beat_unlocked(*t), beatInBar);
+        song_rewind(*s, target);
+        s->playing = true;
+        automation_songs_changed_unlocked();
+        return target;
+    }
+
+
+    // Cambia de la cancion 'from' a 'to' en el siguiente beatInBar del compas de 'from'
+    // 'from' se corta en ese frame y 'to' empieza desde su principio. Ambas en el mismo transport
+    __declspec(dllexport) double gm_audio_song_transition_h(double from, double to, double beatInBar) {
+        rec_call(REC_SONG_TRANSITION_H, { from, to, beatInBar });
+        MutexGuard lock;
+        Song* a = song_find_unlocked(from);
+        Song* b = song_find_unlocked(to);
+        if (!gEngineIniciado || !a || !b || a == b || !b->loaded || b->events.empty()) return -1.0;
+        if (a->transport != b->transport) return -1.0;
+        Transport* t = transport_find_unlocked(a->transport);
+        if (!t) return -1.0;
+        transport_play_unlocked(*t);
+        const double target = song_next_bar_beat(a->playing ? *a : *b, transport_get_beat_unlocked(*t), beatInBar);
+        if (a->playing) {
+            a->holdFrom = target;
+            a->holdUntil = INFINITY;
+            a->holdCutPending = true;
+            a->stinger = nullptr;
+        }
+        song_clear_voices_unlocked((int)to);
+        song_rewind(*b, target);
+        b->playing = true;
+        automation_songs_changed_unlocked();
+        return target;
+    }
+
+
+    // Stinger: suena 'path' en el siguiente downbeat de la cancion, que se calla mientras tanto y
+    // vuelve en el primer compas despues de que acabe el stinger (en su posicion de la timeline)
+    // 'path' absoluta o, como en sus eventos, relativa a la carpeta del JSON de la cancion
+    __declspec(dllexport) double gm_audio_song_stinger_h(double h, const char* path) {
+        rec_call(REC_SONG_STINGER_H, { h, path });
+        if (!gEngineIniciado || path == nullptr) return -1.0;
+        MutexGuard lock;
+        Song* s = song_find_unlocked(h);
+        if (!s || !s->playing) return -1.0;
+        Transport* t = transport_find_unlocked(s->transport);
+        if (!t) return -1.0;
+        VoicePool* pool = voice_pool_get_unlocked(path_join(s->baseDir, path));
+        if (!pool) return -1.0;
+        float lenSec = 0.0f;
+        ma_sound_get_length_in_seconds(pool->voices[0].sound, &lenSec);
+        const double target = song_next_bar_beat(*s, transport_get_beat_unlocked(*t), 0.0);
+        const double endBeat = transport_advance(*t, target, (double)lenSec);
+        s->holdFrom = target;
+        s->holdUntil = song_next_bar_beat(*s, endBeat, 0.0);
+        s->holdCutPending = true;
+        s->stinger = pool;
+        return target;
+    }
+
+
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // GRUPOS DE STEMS
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Crea un grupo de stems vacio. Devuelve su handle o 0 si falla
+    __declspec(dllexport) double gm_audio_stems_create() {
+        const ma_uint32 rseq = rec_call(REC_STEMS_CREATE);
+        if (!gEngineIniciado) return 0.0;
+        MutexGuard lock;
+        std::unique_ptr<StemGroup> g(new StemGroup());
+        g->node.group = g.get();
+        const ma_uint32 channels = ma_engine_get_channels(&gEngine);
+        ma_uint32 inChannels[kMaxStems];
+        for (ma_uint32 i = 0; i < kMaxStems; ++i) inChannels[i] = channels;
+        ma_node_config nc = ma_node_config_init();
+        nc.vtable = &gStemMixVtable;
+        nc.pInputChannels = inChannels;
+        nc.pOutputChannels = &channels;
+        if (ma_node_init(ma_engine_get_node_graph(&gEngine), &nc, NULL, &g->node) != MA_SUCCESS) return 0.0;
+        g->nodeReady = true;
+        ma_node_attach_output_bus(&g->node, 0, ma_engine_get_endpoint(&gEngine), 0);
+        g->smooth.store(stem_smooth_coeff(0.05));
+        int id = makeId();
+        gStemGroups[id] = std::move(g);
+        rec_result(rseq, id);
+        return (double)id;
+    }
+
+
+    // Anade un stem (streaming, en loop) que sube entre las intensidades in0 e in1
+    // Devuelve el indice del stem (0..7) o -1 si falla. Con el grupo sonando no se pueden anadir stems
+    __declspec(dllexport) double gm_audio_stems_add(double h, const char* path, double in0, double in1) {
+        rec_call(REC_STEMS_ADD, { h, path, in0, in1 });
+        if (!gEngineIniciado || path == nullptr) return -1.0;
+        MutexGuard lock;
+        auto it = gStemGroups.find((int)h);
+        if (it == gStemGroups.end()) return -1.0;
+        StemGroup& g = *it->second;
+        const ma_uint32 idx = g.count.load();
+        if (idx >= kMaxStems) return -1.0;
+        for (ma_uint32 s = 0; s < idx; ++s) {
+            if (ma_sound_is_playing(g.stems[s])) return -1.0;
+        }
+        ma_sound* s = new ma_sound();
+        const ma_uint32 flags = MA_SOUND_FLAG_STREAM | MA_SOUND_FLAG_NO_SPATIALIZATION;
+        if (sound_init_from_file_looped(s, path, flags) != MA_SUCCESS) {
+            delete s;
+            return -1.0;
+        }
+        ma_sound_set_looping(s, MA_TRUE);
+        ma_node_attach_output_bus(s, 0, &g.node, idx);
+        StemCurve& c = g.curves[idx];
+        c.in0.store((float)in0);
+        c.in1.store((float)((in1 > in0) ? in1 : in0));
+        c.out0.store(2.0f);
+        c.out1.store(2.0f);
+        g.stems[idx] = s;
+        g.count.store(idx + 1, std::memory_order_release);
+        return (double)idx;
+    }
+
+
+    // Curva completa de un stem: sube entre in0 e in1, plena hasta out0 y baja hasta out1
+    __declspec(dllexport) double gm_audio_stems_set_curve(double h, double stem, double in0, double in1, double out0, double out1) {
+        rec_call(REC_STEMS_SET_CURVE, { h, stem, in0, in1, out0, out1 });
+        MutexGuard lock;
+        auto it = gStemGroups.find((int)h);
+        if (it == gStemGroups.end()) return 0.0;
+        StemGroup& g = *it->second;
+        const int idx = (int)stem;
+        if (idx < 0 || idx >= (int)g.count.load()) return 0.0;
+        if (in1 < in0 || out0 < in1 || out1 < out0) return 0.0;
+        StemCurve& c = g.curves[idx];
+        c.in0.store((float)in0);
+        c.in1.store((float)in1);
+        c.out0.store((float)out0);
+        c.out1.store((float)out1);
         return 1.0;
     }
 
 
-    // Resume si hay una posicion almacenada, hace seek y arranca
-    // Devuelve 1 si arranca, 0 si algo falla o no existe el ID
-    __declspec(dllexport) double gm_audio_resume(double idd) {
-        int id = (int)idd;
-        std::lock_guard<std::mutex> lock(gMutex);
-        auto it = gSounds.find(id);
-        if (it == gSounds.end()) return 0.0;
+    // Arranca todos los stems desde el principio en el mismo frame del engine
+    // Con dispositivo se deja un margen de dos periodos para que ningun stem arranque en otro bloque
+    __declspec(dllexport) double gm_audio_stems_play(double h) {
+        rec_call(REC_STEMS_PLAY, { h });
+        if (!gEngineIniciado) return 0.0;
+        MutexGuard lock;
+        auto it = gStemGroups.find((int)h);
+        if (it == gStemGroups.end()) return 0.0;
+        StemGroup& g = *it->second;
+        if (g.count.load() == 0) return 0.0;
+        const ma_uint64 lead = stem_start_lead();
+        const ma_uint64 startFrame = ma_engine_get_time_in_pcm_frames(&gEngine) + lead;
+        // el seek del transport 0 usa este beat para saber por donde va la musica
+        const double beat = transport_get_beat_unlocked(gTransport);
+        g.startBeat = gTransport.playing.load() ? transport_advance(gTransport, beat, (double)lead / (double)ma_engine_get_sample_rate(&gEngine)) : beat;
+        stem_group_start_unlocked(g, startFrame, 0.0);
+        return 1.0;
+    }
+
+
+    __declspec(dllexport) double gm_audio_stems_stop(double h) {
+        rec_call(REC_STEMS_STOP, { h });
+        MutexGuard lock;
+        auto it = gStemGroups.find((int)h);
+        if (it == gStemGroups.end()) return 0.0;
+        StemGroup& g = *it->second;
+        for (ma_uint32 s = 0; s < g.count.load(); ++s) ma_sound_stop(g.stems[s]);
+        g.playing = false;
+        g.startPending = false;
+        return 1.0;
+    }
+
+
+    // Intensidad del grupo (normalmente 0..1). seconds es la constante de tiempo del suavizado
+    __declspec(dllexport) double gm_audio_stems_set_intensity(double h, double value, double seconds) {
+        rec_call(REC_STEMS_SET_INTENSITY, { h, value, seconds });
+        MutexGuard lock;
+        auto it = gStemGroups.find((int)h);
+        if (it == gStemGroups.end()) return 0.0;
+        it->second->smooth.store(stem_smooth_coeff(seconds));
+        it->second->intensity.store((float)value);
+        return 1.0;
+    }
+
+
+    __declspec(dllexport) double gm_audio_stems_destroy(double h) {
+        rec_call(REC_STEMS_DESTROY, { h });
+        MutexGuard lock;
+        auto it = gStemGroups.find((int)h);
+        if (it == gStemGroups.end()) return 0.0;
+        automation_target_gone_unlocked((int)h);
+        stem_group_release_unlocked(*it->second);
+        gStemGroups.erase(it);
+        return 1.0;
+    }
+
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // PLAYLISTS
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Crea una playlist vacia. Devuelve su handle o 0 si falla
+    __declspec(dllexport) double gm_audio_playlist_create() {
+        const ma_uint32 rseq = rec_call(REC_PLAYLIST_CREATE);
+        if (!gEngineIniciado) return 0.0;
+        MutexGuard lock;
+        int id = makeId();
+        gPlaylists[id] = std::unique_ptr<Playlist>(new Playlist());
+        rec_result(rseq, id);
+        return (double)id;
+    }
+
+
+    // Anade una pista al final. Se puede llamar con la playlist sonando
+    __declspec(dllexport) double gm_audio_playlist_add(double h, const char* path) {
+        rec_call(REC_PLAYLIST_ADD, { h, path });
+        if (path == nullptr) return 0.0;
+        MutexGuard lock;
+        auto it = gPlaylists.find((int)h);
+        if (it == gPlaylists.end()) return 0.0;
+        it->second->paths.push_back(path);
+        return 1.0;
+    }
+
+
+    // Empieza desde la primera pista. La primera se abre aqui mismo; las demas las prepara el tick
+    __declspec(dllexport) double gm_audio_playlist_play(double h) {
+        rec_call(REC_PLAYLIST_PLAY, { h });
+        if (!gEngineIniciado) return 0.0;
+        MutexGuard lock;
+        auto it = gPlaylists.find((int)h);
+        if (it == gPlaylists.end()) return 0.0;
+        Playlist& p = *it->second;
+        if (p.paths.empty()) return 0.0;
+        playlist_close_track_unlocked(p.cur);
+        playlist_close_track_unlocked(p.next);
+        p.lastIndex = -1;
+        playlist_open_following_unlocked(p, p.cur, false);
+        p.playing = true;
+        playlist_update_unlocked(p);
+        return 1.0;
+    }
+
+
+    __declspec(dllexport) double gm_audio_playlist_stop(double h) {
+        rec_call(REC_PLAYLIST_STOP, { h });
+        MutexGuard lock;
+        auto it = gPlaylists.find((int)h);
+        if (it == gPlaylists.end()) return 0.0;
+        Playlist& p = *it->second;
+        playlist_close_track_unlocked(p.cur);
+        playlist_close_track_unlocked(p.next);
+        p.playing = false;
+        return 1.0;
+    }
+
+
+    // Segundos de crossfade entre pistas (0 = una detras de otra, sin huecos)
+    // Afecta a los cambios que aun no se han programado
+    __declspec(dllexport) double gm_audio_playlist_set_crossfade(double h, double seconds) {
+        rec_call(REC_PLAYLIST_SET_CROSSFADE, { h, seconds });
+        MutexGuard lock;
+        auto it = gPlaylists.find((int)h);
+        if (it == gPlaylists.end()) return 0.0;
+        it->second->crossfadeSec = (seconds > 0.0) ? seconds : 0.0;
+        return 1.0;
+    }
+
+
+    // Con loop, despues de la ultima pista vuelve a la primera
+    __declspec(dllexport) double gm_audio_playlist_set_loop(double h, double loop) {
+        rec_call(REC_PLAYLIST_SET_LOOP, { h, loop });
+        MutexGuard lock;
+        auto it = gPlaylists.find((int)h);
+        if (it == gPlaylists.end()) return 0.0;
+        it->second->loop = (loop != 0.0);
+        return 1.0;
+    }
+
+
+    __declspec(dllexport) double gm_audio_playlist_destroy(double h) {
+        rec_call(REC_PLAYLIST_DESTROY, { h });
+        MutexGuard lock;
+        auto it = gPlaylists.find((int)h);
+        if (it == gPlaylists.end()) return 0.0;
+        playlist_close_track_unlocked(it->second->cur);
+        playlist_close_track_unlocked(it->second->next);
+        gPlaylists.erase(it);
+        return 1.0;
+    }
+
+
+    // Indice de la pista que esta sonando (o programada para sonar), -1 si ninguna
+    __declspec(dllexport) double gm_audio_playlist_get_track(double h) {
+        rec_call(REC_PLAYLIST_GET_TRACK, { h });
+        MutexGuard lock;
+        auto it = gPlaylists.find((int)h);
+        if (it == gPlaylists.end() || !it->second->playing || !it->second->cur.sound) return -1.0;
+        const Playlist& p = *it->second;
+        // entre tick y tick la siguiente puede haber empezado ya
+        if (p.next.scheduled && gEngineIniciado && ma_engine_get_time_in_pcm_frames(&gEngine) >= p.cur.endFrame) return (double)p.next.index;
+        return (double)p.cur.index;
+    }
+
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // MUSICA CON TRANSPORT
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Pasa a la pista 'path' en el siguiente limite de 'quantize' beats del transport 0 (4 = cada compas
+    // de 4/4, 0 = cuanto antes) con un crossfade de potencia constante de 'fadeBeats' beats
+    // La pista entra en fase con el transport y en loop. Devuelve el beat del cambio o -1 si falla
+    __declspec(dllexport) double gm_audio_music_transition(const char* path, double quantize, double fadeBeats) {
+        rec_call(REC_MUSIC_TRANSITION, { path, quantize, fadeBeats });
+        if (!gEngineIniciado || path == nullptr) return -1.0;
+        MutexGuard lock;
+        if (!music_node_ready_unlocked()) return -1.0;
+        // despues de un stop la ranura libre es la activa y la otra (la que se funde) se corta
+        const int slot = (gMusic.active < 0) ? 0 : (gMusic.silent ? gMusic.active : 1 - gMusic.active);
+        if (gMusic.silent) music_slot_release_unlocked(1 - slot, false);
+        if (!music_slot_open_unlocked(slot, path)) return -1.0;
+
+        transport_play_unlocked(gTransport);
         ma_uint64 frame = 0;
-        auto itp = gPausedFrame.find(id);
-        if (itp != gPausedFrame.end()) frame = itp->second;
-        if (frame > 0) {
-            ma_sound_seek_to_pcm_frame(it->second, frame);
-        }
-        if (ma_sound_start(it->second) != MA_SUCCESS)
-            return 0.0;
-        gPausedFrame.erase(id);
+        const double target = music_next_boundary(gTransport, quantize, frame);
+        const double sr = (double)ma_engine_get_sample_rate(&gEngine);
+        const ma_uint64 len = (fadeBeats > 0.0) ? (ma_uint64)(transport_seconds_between(gTransport, target, target + fadeBeats) * sr + 0.5) : 0;
+        music_slot_start_unlocked(slot, gTransport, frame, target);
+        if (gMusic.slots[1 - slot]) ma_sound_set_stop_time_in_pcm_frames(gMusic.slots[1 - slot], frame + len);
+
+        music_fade_publish_unlocked(frame, len, slot, false);
+        gMusic.active = slot;
+        gMusic.silent = false;
+        return target;
+    }
+
+
+    // Funde la musica a silencio en 'fadeBeats' beats desde el siguiente limite de 'quantize' beats
+    // Devuelve el beat en que empieza el fundido o -1 si no sonaba nada
+    __declspec(dllexport) double gm_audio_music_stop(double quantize, double fadeBeats) {
+        rec_call(REC_MUSIC_STOP, { quantize, fadeBeats });
+        if (!gEngineIniciado) return -1.0;
+        MutexGuard lock;
+        if (gMusic.active < 0 || gMusic.silent) return -1.0;
+        const int slot = 1 - gMusic.active;
+        music_slot_release_unlocked(slot, false);
+        ma_uint64 frame = 0;
+        const double target = music_next_boundary(gTransport, quantize, frame);
+        const double sr = (double)ma_engine_get_sample_rate(&gEngine);
+        const ma_uint64 len = (fadeBeats > 0.0) ? (ma_uint64)(transport_seconds_between(gTransport, target, target + fadeBeats) * sr + 0.5) : 0;
+        ma_sound_set_stop_time_in_pcm_frames(gMusic.slots[gMusic.active], frame + len);
+
+        music_fade_publish_unlocked(frame, len, slot, true);
+        gMusic.active = slot;
+        gMusic.silent = true;
+        return target;
+    }
+
+
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // AUTOMATIZACION
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Crea un carril de automatizacion sobre 'param' del handle 'target' contra el transport th
+    // Sonidos: "volume", "pan", "pitch" (1 = sin transponer), "cutoff" (Hz del filtro paso bajo, que se
+    // crea si no existe). Grupos de stems: "intensity", "volume"
+    // Handle 0: "volume" (master) o "music" (volumen del bus de gm_audio_music_*)
+    // Devuelve el handle del carril o 0 si falla. Sin puntos no cambia nada
+    __declspec(dllexport) double gm_audio_automation_create(double target, const char* param, double th) {
+        const ma_uint32 rseq = rec_call(REC_AUTOMATION_CREATE, { target, param, th });
+        if (!gEngineIniciado || param == nullptr) return 0.0;
+        const std::string p = param;
+        MutexGuard lock;
+        if (!transport_find_unlocked(th)) return 0.0;
+        std::unique_ptr<AutoLane> lane(new AutoLane());
+        lane->target = (int)target;
+        lane->transport = (int)th;
+        if (!automation_param_parse(lane->target, p, lane->param)) return 0.0;
+        if (!automation_target_prepare_unlocked(lane->target, lane->param)) return 0.0;
+        AutoTarget check;
+        if (!automation_resolve_unlocked(lane->target, lane->param, check)) return 0.0;
+        int id = makeId();
+        gAutoLanes[id] = std::move(lane);
+        rec_result(rseq, id);
+        return (double)id;
+    }
+
+
+    // Anade (o sustituye) un punto del carril en 'beat' del transport. 'curve' es la del tramo hasta el
+    // siguiente punto: 0 lineal, 1 exponencial (entre valores del mismo signo), 2 bezier con puntos de
+    // control c1 y c2 (fraccion del salto: 0.33 y 0.67 = lineal, 0 y 0.5 = empieza lento)
+    __declspec(dllexport) double gm_audio_automation_add_point(double lane, double beat, double value, double curve, double c1, double c2) {
+        rec_call(REC_AUTOMATION_ADD_POINT, { lane, beat, value, curve, c1, c2 });
+        if (beat < 0.0 || curve < 0.0 || curve > 2.0) return 0.0;
+        MutexGuard lock;
+        auto it = gAutoLanes.find((int)lane);
+        if (it == gAutoLanes.end() || it->second->song >= 0) return 0.0;
+        automation_add_point(*it->second, AutoPoint{ beat, (float)value, (ma_uint8)curve, (float)c1, (float)c2 });
+        automation_publish_unlocked();
         return 1.0;
     }
 
 
-    // Volumen de 0 a 1
-    __declspec(dllexport) double gm_audio_set_volume(double idd, double v) {
-        int id = (int)idd;
-        float vol = (float)v;
-        if (vol < 0.f) vol = 0.f;
-        if (vol > 1.f) vol = 1.f;
-        std::lock_guard<std::mutex> lock(gMutex);
-        auto it = gSounds.find(id);
-        if (it == gSounds.end()) return 0.0;
-        ma_sound_set_volume(it->second, vol);
+    // Repite el carril cada 'beats' beats del transport (0 = sin repetir)
+    __declspec(dllexport) double gm_audio_automation_set_loop(double lane, double beats) {
+        rec_call(REC_AUTOMATION_SET_LOOP, { lane, beats });
+        if (beats < 0.0) return 0.0;
+        MutexGuard lock;
+        auto it = gAutoLanes.find((int)lane);
+        if (it == gAutoLanes.end() || it->second->song >= 0) return 0.0;
+        it->second->loopBeats = beats;
+        automation_publish_unlocked();
         return 1.0;
     }
 
 
-    // Loop on/off
-    __declspec(dllexport) double gm_audio_set_loop(double idd, double flag) {
-        int id = (int)idd;
-        ma_bool32 loop = (flag != 0.0) ? MA_TRUE : MA_FALSE;
-        std::lock_guard<std::mutex> lock(gMutex);
-        auto it = gSounds.find(id);
+    // Borra todos los puntos del carril (el parametro se queda en su ultimo valor)
+    __declspec(dllexport) double gm_audio_automation_clear(double lane) {
+        rec_call(REC_AUTOMATION_CLEAR, { lane });
+        MutexGuard lock;
+        auto it = gAutoLanes.find((int)lane);
+        if (it == gAutoLanes.end() || it->second->song >= 0) return 0.0;
+        it->second->points.clear();
+        automation_publish_unlocked();
+        return 1.0;
+    }
+
+
+    __declspec(dllexport) double gm_audio_automation_destroy(double lane) {
+        rec_call(REC_AUTOMATION_DESTROY, { lane });
+        MutexGuard lock;
+        auto it = gAutoLanes.find((int)lane);
+        if (it == gAutoLanes.end() || it->second->song >= 0) return 0.0;
+        gAutoLanes.erase(it);
+        automation_publish_unlocked();
+        return 1.0;
+    }
+
+
+    // Crea un LFO sobre 'param' del handle 'target' (los mismos destinos que gm_audio_automation_create)
+    // con el periodo en beats del transport th. No hace nada hasta gm_audio_lfo_set
+    // Devuelve el handle del LFO o 0 si falla
+    __declspec(dllexport) double gm_audio_lfo_create(double target, const char* param, double th) {
+        const ma_uint32 rseq = rec_call(REC_LFO_CREATE, { target, param, th });
+        if (!gEngineIniciado || param == nullptr) return 0.0;
+        const std::string p = param;
+        MutexGuard lock;
+        if (!transport_find_unlocked(th)) return 0.0;
+        std::unique_ptr<AutoLfo> lfo(new AutoLfo());
+        lfo->target = (int)target;
+        lfo->transport = (int)th;
+        if (!automation_param_parse(lfo->target, p, lfo->param)) return 0.0;
+        if (!automation_target_prepare_unlocked(lfo->target, lfo->param)) return 0.0;
+        AutoTarget check;
+        if (!automation_resolve_unlocked(lfo->target, lfo->param, check)) return 0.0;
+        int id = makeId();
+        gAutoLfos[id] = std::move(lfo);
+        rec_result(rseq, id);
+        return (double)id;
+    }
+
+
+    // Forma y rango del LFO: 0 seno, 1 triangulo, 2 cuadrada, 3 sample and hold (un valor al azar por
+    // periodo). El parametro oscila entre center - depth y center + depth, un ciclo cada periodBeats
+    // beats (0.25 = semicorchea). Ej.: tremolo center 0.7, depth 0.3; autopan center 0, depth 1
+    __declspec(dllexport) double gm_audio_lfo_set(double lfo, double shape, double periodBeats, double center, double depth) {
+        rec_call(REC_LFO_SET, { lfo, shape, periodBeats, center, depth });
+        if (shape < 0.0 || shape > 3.0 || !(periodBeats > 0.0)) return 0.0;
+        MutexGuard lock;
+        auto it = gAutoLfos.find((int)lfo);
+        if (it == gAutoLfos.end()) return 0.0;
+        AutoLfo& o = *it->second;
+        o.shape = (ma_uint8)shape;
+        o.periodBeats = periodBeats;
+        o.center = (float)center;
+        o.depth = (float)depth;
+        o.configured = true;
+        automation_publish_unlocked();
+        return 1.0;
+    }
+
+
+    // Desfase del LFO en ciclos (0.25 = un cuarto de periodo). Con fase 0 el ciclo empieza en el beat 0
+    __declspec(dllexport) double gm_audio_lfo_set_phase(double lfo, double phase) {
+        rec_call(REC_LFO_SET_PHASE, { lfo, phase });
+        MutexGuard lock;
+        auto it = gAutoLfos.find((int)lfo);
+        if (it == gAutoLfos.end()) return 0.0;
+        it->second->phase = phase - std::floor(phase);
+        automation_publish_unlocked();
+        return 1.0;
+    }
+
+
+    // Quita el LFO (el parametro se queda en su ultimo valor)
+    __declspec(dllexport) double gm_audio_lfo_destroy(double lfo) {
+        rec_call(REC_LFO_DESTROY, { lfo });
+        MutexGuard lock;
+        auto it = gAutoLfos.find((int)lfo);
+        if (it == gAutoLfos.end()) return 0.0;
+        gAutoLfos.erase(it);
+        automation_publish_unlocked();
+        return 1.0;
+    }
+
+
+    // Filtro paso bajo (12 dB/oct) del sonido id en 'hz' (10 Hz .. 0.45 * frecuencia de muestreo).
+    // La primera llamada lo crea; con 20000 queda practicamente abierto. Un LFO o carril sobre "cutoff"
+    // lo sobreescribe en el siguiente bloque
+    __declspec(dllexport) double gm_audio_set_lowpass(double id, double hz) {
+        rec_call(REC_SET_LOWPASS, { id, hz });
+        if (!gEngineIniciado || !(hz > 0.0)) return 0.0;
+        MutexGuard lock;
+        auto it = gSounds.find((int)id);
         if (it == gSounds.end()) return 0.0;
-        ma_sound_set_looping(it->second, loop);
+        const bool isNew = gSoundFilters.find((int)id) == gSoundFilters.end();
+        SoundFilter* f = sound_filter_get_unlocked((int)id, it->second);
+        if (!f) return 0.0;
+        f->cutoff.store(sound_filter_clamp((float)hz, f->node.lpf.sampleRate));
+        if (isNew) automation_publish_unlocked();
+        return 1.0;
+    }
+
+
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // DELAY SINCRONIZADO
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Crea un delay (bus de efecto) con el tiempo en beats del transport th: 0.75 beats, feedback 0.35,
+    // tono 6000 Hz, dry 1 y wet 0.35. Devuelve su handle o 0 si falla
+    __declspec(dllexport) double gm_audio_delay_create(double th) {
+        const ma_uint32 rseq = rec_call(REC_DELAY_CREATE, { th });
+        if (!gEngineIniciado) return 0.0;
+        MutexGuard lock;
+        Transport* t = transport_find_unlocked(th);
+        if (!t) return 0.0;
+        const ma_uint32 sr = ma_engine_get_sample_rate(&gEngine);
+        const ma_uint32 channels = ma_engine_get_channels(&gEngine);
+        std::unique_ptr<DelayBus> d(new DelayBus());
+        d->node.bus = d.get();
+        d->transport = (int)th;
+        d->channels = channels;
+        d->ringFrames = (ma_uint32)(kDelayMaxSec * sr) + 2;
+        d->ring.assign((size_t)d->ringFrames * channels, 0.0f);
+        d->tone.assign(channels, 0.0f);
+        d->glide = stem_smooth_coeff(0.05);
+        d->toneCoeff.store(delay_tone_coeff(6000.0));
+        const double rate = transport_bpm_at(*t, transport_get_beat_unlocked(*t)) / 60.0 / (double)sr;
+        d->targetFrames.store(delay_bus_frames(*d, d->beats.load(), rate));
+        d->curDelay = d->targetFrames.load();
+        ma_node_config nc = ma_node_config_init();
+        nc.vtable = &gDelayBusVtable;
+        nc.pInputChannels = &channels;
+        nc.pOutputChannels = &channels;
+        if (ma_node_init(ma_engine_get_node_graph(&gEngine), &nc, NULL, &d->node) != MA_SUCCESS) return 0.0;
+        ma_node_attach_output_bus(&d->node, 0, ma_engine_get_endpoint(&gEngine), 0);
+        int id = makeId();
+        gDelayBuses[id] = std::move(d);
+        automation_publish_unlocked();
+        rec_result(rseq, id);
+        return (double)id;
+    }
+
+
+    // Tiempo en beats (0.75 = corchea con puntillo en 4/4; maximo 4 s al tempo actual), realimentacion
+    // (0..0.98) y corte del paso bajo de las repeticiones en Hz
+    __declspec(dllexport) double gm_audio_delay_set(double h, double beats, double feedback, double toneHz) {
+        rec_call(REC_DELAY_SET, { h, beats, feedback, toneHz });
+        if (!gEngineIniciado || !(beats > 0.0)) return 0.0;
+        MutexGuard lock;
+        auto it = gDelayBuses.find((int)h);
+        if (it == gDelayBuses.end()) return 0.0;
+        DelayBus& d = *it->second;
+        d.beats.store(beats);
+        d.feedback.store((float)std::min(0.98, std::max(0.0, feedback)));
+        d.toneCoeff.store(delay_tone_coeff(toneHz));
+        return 1.0;
+    }
+
+
+    // Volumen de la senal directa y del eco
+    __declspec(dllexport) double gm_audio_delay_set_mix(double h, double dry, double wet) {
+        rec_call(REC_DELAY_SET_MIX, { h, dry, wet });
+        MutexGuard lock;
+        auto it = gDelayBuses.find((int)h);
+        if (it == gDelayBuses.end()) return 0.0;
+        it->second->dry.store((float)std::max(0.0, dry));
+        it->second->wet.store((float)std::max(0.0, wet));
         return 1.0;
     }
 
 
+    // Envia la salida del sonido id (despues de su filtro) al delay. delay = 0 lo devuelve al endpoint
+    __declspec(dllexport) double gm_audio_delay_send(double id, double delay) {
+        rec_call(REC_DELAY_SEND, { id, delay });
+        if (!gEngineIniciado) return 0.0;
+        MutexGuard lock;
+        auto itS = gSounds.find((int)id);
+        if (itS == gSounds.end()) return 0.0;
+        ma_node* dest = ma_engine_get_endpoint(&gEngine);
+        if ((int)delay != 0) {
+            auto itD = gDelayBuses.find((int)delay);
+            if (itD == gDelayBuses.end()) return 0.0;
+            dest = &itD->second->node;
+        }
+        ma_node_attach_output_bus(sound_output_node_unlocked((int)id, itS->second), 0, dest, 0);
+        return 1.0;
+    }
+
 
+    // Destruye el delay. Los sonidos que se le enviaban vuelven al endpoint
+    __declspec(dllexport) double gm_audio_delay_destroy(double h) {
+        rec_call(REC_DELAY_DESTROY, { h });
+        MutexGuard lock;
+        auto it = gDelayBuses.find((int)h);
+        if (it == gDelayBuses.end()) return 0.0;
+        std::unique_ptr<DelayBus> d = std::move(it->second);
+        gDelayBuses.erase(it);
+        delay_bus_unroute_unlocked(*d);
+        // el hilo de audio escribe su tiempo: se republica antes de liberarlo
+        automation_publish_unlocked();
+        ma_node_uninit(&d->node, NULL);
+        return 1.0;
+    }
 
 
     ////////////////////////////////////////////////////////////////////////////////////////
-    // TRANSPORT
+    // CHARTS Y JUICIO DE ENTRADA
     ////////////////////////////////////////////////////////////////////////////////////////
 
-    // Pone el transport en marcha. Si ya estaba en play, no reinicia baseBeat
-    __declspec(dllexport) double gm_audio_transport_play() {
-        std::lock_guard<std::mutex> lock(gMutex);
+    // Reloj de los timestamps de entrada en us (offline: el tiempo del engine). Para pasar get_timer()
+    // de GML a este reloj basta con sumarle (gm_audio_time_us() - get_timer()) medido una vez
+    __declspec(dllexport) double gm_audio_time_us() {
+        if (gEngineIniciado && gEngineOffline) {
+            return (double)ma_engine_get_time_in_pcm_frames(&gEngine) * 1e6 / (double)ma_engine_get_sample_rate(&gEngine);
+        }
+        return wall_time_us();
+    }
+
+
+    // Latencia de salida del dispositivo en ms (0 offline). Ya se descuenta en gm_audio_judge_input
+    __declspec(dllexport) double gm_audio_get_output_latency_ms() {
+        MutexGuard lock;
         if (!gEngineIniciado) return 0.0;
-        if (!gTransport.playing.load()) {
-            gTransport.startTime = std::chrono::high_resolution_clock::now();
-            gTransport.playing.store(true);
+        return output_latency_sec() * 1000.0;
+    }
+
+
+    // Crea un chart vacio. Devuelve su handle
+    __declspec(dllexport) double gm_audio_chart_create() {
+        const ma_uint32 rseq = rec_call(REC_CHART_CREATE);
+        MutexGuard lock;
+        int id = makeId();
+        gCharts[id] = std::unique_ptr<Chart>(new Chart());
+        rec_result(rseq, id);
+        return (double)id;
+    }
+
+
+    // Anade una nota en 'beat' al carril 'lane' (0..63). length > 0 = nota larga de 'length' beats
+    __declspec(dllexport) double gm_audio_chart_add_note(double chart, double lane, double beat, double length) {
+        rec_call(REC_CHART_ADD_NOTE, { chart, lane, beat, length });
+        MutexGuard lock;
+        auto it = gCharts.find((int)chart);
+        if (it == gCharts.end()) return 0.0;
+        return chart_add_note(*it->second, (int)lane, beat, length) ? 1.0 : 0.0;
+    }
+
+
+    // Carga un chart desde un archivo binario (cabecera GMCH) o JSON. Devuelve su handle o 0 si falla
+    __declspec(dllexport) double gm_audio_chart_load_file(const char* path) {
+        const ma_uint32 rseq = rec_call(REC_CHART_LOAD, { path });
+        if (path == nullptr) return 0.0;
+        std::string data;
+        if (!readTextFile(path, data)) return 0.0;
+        std::unique_ptr<Chart> c(new Chart());
+        const bool binary = data.size() >= 4 && memcmp(data.data(), kChartMagic, 4) == 0;
+        if (!(binary ? chart_load_binary(data, *c) : chart_load_json(data, *c))) return 0.0;
+        MutexGuard lock;
+        int id = makeId();
+        gCharts[id] = std::move(c);
+        rec_result(rseq, id);
+        return (double)id;
+    }
+
+
+    // Guarda el chart en el formato binario
+    __declspec(dllexport) double gm_audio_chart_save_file(double chart, const char* path) {
+        rec_call(REC_CHART_SAVE, { chart, path });
+        if (path == nullptr) return 0.0;
+        MutexGuard lock;
+        auto it = gCharts.find((int)chart);
+        if (it == gCharts.end()) return 0.0;
+        return chart_save_binary(*it->second, path) ? 1.0 : 0.0;
+    }
+
+
+    // Numero de notas visibles en [beatFrom, beatTo) (para dimensionar el buffer de gm_audio_chart_query)
+    __declspec(dllexport) double gm_audio_chart_count(double chart, double beatFrom, double beatTo) {
+        MutexGuard lock;
+        auto it = gCharts.find((int)chart);
+        if (it == gCharts.end()) return 0.0;
+        size_t n = 0;
+        chart_visible(*it->second, beatFrom, beatTo, [&](int, const ChartNote&) { ++n; return true; });
+        return (double)n;
+    }
+
+
+    // Escribe en 'buffer' (buffer_get_address) las notas visibles en [beatFrom, beatTo) como f64
+    // beat, lane, length (24 bytes por nota), por carril y en orden de beat; las notas largas que
+    // empezaron antes y siguen dentro tambien salen. A la entrada el primer f64 del buffer es su
+    // capacidad en notas (buffer_poke antes de llamar): no se escribe mas alla. Va en el buffer y no
+    // como quinto argumento porque GameMaker no admite mas de 4 si alguno es un puntero
+    // Devuelve las escritas (gm_audio_chart_count da las visibles). No se graba: el buffer es de la partida
+    __declspec(dllexport) double gm_audio_chart_query(double chart, double beatFrom, double beatTo, void* buffer) {
+        if (buffer == nullptr) return 0.0;
+        double* out = (double*)buffer;
+        const double capacity = out[0];
+        if (!(capacity >= 1.0)) return 0.0;
+        const size_t cap = (capacity < 1e9) ? (size_t)capacity : (size_t)1e9;
+        MutexGuard lock;
+        auto it = gCharts.find((int)chart);
+        if (it == gCharts.end()) return 0.0;
+        size_t n = 0;
+        chart_visible(*it->second, beatFrom, beatTo, [&](int lane, const ChartNote& note) {
+            out[n * 3 + 0] = note.beat;
+            out[n * 3 + 1] = (double)lane;
+            out[n * 3 + 2] = (double)note.length;
+            return ++n < cap;
+        });
+        return (double)n;
+    }
+
+
+    __declspec(dllexport) double gm_audio_chart_destroy(double chart) {
+        rec_call(REC_CHART_DESTROY, { chart });
+        MutexGuard lock;
+        if (gCharts.erase((int)chart) == 0) return 0.0;
+        if (gJudge.chart == (int)chart) gJudge.chart = 0;
+        return 1.0;
+    }
+
+
+    // Chart contra el que juzga gm_audio_judge_input y transport que da los beats
+    __declspec(dllexport) double gm_audio_judge_set_chart(double chart, double th) {
+        rec_call(REC_JUDGE_SET_CHART, { chart, th });
+        MutexGuard lock;
+        if (gCharts.find((int)chart) == gCharts.end() || !transport_find_unlocked(th)) return 0.0;
+        gJudge.chart = (int)chart;
+        gJudge.transport = (int)th;
+        return 1.0;
+    }
+
+
+    // Ventanas de juicio en ms a cada lado de la nota (crecientes): perfect, great, good y miss
+    __declspec(dllexport) double gm_audio_judge_set_windows(double perfectMs, double greatMs, double goodMs, double missMs) {
+        rec_call(REC_JUDGE_SET_WINDOWS, { perfectMs, greatMs, goodMs, missMs });
+        if (perfectMs < 0.0 || greatMs < perfectMs || goodMs < greatMs || missMs < goodMs) return 0.0;
+        MutexGuard lock;
+        gJudge.windowsMs[0] = perfectMs;
+        gJudge.windowsMs[1] = greatMs;
+        gJudge.windowsMs[2] = goodMs;
+        gJudge.windowsMs[3] = missMs;
+        return 1.0;
+    }
+
+
+    // Calibracion del jugador en ms (positivo si pulsa tarde porque oye el audio tarde)
+    __declspec(dllexport) double gm_audio_judge_set_calibration(double ms) {
+        rec_call(REC_JUDGE_SET_CALIBRATION, { ms });
+        MutexGuard lock;
+        gJudge.calibrationMs = ms;
+        return 1.0;
+    }
+
+
+    // Vuelve a dejar pendientes todas las notas del chart del juez (reintentar, seek hacia atras)
+    __declspec(dllexport) double gm_audio_judge_reset() {
+        rec_call(REC_JUDGE_RESET);
+        MutexGuard lock;
+        auto it = gCharts.find(gJudge.chart);
+        if (it == gCharts.end()) return 0.0;
+        for (ChartLane& lane : it->second->lanes) {
+            for (ChartNote& n : lane.notes) n.judged = false;
+        }
+        return 1.0;
+    }
+
+
+    // Juzga una pulsacion en el carril 'lane' hecha en timestampUs (reloj de gm_audio_time_us)
+    // Devuelve 0 perfect, 1 great, 2 good, 3 miss o -1 si no hay nota pendiente en la ventana de miss
+    // El desfase (ms, negativo = pronto) y el beat de la nota quedan en gm_audio_judge_last_offset/beat
+    __declspec(dllexport) double gm_audio_judge_input(double timestampUs, double lane) {
+        rec_call(REC_JUDGE_INPUT, { timestampUs, lane });
+        MutexGuard lock;
+        if (!gEngineIniciado) return JUDGE_NONE;
+        auto it = gCharts.find(gJudge.chart);
+        Transport* t = transport_find_unlocked(gJudge.transport);
+        const int l = (int)lane;
+        if (it == gCharts.end() || !t || l < 0 || l >= (int)it->second->lanes.size()) return JUDGE_NONE;
+        const double frame = judge_heard_frame(timestampUs);
+        if (frame < 0.0) return JUDGE_NONE;
+        const ma_uint64 f0 = (ma_uint64)frame;
+        const double rate = t->clockRate.load(std::memory_order_relaxed);
+        const double beat = transport_clock_beat(*t, f0) + (frame - (double)f0) * rate;
+        ChartNote* n = chart_nearest_pending(it->second->lanes[l].notes, *t, beat, gJudge.windowsMs[3] / 1000.0);
+        if (!n) return JUDGE_NONE;
+        const double offsetMs = (beat >= n->beat) ? transport_seconds_between(*t, n->beat, beat) * 1000.0
+            : -transport_seconds_between(*t, beat, n->beat) * 1000.0;
+        const double a = std::fabs(offsetMs);
+        if (a > gJudge.windowsMs[3]) return JUDGE_NONE;
+        n->judged = true;
+        gJudge.lastOffsetMs = offsetMs;
+        gJudge.lastBeat = n->beat;
+        for (int w = 0; w < 3; ++w) {
+            if (a <= gJudge.windowsMs[w]) return w;
+        }
+        return JUDGE_MISS;
+    }
+
+
+    // Desfase en ms de la ultima nota juzgada (negativo = antes de tiempo)
+    __declspec(dllexport) double gm_audio_judge_last_offset() {
+        MutexGuard lock;
+        return gJudge.lastOffsetMs;
+    }
+
+
+    // Beat de la ultima nota juzgada (-1 si ninguna)
+    __declspec(dllexport) double gm_audio_judge_last_beat() {
+        MutexGuard lock;
+        return gJudge.lastBeat;
+    }
+
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // ANALISIS EN SEGUNDO PLANO
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Carpeta (ya existente) donde guardar y buscar los resultados de analisis. "" = solo en memoria
+    __declspec(dllexport) double gm_audio_analysis_set_cache_dir(const char* dir) {
+        rec_call(REC_ANALYSIS_SET_CACHE_DIR, { dir });
+        if (dir == nullptr) return 0.0;
+        std::lock_guard<std::mutex> lk(gAnalysisMutex);
+        gAnalysisCacheDir = dir;
+        while (!gAnalysisCacheDir.empty() && (gAnalysisCacheDir.back() == '/' || gAnalysisCacheDir.back() == '\\')) {
+            gAnalysisCacheDir.pop_back();
         }
         return 1.0;
     }
 
 
-    // Pausa el transport acumulando el beat actual en baseBeat
-    __declspec(dllexport) double gm_audio_transport_pause() {
-        std::lock_guard<std::mutex> lock(gMutex);
-        if (!gEngineIniciado) return 0.0;
-        if (gTransport.playing.load()) {
-            gTransport.baseBeat = transport_get_beat_unlocked();
-            gTransport.playing.store(false);
-        }
-        return 1.0;
+    // Picos de la forma de onda de un archivo en 'buckets' columnas: escribe en 'buffer'
+    // (buffer_get_address) el minimo y el maximo de cada columna como f32, todos los canales juntos
+    // (8 bytes por columna). No hace falta gm_audio_init
+    // La primera llamada encola el calculo: devuelve 0 mientras esta pendiente, -1 si el archivo no se
+    // puede decodificar y 'buckets' cuando ha escrito el resultado (cacheado por archivo y columnas)
+    // No se graba: el buffer es de la partida
+    __declspec(dllexport) double gm_audio_waveform_peaks(const char* path, double buckets, void* buffer) {
+        if (path == nullptr || buffer == nullptr || buckets < 1.0 || buckets > 1048576.0) return -1.0;
+        const ma_uint32 n = (ma_uint32)buckets;
+        const std::string p = path;
+        const std::string key = p + "#" + std::to_string(n);
+        std::lock_guard<std::mutex> lk(gAnalysisMutex);
+        auto it = gWaveforms.find(key);
+        if (it == gWaveforms.end()) {
+            gWaveforms[key] = std::unique_ptr<WaveformPeaks>(new WaveformPeaks());
+            analysis_enqueue_locked([p, n, key] { waveform_job(p, n, key); });
+            return 0.0;
+        }
+        if (it->second->state != ANALYSIS_READY) return (double)it->second->state;
+        memcpy(buffer, it->second->minmax.data(), it->second->minmax.size() * sizeof(float));
+        return (double)n;
+    }
+
+
+    // Precalcula en segundo plano la envolvente RMS de un archivo con 'hz' valores por segundo (1..1000,
+    // 100 si es 0). Llamar al cargar: despues se consulta sin coste con gm_audio_envelope_get/at
+    // Devuelve 0 mientras esta pendiente, 1 cuando esta lista y -1 si el archivo no se puede decodificar
+    // La primera peticion de un archivo fija su resolucion
+    __declspec(dllexport) double gm_audio_envelope_request(const char* path, double hz) {
+        rec_call(REC_ENVELOPE_REQUEST, { path, hz });
+        if (path == nullptr || hz < 0.0 || hz > 1000.0) return -1.0;
+        if (hz < 1.0) hz = 100.0;
+        const std::string p = path;
+        std::lock_guard<std::mutex> lk(gAnalysisMutex);
+        auto it = gEnvelopes.find(p);
+        if (it == gEnvelopes.end()) {
+            std::unique_ptr<RmsEnvelope> e(new RmsEnvelope());
+            e->rateHz = hz;
+            gEnvelopes[p] = std::move(e);
+            analysis_enqueue_locked([p, hz] { envelope_job(p, hz); });
+            return 0.0;
+        }
+        return (double)it->second->state;
+    }
+
+
+    // Nivel RMS (0..1) de un sonido en lo que se esta oyendo ahora: su cursor menos la latencia de
+    // salida. O(1): no analiza nada. -1 si el sonido no existe o su envolvente no esta lista
+    __declspec(dllexport) double gm_audio_envelope_get(double idd) {
+        MutexGuard lock;
+        auto it = gSounds.find((int)idd);
+        auto itPath = gSoundPaths.find((int)idd);
+        if (it == gSounds.end() || itPath == gSoundPaths.end()) return -1.0;
+        ma_uint64 cursor = 0;
+        auto itPaused = gPausedFrame.find((int)idd);
+        if (itPaused != gPausedFrame.end()) cursor = itPaused->second;
+        else if (ma_sound_get_cursor_in_pcm_frames(it->second, &cursor) != MA_SUCCESS) return -1.0;
+        std::lock_guard<std::mutex> lk(gAnalysisMutex);
+        auto itEnv = gEnvelopes.find(itPath->second);
+        if (itEnv == gEnvelopes.end() || itEnv->second->state != ANALYSIS_READY) return -1.0;
+        const RmsEnvelope& e = *itEnv->second;
+        // el resource manager decodifica a la frecuencia del engine: cursor y latencia van en sus frames
+        const double engineRate = (double)ma_engine_get_sample_rate(&gEngine);
+        const double heard = ma_sound_is_playing(it->second) ? (double)cursor - output_latency_sec() * engineRate : (double)cursor;
+        return envelope_value_locked(e, heard * e.sampleRate / engineRate);
+    }
+
+
+    // Nivel RMS (0..1) de un archivo en el segundo 'sec'. -1 si su envolvente no esta lista
+    __declspec(dllexport) double gm_audio_envelope_at(const char* path, double sec) {
+        if (path == nullptr) return -1.0;
+        std::lock_guard<std::mutex> lk(gAnalysisMutex);
+        auto it = gEnvelopes.find(path);
+        if (it == gEnvelopes.end() || it->second->state != ANALYSIS_READY) return -1.0;
+        return envelope_value_locked(*it->second, sec * it->second->sampleRate);
+    }
+
+
+    // Analiza en segundo plano los onsets, el tempo y la fase de un archivo (mp3, wav...)
+    // Devuelve 0 mientras esta pendiente, 1 cuando esta listo y -1 si no se puede analizar
+    __declspec(dllexport) double gm_audio_tempo_analyze(const char* path) {
+        rec_call(REC_TEMPO_ANALYZE, { path });
+        if (path == nullptr) return -1.0;
+        const std::string p = path;
+        std::lock_guard<std::mutex> lk(gAnalysisMutex);
+        auto it = gTempoAnalyses.find(p);
+        if (it == gTempoAnalyses.end()) {
+            gTempoAnalyses[p] = std::unique_ptr<TempoAnalysis>(new TempoAnalysis());
+            analysis_enqueue_locked([p] { tempo_job(p); });
+            return 0.0;
+        }
+        return (double)it->second->state;
+    }
+
+
+    // BPM detectado (60..200; -1 si el analisis no esta listo)
+    __declspec(dllexport) double gm_audio_tempo_get_bpm(const char* path) {
+        std::lock_guard<std::mutex> lk(gAnalysisMutex);
+        const TempoAnalysis* a = tempo_ready_locked(path);
+        return a ? a->bpm : -1.0;
     }
 
 
-    // Para el transport y resetea el contador a 0.
-    __declspec(dllexport) double gm_audio_transport_stop() {
-        std::lock_guard<std::mutex> lock(gMutex);
-        if (!gEngineIniciado) return 0.0;
+    // Segundo del archivo en el que cae el primer beat de la rejilla detectada (-1 si no esta listo)
+    __declspec(dllexport) double gm_audio_tempo_get_offset(const char* path) {
+        std::lock_guard<std::mutex> lk(gAnalysisMutex);
+        const TempoAnalysis* a = tempo_ready_locked(path);
+        return a ? a->offsetSec : -1.0;
+    }
 
-        // Para el transport y resetea el beat base a 0
-        gTransport.playing.store(false);
-        gTransport.baseBeat = 0.0;
 
-        // Limpiar cola de lanzamientos cuantizados
-        gQueue.clear();
+    // Numero de onsets detectados (-1 si no esta listo)
+    __declspec(dllexport) double gm_audio_tempo_onset_count(const char* path) {
+        std::lock_guard<std::mutex> lk(gAnalysisMutex);
+        const TempoAnalysis* a = tempo_ready_locked(path);
+        return a ? (double)a->onsets.size() : -1.0;
+    }
 
-        // Parar y agenda borrado de voces pendientes
-        for (auto& ps : gPendingStops) {
-            if (ps.voice) {
-                ma_sound_stop(ps.voice);
-                schedule_sound_delete(ps.voice);
-                ps.voice = nullptr;
-            }
-        }
-        gPendingStops.clear();
 
-        // Parar y agenda borrado de voces activas
-        for (auto& av : gActiveVoices) {
-            if (av.sound) {
-                ma_sound_stop(av.sound);
-                schedule_sound_delete(av.sound);
-                av.sound = nullptr;
-            }
-        }
-        gActiveVoices.clear();
+    // Escribe los onsets (segundos, f64) en 'buffer', como mucho 'max' (su capacidad en valores): no se
+    // escribe mas alla aunque haya mas (gm_audio_tempo_onset_count da cuantos hay)
+    // Devuelve los escritos (-1 si no esta listo). No se graba: el buffer es de la partida
+    __declspec(dllexport) double gm_audio_tempo_get_onsets(const char* path, void* buffer, double max) {
+        if (buffer == nullptr) return -1.0;
+        std::lock_guard<std::mutex> lk(gAnalysisMutex);
+        const TempoAnalysis* a = tempo_ready_locked(path);
+        if (!a) return -1.0;
+        const size_t cap = (max >= 1.0) ? ((max < 1e9) ? (size_t)max : (size_t)1e9) : 0;
+        const size_t n = std::min(cap, a->onsets.size());
+        double* out = (double*)buffer;
+        for (size_t i = 0; i < n; ++i) out[i] = a->onsets[i];
+        return (double)n;
+    }
 
-        // Reiniciar la cancin: empezar desde el principio
-        if (gSong.loaded) {
-            gSong.startBeat = 0.0;
-            for (auto& ev : gSong.events) {
-                ev.active = true;
-                // Mantener offsetBeat para respetar la posicin del evento en el patrn
-                ev.nextBeat = ev.offsetBeat;
-            }
-        }
 
+    // Pone el transport th al bpm detectado (misma logica que gm_audio_transport_set_tempo_h)
+    // La musica entra en fase si arranca cuando el transport pasa por un beat, gm_audio_tempo_get_offset
+    // segundos dentro del archivo
+    __declspec(dllexport) double gm_audio_tempo_apply_h(double th, const char* path) {
+        rec_call(REC_TEMPO_APPLY_H, { th, path });
+        MutexGuard lock;
+        Transport* t = transport_find_unlocked(th);
+        if (!t) return 0.0;
+        double bpm = 0.0;
+        {
+            std::lock_guard<std::mutex> lk(gAnalysisMutex);
+            const TempoAnalysis* a = tempo_ready_locked(path);
+            if (!a) return 0.0;
+            bpm = a->bpm;
+        }
+        transport_set_tempo_unlocked(*t, bpm);
         return 1.0;
     }
 
 
 
 
-    // Cambia el BPM manteniendo la continuidad del beat
-    __declspec(dllexport) double gm_audio_set_tempo(double bpm) {
-        std::lock_guard<std::mutex> lock(gMutex);
-        if (bpm <= 0.0) return 0.0;
-
-        // Captura el beat actual con el bpm anterior
-        double current = transport_get_beat_unlocked();
-
-        // Aplica el nuevo bpm
-        gTransport.bpm.store(bpm);
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // ESTADISTICAS
+    ////////////////////////////////////////////////////////////////////////////////////////
 
-        // Si esta en play, reancla el reloj al instante actual manteniendo el beat
-        if (gTransport.playing.load()) {
-            gTransport.baseBeat = current;
-            gTransport.startTime = std::chrono::high_resolution_clock::now();
+    // Devuelve un contador interno por nombre (-1 si no existe)
+    // lock_acquires, lock_contended, lock_wait_us, lock_wait_max_us, sounds, queue, transports, songs, pool_voices, playlists,
+    // automation_lanes, lfos, delays, charts, analysis_jobs,
+    // rt_check (1 si la DLL se compilo con GMAUDIO_RT_CHECK), rt_allocs, rt_frees, rt_locks
+    __declspec(dllexport) double gm_audio_stats_get(const char* name) {
+        if (name == nullptr) return -1.0;
+        const std::string n = name;
+#ifdef GMAUDIO_RT_CHECK
+        if (n == "rt_check") return 1.0;
+#else
+        if (n == "rt_check") return 0.0;
+#endif
+        if (n == "rt_allocs") return (double)gStats.rtAllocs.load();
+        if (n == "rt_frees") return (double)gStats.rtFrees.load();
+        if (n == "rt_locks") return (double)gStats.rtLocks.load();
+        if (n == "lock_acquires") return (double)gStats.lockAcquires.load();
+        if (n == "lock_contended") return (double)gStats.lockContended.load();
+        if (n == "lock_wait_us") return (double)gStats.lockWaitNs.load() / 1000.0;
+        if (n == "lock_wait_max_us") return (double)gStats.lockWaitMaxNs.load() / 1000.0;
+        if (n == "sounds") {
+            MutexGuard lock;
+            return (double)gSounds.size();
         }
-        else {
-            // En pausa: conserva el beat actual
-            gTransport.baseBeat = current;
+        if (n == "queue") {
+            MutexGuard lock;
+            return (double)gQueue.size();
         }
-        return 1.0;
+        if (n == "transports") {
+            MutexGuard lock;
+            return (double)gTransports.size() + 1.0;
+        }
+        if (n == "songs") {
+            MutexGuard lock;
+            return (double)gSongs.size() + 1.0;
+        }
+        if (n == "pool_voices") {
+            MutexGuard lock;
+            size_t total = 0;
+            for (auto& kv : gVoicePools) total += kv.second->voices.size();
+            return (double)total;
+        }
+        if (n == "playlists") {
+            MutexGuard lock;
+            return (double)gPlaylists.size();
+        }
+        if (n == "automation_lanes") {
+            MutexGuard lock;
+            return (double)gAutoLanes.size();
+        }
+        if (n == "lfos") {
+            MutexGuard lock;
+            return (double)gAutoLfos.size();
+        }
+        if (n == "delays") {
+            MutexGuard lock;
+            return (double)gDelayBuses.size();
+        }
+        if (n == "charts") {
+            MutexGuard lock;
+            return (double)gCharts.size();
+        }
+        if (n == "analysis_jobs") {
+            std::lock_guard<std::mutex> lk(gAnalysisMutex);
+            return (double)gAnalysisJobs.size();
+        }
+        return -1.0;
     }
 
 
+    // Pone a cero los contadores acumulados
+    __declspec(dllexport) double gm_audio_stats_reset() {
+        gStats.lockAcquires.store(0);
+        gStats.lockContended.store(0);
+        gStats.lockWaitNs.store(0);
+        gStats.lockWaitMaxNs.store(0);
+        gStats.rtAllocs.store(0);
+        gStats.rtFrees.store(0);
+        gStats.rtLocks.store(0);
+        return 1.0;
+    }
 
-    // Devuelve el beat actual como double
-    __declspec(dllexport) double gm_audio_get_beat_position() {
-        std::lock_guard<std::mutex> lock(gMutex);
-        return transport_get_beat_unlocked();
+
+    // Activa/desactiva parar en la primera violacion de tiempo real (__debugbreak)
+    // Devuelve 0 si la DLL no se compilo con GMAUDIO_RT_CHECK
+    __declspec(dllexport) double gm_audio_rtcheck_set_trap(double flag) {
+#ifdef GMAUDIO_RT_CHECK
+        gRtTrap.store(flag != 0.0);
+        return 1.0;
+#else
+        (void)flag;
+        return 0.0;
+#endif
     }
 
 
+    // Violaciones de tiempo real acumuladas (para los informes de los benchmarks)
+    struct RtSnapshot {
+        ma_uint64 allocs = 0, frees = 0, locks = 0;
+    };
+
+    static RtSnapshot rt_snapshot() {
+        RtSnapshot s;
+        s.allocs = gStats.rtAllocs.load();
+        s.frees = gStats.rtFrees.load();
+        s.locks = gStats.rtLocks.load();
+        return s;
+    }
+
+    static void bench_write_rt(FILE* f, const RtSnapshot& s0) {
+        const RtSnapshot s1 = rt_snapshot();
+#ifdef GMAUDIO_RT_CHECK
+        fprintf(f, "rt_check=on audio_thread: allocs=%llu frees=%llu gMutex_locks=%llu\n",
+            (unsigned long long)(s1.allocs - s0.allocs), (unsigned long long)(s1.frees - s0.frees),
+            (unsigned long long)(s1.locks - s0.locks));
+#else
+        (void)s1;
+        (void)s0;
+        fprintf(f, "rt_check=off (compilar con GMAUDIO_RT_CHECK)\n");
+#endif
+    }
 
 
 
 
     ////////////////////////////////////////////////////////////////////////////////////////
-    // Preset JSON
+    // BENCHMARK DE CONTENCION
+    // - N hilos llaman a play/stop/set_volume/get_beat_position/tick durante X segundos
+    // - cada llamada se cronometra en un histograma log2 (en ns) por operacion
+    // - la espera en gMutex sale de gStats (diferencia antes/despues)
+    // - semillas fijas por hilo: dos ejecuciones con la misma config hacen la misma secuencia de ops
     ////////////////////////////////////////////////////////////////////////////////////////
 
-    // Lee un archivo JSON y, si tiene bpm, actualiza el transport
-    // Mantiene continuidad del beat en play, resetea a 0 en stop/pausa inicial.
-    __declspec(dllexport) double gm_audio_load_preset_file(const char* path) {
-        if (!gEngineIniciado || path == nullptr) return 0.0;
-        std::lock_guard<std::mutex> lock(gMutex);
-        std::string txt;
-        if (!readTextFile(path, txt)) return 0.0;
-        double bpm = gTransport.bpm.load();
-        double parsed = bpm;
-        if (json_extract_bpm(txt, parsed) && parsed > 0.0) {
-            bpm = parsed;
+    enum BenchOp { BENCH_PLAY, BENCH_STOP, BENCH_SET_VOLUME, BENCH_GET_BEAT, BENCH_TICK, BENCH_OP_COUNT };
+    static const char* const kBenchOpNames[BENCH_OP_COUNT] = { "play", "stop", "set_volume", "get_beat_position", "tick" };
+    static const int kHistBuckets = 40;   // bucket i: [2^i, 2^(i+1)) ns
+
+    struct LatencyHist {
+        ma_uint64 count = 0;
+        ma_uint64 totalNs = 0;
+        ma_uint64 maxNs = 0;
+        ma_uint64 buckets[kHistBuckets] = {};
+
+        void add(ma_uint64 ns) {
+            int b = 0;
+            while (b < kHistBuckets - 1 && (ns >> (b + 1)) != 0) ++b;
+            ++buckets[b];
+            ++count;
+            totalNs += ns;
+            if (ns > maxNs) maxNs = ns;
         }
-
-        // Aplica bpm con la misma logica que set_tempo
-        double current = transport_get_beat_unlocked();
-        gTransport.bpm.store(bpm);
-        if (gTransport.playing.load()) {
-            gTransport.baseBeat = current;
-            gTransport.startTime = std::chrono::high_resolution_clock::now();
+        void merge(const LatencyHist& o) {
+            for (int i = 0; i < kHistBuckets; ++i) buckets[i] += o.buckets[i];
+            count += o.count;
+            totalNs += o.totalNs;
+            if (o.maxNs > maxNs) maxNs = o.maxNs;
         }
-        else {
-            // Si estaba parado/pausado, empezamos desde 0 para reflejar preset nuevo
-            gTransport.baseBeat = 0.0;
+        // Percentil aproximado: limite superior del bucket que lo contiene (en us)
+        double percentile_us(double p) const {
+            if (count == 0) return 0.0;
+            const ma_uint64 target = (ma_uint64)std::ceil(p * (double)count);
+            ma_uint64 acc = 0;
+            for (int i = 0; i < kHistBuckets; ++i) {
+                acc += buckets[i];
+                if (acc >= target) return (double)(1ull << (i + 1)) / 1000.0;
+            }
+            return (double)maxNs / 1000.0;
         }
-        return 1.0;
+    };
+
+    static void bench_write_hist(FILE* f, const char* name, const LatencyHist& h, double seconds) {
+        const double meanUs = h.count ? (double)h.totalNs / (double)h.count / 1000.0 : 0.0;
+        fprintf(f, "op %-18s calls=%llu (%.0f/s) mean_us=%.3f p50_us<=%.3f p99_us<=%.3f max_us=%.3f\n",
+            name, (unsigned long long)h.count, (double)h.count / seconds, meanUs,
+            h.percentile_us(0.50), h.percentile_us(0.99), (double)h.maxNs / 1000.0);
+        fprintf(f, "   hist_ns:");
+        for (int i = 0; i < kHistBuckets; ++i) {
+            if (h.buckets[i]) fprintf(f, " [%llu,%llu)=%llu", 1ull << i, 1ull << (i + 1), (unsigned long long)h.buckets[i]);
+        }
+        fprintf(f, "\n");
     }
 
 
+    // Lanza el benchmark de contencion. soundPath: archivo que usan los play
+    // reportPath: informe de texto (throughput, histogramas por op y espera en el lock)
+    // Devuelve el throughput total (llamadas/s) o 0 si el engine no esta iniciado
+    __declspec(dllexport) double gm_audio_bench_contention(const char* soundPath, const char* reportPath, double threads, double seconds) {
+        if (!gEngineIniciado || soundPath == nullptr || reportPath == nullptr) return 0.0;
+        RecMute mute;   // las llamadas de los hilos del bench no son del juego
+        const int nThreads = (threads >= 1.0) ? (int)threads : 1;
+        if (seconds <= 0.0) seconds = 1.0;
+        const std::string path = soundPath;
+
+        const ma_uint64 acq0 = gStats.lockAcquires.load(), cont0 = gStats.lockContended.load();
+        const ma_uint64 wait0 = gStats.lockWaitNs.load();
+        gStats.lockWaitMaxNs.store(0);
+        const RtSnapshot rt0 = rt_snapshot();
+
+        std::atomic<bool> run{ true };
+        std::vector<std::vector<LatencyHist>> hists(nThreads, std::vector<LatencyHist>(BENCH_OP_COUNT));
+        std::vector<std::thread> workers;
+
+        // Con engine offline nadie consume audio: un hilo hace de dispositivo (periodos de ~10 ms)
+        std::thread renderer;
+        if (gEngineOffline) {
+            renderer = std::thread([&run] {
+                const double period = (double)ma_engine_get_sample_rate(&gEngine) / 100.0;
+                while (run.load()) {
+                    gm_audio_render(period);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+            });
+        }
 
+        // El benchmark necesita el transport 0 en marcha: al acabar se deja como estaba
+        bool wasPlaying;
+        double savedBeat;
+        {
+            MutexGuard lock;
+            wasPlaying = gTransport.playing.load();
+            savedBeat = transport_get_beat_unlocked(gTransport);
+            transport_play_unlocked(gTransport);
+        }
+        const auto t0 = std::chrono::steady_clock::now();
+        for (int t = 0; t < nThreads; ++t) {
+            workers.emplace_back([&, t] {
+                std::mt19937 rng(1234u + (unsigned)t);
+                std::vector<double> ids;
+                std::vector<LatencyHist>& h = hists[t];
+                while (run.load(std::memory_order_relaxed)) {
+                    int op = (int)(rng() % BENCH_OP_COUNT);
+                    if (op == BENCH_STOP && ids.empty()) op = BENCH_PLAY;
+                    const auto c0 = std::chrono::steady_clock::now();
+                    switch (op) {
+                    case BENCH_PLAY: {
+                        const double id = gm_audio_play(path.c_str());
+                        if (id > 0.0) ids.push_back(id);
+                        break;
+                    }
+                    case BENCH_STOP:
+                        gm_audio_stop(ids.front());
+                        ids.erase(ids.begin());
+                        break;
+                    case BENCH_SET_VOLUME:
+                        gm_audio_set_volume(ids.empty() ? 0.0 : ids[rng() % ids.size()], (double)(rng() % 100) / 100.0);
+                        break;
+                    case BENCH_GET_BEAT:
+                        gm_audio_get_beat_position();
+                        break;
+                    default:
+                        gm_audio_transport_tick();
+                        break;
+                    }
+                    h[op].add((ma_uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - c0).count());
+                    // acota las voces vivas por hilo
+                    if (ids.size() > 8) {
+                        gm_audio_stop(ids.front());
+                        ids.erase(ids.begin());
+                    }
+                }
+                for (double id : ids) gm_audio_stop(id);
+            });
+        }
 
-    ////////////////////////////////////////////////////////////////////////////////////////
-    // Lanzamiento cuantizado al beat
-    ////////////////////////////////////////////////////////////////////////////////////////
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        run.store(false);
+        for (auto& w : workers) w.join();
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if (renderer.joinable()) renderer.join();
+        gm_audio_transport_tick();   // libera los sonidos parados
+        if (!wasPlaying) {
+            MutexGuard lock;
+            transport_pause_unlocked(gTransport);
+            transport_seek_unlocked(0, gTransport, savedBeat);
+        }
 
-    // Prepara un sonido y lo programa para el proximo multiplo de quant beats
-    // 1 negras, 0.5 corcheas, 0.25 semicorcheas...
-    __declspec(dllexport) double gm_audio_play_on_beat(const char* path, double quant_beats) {
-        if (!gEngineIniciado || path == nullptr) return 0.0;
-        if (quant_beats <= 0.0) quant_beats = 1.0;
-        std::lock_guard<std::mutex> lock(gMutex);
-        ma_sound* s = new ma_sound();
-        if (ma_sound_init_from_file(&gEngine, path, 0, NULL, NULL, s) != MA_SUCCESS) {
-            delete s;
-            return 0.0;
+        LatencyHist all;
+        std::vector<LatencyHist> perOp(BENCH_OP_COUNT);
+        for (int t = 0; t < nThreads; ++t) {
+            for (int op = 0; op < BENCH_OP_COUNT; ++op) {
+                perOp[op].merge(hists[t][op]);
+                all.merge(hists[t][op]);
+            }
         }
-        int id = makeId();
-        gSounds[id] = s;
-        gPausedFrame.erase(id);
+        const ma_uint64 acq = gStats.lockAcquires.load() - acq0;
+        const ma_uint64 cont = gStats.lockContended.load() - cont0;
+        const ma_uint64 waitNs = gStats.lockWaitNs.load() - wait0;
+        const double throughput = (double)all.count / elapsed;
+
+        FILE* f = fopen(reportPath, "w");
+        if (f) {
+            fprintf(f, "gm_audio contention benchmark\n");
+            fprintf(f, "threads=%d seconds=%.3f engine=%s\n", nThreads, elapsed, gEngineOffline ? "offline" : "device");
+            fprintf(f, "total_calls=%llu throughput=%.0f calls/s\n", (unsigned long long)all.count, throughput);
+            fprintf(f, "lock acquires=%llu contended=%llu (%.2f%%) wait_total_us=%.1f wait_mean_us=%.3f wait_max_us=%.1f\n",
+                (unsigned long long)acq, (unsigned long long)cont, acq ? 100.0 * (double)cont / (double)acq : 0.0,
+                (double)waitNs / 1000.0, cont ? (double)waitNs / (double)cont / 1000.0 : 0.0,
+                (double)gStats.lockWaitMaxNs.load() / 1000.0);
+            for (int op = 0; op < BENCH_OP_COUNT; ++op) bench_write_hist(f, kBenchOpNames[op], perOp[op], elapsed);
+            bench_write_hist(f, "all", all, elapsed);
+            bench_write_rt(f, rt0);
+            fclose(f);
+        }
+        return throughput;
+    }
 
-        // Calcula el siguiente grid en beats
-        const double nowBeat = transport_get_beat_unlocked();
-        const double q = quant_beats;
-        const double next = std::ceil(nowBeat / q) * q;
 
-        // Encola el lanzamiento
-        gQueue.push_back({ id, next });
-        return (double)id;
-    }
 
 
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // MEDICION DE LATENCIA (trigger -> primera muestra no silenciosa)
+    // - engine offline propio a 48 kHz; el tap de captura detecta el onset en la salida
+    // - el juego se simula a 60 Hz: las llamadas se hacen en el instante ideal de cada Step
+    //   y entran en el siguiente bloque de audio (como con un dispositivo real)
+    // - play: latencia desde la llamada; play_on_beat: desde el frame ideal del beat objetivo
+    // - no incluye el buffer del dispositivo (aprox. periodos x tamano de bloque adicionales)
+    ////////////////////////////////////////////////////////////////////////////////////////
 
+    // Escribe un wav mono s16 con un impulso en el frame 0 (para detectar onsets)
+    static bool bench_write_impulse_wav(const std::string& path, ma_uint32 sampleRate, ma_uint32 frames) {
+        ma_encoder_config ec = ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, 1, sampleRate);
+        ma_encoder enc;
+        if (ma_encoder_init_file(path.c_str(), &ec, &enc) != MA_SUCCESS) return false;
+        std::vector<ma_int16> pcm(frames, 0);
+        pcm[0] = 32767;
+        ma_encoder_write_pcm_frames(&enc, pcm.data(), frames, NULL);
+        ma_encoder_uninit(&enc);
+        return true;
+    }
 
+    // Resumen de una distribucion (en frames)
+    static void bench_write_dist(FILE* f, const char* label, std::vector<double> v, int misses) {
+        if (v.empty()) {
+            fprintf(f, "%s n=0 misses=%d\n", label, misses);
+            return;
+        }
+        std::sort(v.begin(), v.end());
+        double sum = 0.0, sum2 = 0.0;
+        for (double x : v) { sum += x; sum2 += x * x; }
+        const double n = (double)v.size();
+        const double mean = sum / n;
+        const double sd = std::sqrt((std::max)(0.0, sum2 / n - mean * mean));
+        auto pct = [&](double p) { return v[(size_t)std::floor(p * (n - 1.0))]; };
+        fprintf(f, "%s n=%d misses=%d min=%.1f mean=%.2f sd=%.2f p50=%.1f p95=%.1f max=%.1f\n",
+            label, (int)v.size(), misses, v.front(), mean, sd, pct(0.50), pct(0.95), v.back());
+    }
 
-    // Tick del transport: revisa la cola y dispara los sonidos cuyo targetBeat llegue
-    __declspec(dllexport) double gm_audio_transport_tick() {
-        std::lock_guard<std::mutex> lock(gMutex);
-        if (!gEngineIniciado) return 0.0;
-        if (!gTransport.playing.load()) return 1.0;
-        const double beat = transport_get_beat_unlocked();
+    struct OnsetTap {
+        std::atomic<bool> armed{ false };
+        std::atomic<long long> onsetFrame{ -1 };
+    };
 
-        for (auto it = gQueue.begin(); it != gQueue.end();) {
-            if (beat + 1e-6 >= it->targetBeat) {
-                auto itS = gSounds.find(it->id);
-                if (itS != gSounds.end()) {
-                    ma_sound_seek_to_pcm_frame(itS->second, 0);
-                    ma_sound_start(itS->second);
+    static void onset_tap_proc(void* pUserData, const float* pFrames, ma_uint64 frameCount, ma_uint32 channels) {
+        OnsetTap* tap = (OnsetTap*)pUserData;
+        if (!tap->armed.load(std::memory_order_acquire)) return;
+        // el engine ya avanzo su reloj: el bloque empieza frameCount frames antes
+        const ma_uint64 blockStart = ma_engine_get_time_in_pcm_frames(&gEngine) - frameCount;
+        for (ma_uint64 i = 0; i < frameCount; ++i) {
+            for (ma_uint32 c = 0; c < channels; ++c) {
+                if (std::fabs(pFrames[i * channels + c]) > 1e-4f) {
+                    tap->onsetFrame.store((long long)(blockStart + i));
+                    tap->armed.store(false, std::memory_order_release);
+                    return;
                 }
-                it = gQueue.erase(it);
-            }
-            else {
-                ++it;
             }
         }
+    }
 
-        if (gSong.loaded) {
-            const double songLenBeats = (double)gSong.beatsPerBar * (double)gSong.bars;
 
-            for (auto it = gPendingStops.begin(); it != gPendingStops.end();) {
-                if (beat + 1e-6 >= it->endBeat) {
-                    if (it->voice) {
-                        ma_sound_stop(it->voice);
-                        schedule_sound_delete(it->voice);
-                        for (auto vit = gActiveVoices.begin(); vit != gActiveVoices.end();) {
-                            if (vit->sound == it->voice) vit = gActiveVoices.erase(vit);
-                            else ++vit;
+    // Ejecuta el harness de latencia y escribe el informe en reportPath
+    // Configs: bloque 64/256/1024 frames x carga decodificada/streaming x play/play_on_beat
+    // Necesita el engine parado (usa su propio engine offline). Devuelve 1 si ok
+    __declspec(dllexport) double gm_audio_bench_latency(const char* reportPath, double trials) {
+        if (reportPath == nullptr || gEngineIniciado) return 0.0;
+        RecMute mute;
+        const int nTrials = (trials >= 1.0) ? (int)trials : 50;
+        const ma_uint32 sr = 48000;
+        const std::string impulse = std::string(reportPath) + ".impulse.wav";
+        if (!bench_write_impulse_wav(impulse, sr, sr / 10)) return 0.0;
+
+        FILE* f = fopen(reportPath, "w");
+        if (!f) return 0.0;
+        fprintf(f, "gm_audio latency benchmark (frames @ %u Hz, game step 60 Hz, bpm 120)\n", sr);
+        const RtSnapshot rt0 = rt_snapshot();
+
+        static const ma_uint32 kBlocks[] = { 64, 256, 1024 };
+        static const int kModes[] = { 1, 2 };
+        static const char* const kModeNames[] = { "", "decoded", "streamed" };
+        OnsetTap tap;
+        std::mt19937 rng(42u);
+
+        for (ma_uint32 block : kBlocks) {
+            for (int mode : kModes) {
+                for (int path = 0; path < 2; ++path) {
+                    if (gm_audio_init_offline((double)sr, 2.0) == 0.0) { fclose(f); return 0.0; }
+                    gm_audio_set_load_mode((double)mode);
+                    gCaptureTapUserData = &tap;
+                    gCaptureTap.store(onset_tap_proc, std::memory_order_release);
+                    gm_audio_transport_play();
+                    const double frame0 = (double)ma_engine_get_time_in_pcm_frames(&gEngine);
+                    const double framesPerBeat = (double)sr * 60.0 / 120.0;
+                    const double step = (double)sr / 60.0;
+
+                    std::vector<double> lat;
+                    int misses = 0;
+                    double nextStep = frame0;
+                    for (int t = 0; t < nTrials; ++t) {
+                        // entre 3 y 12 Steps de espera para variar la fase respecto al bloque y al beat
+                        int wait = 3 + (int)(rng() % 10);
+                        double issueFrame = -1.0, idealFrame = -1.0, id = 0.0;
+                        const double deadline = (double)ma_engine_get_time_in_pcm_frames(&gEngine) + (double)sr * 2.0;
+                        while ((double)ma_engine_get_time_in_pcm_frames(&gEngine) < deadline) {
+                            const double now = (double)ma_engine_get_time_in_pcm_frames(&gEngine);
+                            while (nextStep <= now) {
+                                if (issueFrame < 0.0 && --wait <= 0) {
+                                    issueFrame = nextStep;
+                                    tap.onsetFrame.store(-1);
+                                    tap.armed.store(true, std::memory_order_release);
+                                    if (path == 0) {
+                                        id = gm_audio_play(impulse.c_str());
+                                        idealFrame = issueFrame;
+                                    }
+                                    else {
+                                        const double b = gm_audio_get_beat_position();
+                                        id = gm_audio_play_on_beat(impulse.c_str(), 1.0);
+                                        idealFrame = frame0 + std::ceil(b) * framesPerBeat;
+                                    }
+                                }
+                                gm_audio_transport_tick();
+                                nextStep += step;
+                            }
+                            if (issueFrame >= 0.0 && tap.onsetFrame.load() >= 0) break;
+                            gm_audio_render((double)block);
                         }
-                        it->voice = nullptr;
+                        const long long onset = tap.onsetFrame.load();
+                        if (onset >= 0) lat.push_back((double)onset - idealFrame);
+                        else ++misses;
+                        tap.armed.store(false);
+                        if (id > 0.0) gm_audio_stop(id);
                     }
-                    it = gPendingStops.erase(it);
+
+                    gCaptureTap.store(nullptr, std::memory_order_release);
+                    gm_audio_shutdown();
+                    char label[96];
+                    snprintf(label, sizeof(label), "block=%-5u load=%-8s path=%-12s", block, kModeNames[mode], path == 0 ? "play" : "play_on_beat");
+                    bench_write_dist(f, label, lat, misses);
                 }
-                else ++it;
             }
+        }
+        gm_audio_set_load_mode(0.0);
+        bench_write_rt(f, rt0);
+        fclose(f);
+        remove(impulse.c_str());
+        return 1.0;
+    }
 
-            for (auto& ev : gSong.events) {
-                if (!ev.active) continue;
 
-                // Mientras estemos alcanzando instantes programados, dispara y programa el siguiente ciclo
-                while (beat + 1e-6 >= ev.nextBeat) {
-                    // Tocar
-                    if (ev.sound) {
-                        ma_sound_seek_to_pcm_frame(ev.sound, 0);
-                        ma_sound_start(ev.sound);
-                    }
-                    else {
-                        size_t pnote = ev.path.find("|NOTE:");
-                        if (pnote != std::string::npos) {
-                            std::string filePart = ev.path.substr(0, pnote);
-                            std::string notePart;
-                            double baseNote = 60.0;
-                            double tuningHz = 440.0;
-                            size_t pbase = ev.path.find("|BASE:", pnote);
-                            size_t ptun = ev.path.find("|TUN:", pnote);
-                            if (pbase != std::string::npos) {
-                                notePart = ev.path.substr(pnote + 6, pbase - (pnote + 6));
-                                if (ptun != std::string::npos) {
-                                    baseNote = std::stod(ev.path.substr(pbase + 6, ptun - (pbase + 6)));
-                                    tuningHz = std::stod(ev.path.substr(ptun + 5));
-                                }
-                                else {
-                                    baseNote = std::stod(ev.path.substr(pbase + 6));
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // PRECISION DE CUANTIZACION
+    // - render offline de secuencias a varios bpm, frecuencias de tick (30/60/144 Hz y 60 Hz con jitter)
+    //   y con/sin cambio de tempo (x1.25 en el beat 16)
+    // - fuentes: play_on_beat (un impulso por beat, pedido a mitad del beat anterior) y una cancion
+    //   JSON con un impulso en cada beat del compas
+    // - los onsets se detectan en la salida; el error es onset - frame ideal del beat mas cercano
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    struct OnsetCollector {
+        std::vector<long long> onsets;   // reservado antes de renderizar: el tap no reserva memoria
+        long long lastLoud = -1000000;
+    };
+
+    static void onset_collect_proc(void* pUserData, const float* pFrames, ma_uint64 frameCount, ma_uint32 channels) {
+        OnsetCollector* oc = (OnsetCollector*)pUserData;
+        const long long blockStart = (long long)(ma_engine_get_time_in_pcm_frames(&gEngine) - frameCount);
+        for (ma_uint64 i = 0; i < frameCount; ++i) {
+            bool loud = false;
+            for (ma_uint32 c = 0; c < channels && !loud; ++c) loud = std::fabs(pFrames[i * channels + c]) > 1e-4f;
+            if (!loud) continue;
+            const long long frame = blockStart + (long long)i;
+            if (frame - oc->lastLoud > 256 && oc->onsets.size() < oc->onsets.capacity()) oc->onsets.push_back(frame);
+            oc->lastLoud = frame;
+        }
+    }
+
+
+    // Ejecuta el benchmark de cuantizacion y escribe el informe en reportPath
+    // Necesita el engine parado (usa su propio engine offline). Devuelve el error absoluto medio (frames)
+    // o -1 si falla
+    __declspec(dllexport) double gm_audio_bench_quantization(const char* reportPath) {
+        if (reportPath == nullptr || gEngineIniciado) return -1.0;
+        RecMute mute;
+        const ma_uint32 sr = 48000;
+        const ma_uint32 block = 256;
+        const double beatsPerRun = 32.0;
+        const double changeAt = 16.0;
+
+        const std::string impulse = std::string(reportPath) + ".impulse.wav";
+        const std::string songJson = std::string(reportPath) + ".song.json";
+        if (!bench_write_impulse_wav(impulse, sr, sr / 20)) return -1.0;
+        {
+            FILE* js = fopen(songJson.c_str(), "w");
+            if (!js) return -1.0;
+            const std::string file = impulse.substr(path_dirname(impulse).size());
+            fprintf(js, "{ \"beatsPerBar\": 4, \"bars\": 1, \"loop\": true, \"events\": [\n");
+            for (int b = 0; b < 4; ++b) fprintf(js, "  { \"file\": \"%s\", \"beat\": %d.0 }%s\n", file.c_str(), b, b < 3 ? "," : "");
+            fprintf(js, "] }\n");
+            fclose(js);
+        }
+
+        FILE* f = fopen(reportPath, "w");
+        if (!f) return -1.0;
+        fprintf(f, "gm_audio quantization benchmark (error en frames @ %u Hz, bloque %u, %g beats por secuencia)\n", sr, block, beatsPerRun);
+        const RtSnapshot rt0 = rt_snapshot();
+
+        static const double kBpms[] = { 90.0, 120.0, 174.0 };
+        static const double kTicks[] = { 30.0, 60.0, 144.0, -60.0 };   // negativo = 60 Hz con jitter de +-4 ms
+        OnsetCollector oc;
+        oc.onsets.reserve(4096);
+        std::mt19937 rng(7u);
+        double absSum = 0.0;
+        size_t absCount = 0;
+
+        for (double bpm : kBpms) {
+            for (double tickHz : kTicks) {
+                for (int source = 0; source < 2; ++source) {
+                    for (int change = 0; change < 2; ++change) {
+                        if (gm_audio_init_offline((double)sr, 2.0) == 0.0) { fclose(f); return -1.0; }
+                        oc.onsets.clear();
+                        oc.lastLoud = -1000000;
+                        gCaptureTapUserData = &oc;
+                        gCaptureTap.store(onset_collect_proc, std::memory_order_release);
+                        gm_audio_set_tempo(bpm);
+                        if (source == 1 && gm_audio_song_load_file(songJson.c_str()) == 0.0) {
+                            gCaptureTap.store(nullptr);
+                            gm_audio_shutdown();
+                            fclose(f);
+                            return -1.0;
+                        }
+                        gm_audio_transport_play();
+
+                        const double frame0 = (double)ma_engine_get_time_in_pcm_frames(&gEngine);
+                        const double fpb1 = (double)sr * 60.0 / bpm;
+                        const double fpb2 = fpb1 / 1.25;
+                        double changeBeat = 1e300, changeFrame = 0.0;
+                        auto idealFrame = [&](double b) {
+                            return (b < changeBeat) ? frame0 + b * fpb1 : changeFrame + (b - changeBeat) * fpb2;
+                        };
+                        auto beatOfFrame = [&](double fr) {
+                            const double b = (fr - frame0) / fpb1;
+                            return (b < changeBeat) ? b : changeBeat + (fr - changeFrame) / fpb2;
+                        };
+
+                        const double stepBase = (double)sr / std::fabs(tickHz);
+                        const double jitter = (tickHz < 0.0) ? 0.004 * (double)sr : 0.0;
+                        std::uniform_real_distribution<double> jit(-jitter, jitter);
+                        double nextStep = frame0;
+                        double firstBeat = 0.0;
+                        double lastIssued = -1.0;
+                        int expected = 0;
+                        bool songStarted = false;
+
+                        while (gm_audio_get_beat_position() < beatsPerRun + 1.0) {
+                            const double now = (double)ma_engine_get_time_in_pcm_frames(&gEngine);
+                            while (nextStep <= now) {
+                                const double beat = gm_audio_get_beat_position();
+                                if (change && changeBeat > 1e299 && beat >= changeAt) {
+                                    changeBeat = beat;
+                                    changeFrame = now;
+                                    gm_audio_set_tempo(bpm * 1.25);
                                 }
-                            }
-                            else {
-                                notePart = ev.path.substr(pnote + 6);
-                            }
-                            double vel = ev.vel;
-                            int midi = note_name_to_midi(notePart);
-                            if (midi >= 0) {
-                                double delta = (double)midi - baseNote;
-                                double pitch = pitch_from_semitones(delta, 0.0);
-                                ma_sound* v = new ma_sound();
-                                if (ma_sound_init_from_file(&gEngine, filePart.c_str(), 0, NULL, NULL, v) == MA_SUCCESS) {
-                                    ma_sound_set_volume(v, (float)vel);
-                                    ma_sound_set_pitch(v, (float)pitch);
-                                    ma_sound_start(v);
-                                    gActiveVoices.push_back(ActiveVoice{ v, makeId() });
-                                    if (ev.dur > 1e-9) {
-                                        double voiceEndBeat = beat + ev.dur;
-                                        gPendingStops.push_back(PendingStop{ v, voiceEndBeat });
+                                if (source == 0) {
+                                    const double fl = std::floor(beat);
+                                    if (fl > lastIssued && beat - fl >= 0.5 && fl + 1.0 <= beatsPerRun) {
+                                        gm_audio_play_on_beat(impulse.c_str(), 1.0);
+                                        lastIssued = fl;
+                                        ++expected;
                                     }
                                 }
-                                else {
-                                    delete v;
+                                else if (!songStarted) {
+                                    firstBeat = std::ceil(beat);
+                                    gm_audio_song_play();
+                                    songStarted = true;
                                 }
+                                gm_audio_transport_tick();
+                                nextStep += (std::max)(1.0, stepBase + jit(rng));
                             }
+                            gm_audio_render((double)block);
                         }
+                        if (source == 1) expected = (int)(beatsPerRun - firstBeat) + 1;
+
+                        gCaptureTap.store(nullptr, std::memory_order_release);
+                        gm_audio_shutdown();
+
+                        std::vector<double> errs;
+                        for (long long on : oc.onsets) {
+                            const double b = std::round(beatOfFrame((double)on));
+                            if (b > beatsPerRun) continue;
+                            const double e = (double)on - idealFrame(b);
+                            errs.push_back(e);
+                            absSum += std::fabs(e);
+                            ++absCount;
+                        }
+                        char label[128];
+                        char tickName[16];
+                        if (tickHz < 0.0) snprintf(tickName, sizeof(tickName), "%gj", -tickHz);
+                        else snprintf(tickName, sizeof(tickName), "%g", tickHz);
+                        snprintf(label, sizeof(label), "bpm=%-5g tick=%-4s src=%-12s tempo=%-6s", bpm, tickName,
+                            source == 0 ? "play_on_beat" : "song", change ? "change" : "const");
+                        bench_write_dist(f, label, errs, (std::max)(0, expected - (int)errs.size()));
                     }
-
-                    // Programar proximo
-                    ev.nextBeat += gSong.beatsPerBar;
-
-                    // Si no hay loop y nos pasamos del final de la cancion, desactivamos este evento
-                    if (!gSong.loop && (ev.nextBeat - gSong.startBeat) >= songLenBeats + 1e-6) {
-                        ev.active = false;
-                        break;
-                    }
-                }
-            }
-        }
-
-        // Procesar destruccin diferida de ma_sound
-        if (!gPendingDelete.empty()) {
-            for (ma_sound* s : gPendingDelete) {
-                if (s) {
-                    ma_sound_stop(s);
-                    ma_sound_uninit(s);
-                    delete s;
                 }
             }
-            gPendingDelete.clear();
         }
-
-        return 1.0;
+        const double meanAbs = absCount ? absSum / (double)absCount : 0.0;
+        fprintf(f, "mean_abs_error=%.2f frames (%.3f ms)\n", meanAbs, meanAbs * 1000.0 / (double)sr);
+        bench_write_rt(f, rt0);
+        fclose(f);
+        remove(impulse.c_str());
+        remove(songJson.c_str());
+        return meanAbs;
     }
 
 
 
 
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // COMPROBACION DEL ARRANQUE A MITAD DE BLOQUE
+    // - comprueba patches/miniaudio-node-start-offset.patch: un sonido con start y stop time dentro
+    //   de un bloque del engine tiene que sonar desde el frame exacto de su start y callarse en el de
+    //   su stop (miniaudio sin el parche lo arranca en el siguiente bloque)
+    // - la fuente es un buffer en memoria de continua, sin archivos, y la salida se mira en el tap
+    ////////////////////////////////////////////////////////////////////////////////////////
 
-    // Carga una cancion desde JSON (ruta en disco). Pre-carga los wav como ma_sound.
-    __declspec(dllexport) double gm_audio_song_load_file(const char* pathJson) {
-        if (!gEngineIniciado || pathJson == nullptr) return 0.0;
-        std::lock_guard<std::mutex> lock(gMutex);
-        std::string txt;
-        if (!readTextFile(pathJson, txt)) return 0.0;
-        std::string baseDir = path_dirname(pathJson);
+    struct SpanTap {
+        long long first = -1;   // primer y ultimo frame del engine con senal
+        long long last = -1;
+    };
 
+    static void span_tap_proc(void* pUserData, const float* pFrames, ma_uint64 frameCount, ma_uint32 channels) {
+        SpanTap* st = (SpanTap*)pUserData;
+        const long long blockStart = (long long)(ma_engine_get_time_in_pcm_frames(&gEngine) - frameCount);
+        for (ma_uint64 i = 0; i < frameCount; ++i) {
+            if (std::fabs(pFrames[i * channels]) <= 1e-4f) continue;
+            if (st->first < 0) st->first = blockStart + (long long)i;
+            st->last = blockStart + (long long)i;
+        }
+    }
 
-        // Parametros por defecto
-        int beatsPerBar = 4;
-        int bars = 1;
-        bool loop = true;
-        json_extract_int(txt, "beatsPerBar", beatsPerBar);
-        json_extract_int(txt, "bars", bars);
-        json_extract_bool(txt, "loop", loop);
 
-        double parsedBpm;
-        if (json_extract_bpm(txt, parsedBpm) && parsedBpm > 0.0) {
-            double current = transport_get_beat_unlocked();
-            gTransport.bpm.store(parsedBpm);
-            if (gTransport.playing.load()) {
-                gTransport.baseBeat = current;
-                gTransport.startTime = std::chrono::high_resolution_clock::now();
-            }
-            else {
-                gTransport.baseBeat = 0.0;
-            }
+    // Necesita el engine parado (usa su propio engine offline). Devuelve el error maximo en frames
+    // del primer y el ultimo frame que suenan (0 = exacto) o -1 si falla o no llega a sonar
+    __declspec(dllexport) double gm_audio_check_start_offset() {
+        if (gEngineIniciado) return -1.0;
+        const ma_uint32 sr = 48000;
+        const ma_uint32 block = 256;
+        if (gm_audio_init_offline((double)sr, 2.0) == 0.0) return -1.0;
+
+        std::vector<float> dc(sr / 10, 0.5f);
+        ma_audio_buffer_config bc = ma_audio_buffer_config_init(ma_format_f32, 1, dc.size(), dc.data(), NULL);
+        bc.sampleRate = sr;
+        ma_audio_buffer buf;
+        if (ma_audio_buffer_init(&bc, &buf) != MA_SUCCESS) {
+            gm_audio_shutdown();
+            return -1.0;
         }
+        // sin pitch: el resampler lineal del sonido retrasa la salida un frame y aqui solo se mide el nodo
+        ma_sound s;
+        if (ma_sound_init_from_data_source(&gEngine, &buf, MA_SOUND_FLAG_NO_SPATIALIZATION | MA_SOUND_FLAG_NO_PITCH, NULL, &s) != MA_SUCCESS) {
+            ma_audio_buffer_uninit(&buf);
+            gm_audio_shutdown();
+            return -1.0;
+        }
+        // start y stop a mitad de bloques distintos
+        const ma_uint64 start = ma_engine_get_time_in_pcm_frames(&gEngine) + 3 * block + 101;
+        const ma_uint64 stop = start + 5 * block + 37;
+        ma_sound_set_start_time_in_pcm_frames(&s, start);
+        ma_sound_set_stop_time_in_pcm_frames(&s, stop);
+        ma_sound_start(&s);
+
+        SpanTap st;
+        gCaptureTapUserData = &st;
+        gCaptureTap.store(span_tap_proc, std::memory_order_release);
+        while (ma_engine_get_time_in_pcm_frames(&gEngine) < stop + 2 * block) gm_audio_render((double)block);
+        gCaptureTap.store(nullptr, std::memory_order_release);
+
+        ma_sound_uninit(&s);
+        ma_audio_buffer_uninit(&buf);
+        gm_audio_shutdown();
+        if (st.first < 0) return -1.0;
+        const double errBeg = std::fabs((double)st.first - (double)start);
+        const double errEnd = std::fabs((double)(st.last + 1) - (double)stop);
+        return (std::max)(errBeg, errEnd);
+    }
 
-        std::vector<SongEvent> evs;
-        if (!json_extract_events(txt, evs)) return 0.0;
 
-        // Liberar cancion previa
-        for (auto& ev : gSong.events) {
-            if (ev.sound) {
-                schedule_sound_delete(ev.sound);
-                ev.sound = nullptr;
-            }
-        }
-        gSong = Song{};
 
-        std::regex reInstr(R"("instrument"\s*:\s*\{\s*\"file\"\s*:\s*\"([^\"]+)\"(?:\s*,\s*\"baseNote\"\s*:\s*([-]?\d+))?(?:\s*,\s*\"tuningHz\"\s*:\s*([0-9.]+))?)", std::regex::icase);
-        std::smatch mInstr;
-        std::string globalInstrFile;
-        int globalBaseNote = 60;
-        double globalTuningHz = 440.0;
-        if (std::regex_search(txt, mInstr, reInstr)) {
-            if (mInstr.size() >= 2 && mInstr[1].matched) globalInstrFile = mInstr[1].str();
-            if (mInstr.size() >= 3 && mInstr[2].matched) globalBaseNote = std::stoi(mInstr[2].str());
-            if (mInstr.size() >= 4 && mInstr[3].matched) globalTuningHz = std::stod(mInstr[3].str());
-        }
 
-        std::vector<SongEvent> loadedEvents;
-        loadedEvents.reserve(evs.size());
-
-        for (auto& ev : evs) {
-            if (ev.path.rfind("NOTE:", 0) == 0) {
-                std::string noteTail = ev.path.substr(5);
-                std::string noteStr;
-                double vel = 1.0;
-                size_t pvel = noteTail.find("|vel=");
-                if (pvel != std::string::npos) {
-                    noteStr = noteTail.substr(0, pvel);
-                    try { vel = std::stod(noteTail.substr(pvel + 5)); }
-                    catch (...) { vel = 1.0; }
-                }
-                else {
-                    noteStr = noteTail;
-                }
-                SongEvent sev;
-                sev.sound = nullptr;
-                sev.offsetBeat = ev.offsetBeat;
-                sev.active = true;
-                sev.dur = ev.dur;
-                sev.vel = (float)vel;
-                if (globalInstrFile.empty()) {
-                    for (auto& le : loadedEvents) {
-                        if (le.sound) { schedule_sound_delete(le.sound); le.sound = nullptr; }
-                    }
-                    return 0.0;
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // COMPROBACION DE LAS CONSULTAS DE CHART
+    // - compara chart_visible con un recorrido de todas las notas en charts hechos para el peor caso
+    //   del indice de notas largas: muchas largas cortas debajo de una que dura todo el chart, largas
+    //   anidadas (todas siguen dentro de la ventana) y largas sueltas entre notas simples
+    // - cada consulta tiene que expandir como mucho 2k + 1 rangos de notas largas (k las devueltas):
+    //   lo que no llega a la ventana no se recorre
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // No necesita el engine. Devuelve el numero de consultas con un resultado distinto del recorrido o
+    // que miran mas rangos de la cuenta (0 = ok)
+    __declspec(dllexport) double gm_audio_check_chart_query() {
+        MutexGuard lock;
+        const int notes = 20000;
+        std::mt19937 rng(95u);
+        std::vector<Chart> charts(4);
+        // 0: una larga de todo el chart y debajo largas de medio beat
+        chart_push_note(charts[0], 0, 0.0, (double)notes);
+        for (int i = 1; i < notes; ++i) chart_push_note(charts[0], 0, (double)i, 0.5);
+        // 1: largas anidadas, cada una acaba despues de la siguiente
+        for (int i = 0; i < notes; ++i) chart_push_note(charts[1], 0, (double)i, 2.0 * (notes - i));
+        // 2: varios carriles con largas sueltas entre simples
+        for (int i = 0; i < notes; ++i) {
+            const bool hold = (rng() % 8) == 0;
+            chart_push_note(charts[2], (int)(rng() % 4), i * 0.25, hold ? (double)(rng() % 64) : 0.0);
+        }
+        for (int i = 0; i < 3; ++i) chart_finalize(charts[i]);
+        // 3: como el 0 (mas corto) insertando nota a nota y desordenado: el indice se rehace por partes
+        std::vector<int> order(notes / 10);
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), rng);
+        for (int i : order) chart_add_note(charts[3], 0, (double)i, (i == 0) ? (double)order.size() : 0.5);
+
+        int bad = 0;
+        for (const Chart& c : charts) {
+            for (int q = 0; q < 2000; ++q) {
+                const double from = std::uniform_real_distribution<double>(-2.0, notes + 2.0)(rng);
+                const double to = from + std::uniform_real_distribution<double>(0.0, 16.0)(rng);
+                std::vector<const ChartNote*> got, want;
+                chart_visible(c, from, to, [&](int, const ChartNote& n) { got.push_back(&n); return true; });
+                for (const ChartLane& l : c.lanes) {
+                    for (const ChartNote& n : l.notes)
+                        if (n.beat < from && n.beat < to && n.beat + n.length >= from) want.push_back(&n);
+                    for (const ChartNote& n : l.notes)
+                        if (n.beat >= from && n.beat < to) want.push_back(&n);
                 }
-                std::string instrFullPath = path_join(baseDir, globalInstrFile);
-                std::ostringstream meta;
-                meta << instrFullPath << "|NOTE:" << noteStr << "|BASE:" << globalBaseNote << "|TUN:" << globalTuningHz;
-                sev.path = meta.str();
-                loadedEvents.push_back(sev);
-            }
-            else {
-                ma_sound* s = new ma_sound();
-                std::string fullPath = path_join(baseDir, ev.path);
-                if (ma_sound_init_from_file(&gEngine, fullPath.c_str(), 0, NULL, NULL, s) != MA_SUCCESS) {
-                    delete s;
-                    for (auto& le : loadedEvents) {
-                        if (le.sound) { schedule_sound_delete(le.sound); le.sound = nullptr; }
-                    }
-                    return 0.0;
+                bool ok = (got == want);
+                for (const ChartLane& l : c.lanes) {
+                    size_t expanded = 0, k = 0;
+                    chart_lane_long(l, from, to, [&](const ChartNote&) { ++k; return true; }, &expanded);
+                    ok = ok && expanded <= 2 * k + 1;
                 }
-                SongEvent sev;
-                sev.path = fullPath;
-                sev.sound = s;
-                sev.offsetBeat = ev.offsetBeat;
-                sev.nextBeat = 0.0;
-                sev.dur = ev.dur;
-                sev.vel = ev.vel;
-                sev.active = true;
-                loadedEvents.push_back(sev);
+                if (!ok) ++bad;
             }
         }
+        return (double)bad;
+    }
 
-        gSong.loaded = true;
-        gSong.loop = loop;
-        gSong.beatsPerBar = (beatsPerBar > 0) ? beatsPerBar : 4;
-        gSong.bars = (bars > 0) ? bars : 1;
-        gSong.events = std::move(loadedEvents);
+
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // RECORD / REPLAY
+    // - record_start/stop: graba las llamadas a un archivo binario (ver formato arriba)
+    // - replay_file: ejecuta la grabacion contra el engine ya iniciado (normalmente el offline)
+    //   init/shutdown no se reproducen: el engine lo controla quien hace el replay
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Empieza a grabar en path (sobrescribe). Devuelve 1 si ok
+    __declspec(dllexport) double gm_audio_record_start(const char* path) {
+        if (path == nullptr) return 0.0;
+        std::lock_guard<std::mutex> lock(gRecMutex);
+        if (gRecFile) {
+            rec_flush_unlocked();
+            fclose(gRecFile);
+            gRecFile = nullptr;
+        }
+        gRecFile = fopen(path, "wb");
+        if (!gRecFile) return 0.0;
+        gRecBuf.clear();
+        gRecSeq = 0;
+        gRecT0 = std::chrono::steady_clock::now();
+        rec_put("GMAR", 4);
+        rec_put(&kRecVersion, 4);
+        gRecOn.store(true);
         return 1.0;
     }
 
-    __declspec(dllexport) double gm_audio_song_play() {
-        std::lock_guard<std::mutex> lock(gMutex);
-        if (!gEngineIniciado || !gSong.loaded) return 0.0;
-        if (!gTransport.playing.load()) {
-            gTransport.startTime = std::chrono::high_resolution_clock::now();
-            gTransport.playing.store(true);
-        }
-        const double nowBeat = transport_get_beat_unlocked();
-        const double start = std::ceil(nowBeat);
-        gSong.startBeat = start;
-        for (auto& ev : gSong.events) {
-            ev.active = true;
-            ev.nextBeat = gSong.startBeat + ev.offsetBeat;
-        }
+
+    // Termina la grabacion y cierra el archivo
+    __declspec(dllexport) double gm_audio_record_stop() {
+        std::lock_guard<std::mutex> lock(gRecMutex);
+        gRecOn.store(false);
+        if (!gRecFile) return 0.0;
+        rec_flush_unlocked();
+        fclose(gRecFile);
+        gRecFile = nullptr;
         return 1.0;
     }
 
 
+    // Tabla de replay: firma de argumentos (d numero, h handle a remapear, s cadena)
+    struct ReplayArg {
+        double d = 0.0;
+        std::string s;
+    };
 
+    struct ReplayEntry {
+        ma_uint8 op;
+        const char* sig;
+        bool retHandle;
+        double (*call)(const ReplayArg* a);
+    };
 
-    // Para o limpia el estado de la cancion
-    __declspec(dllexport) double gm_audio_song_stop() {
-        std::lock_guard<std::mutex> lock(gMutex);
-        if (!gSong.loaded) return 1.0;
-        for (auto& ev : gSong.events) {
-            if (ev.sound) ma_sound_stop(ev.sound);
-            ev.active = false;
-            ev.nextBeat = 0.0;
+    static const ReplayEntry kReplayTable[] = {
+        { REC_PLAY,                        "s",      true,  [](const ReplayArg* a) { return gm_audio_play(a[0].s.c_str()); } },
+        { REC_STOP,                        "h",      false, [](const ReplayArg* a) { return gm_audio_stop(a[0].d); } },
+        { REC_PAUSE,                       "h",      false, [](const ReplayArg* a) { return gm_audio_pause(a[0].d); } },
+        { REC_RESUME,                      "h",      false, [](const ReplayArg* a) { return gm_audio_resume(a[0].d); } },
+        { REC_SET_VOLUME,                  "hd",     false, [](const ReplayArg* a) { return gm_audio_set_volume(a[0].d, a[1].d); } },
+        { REC_SET_LOOP,                    "hd",     false, [](const ReplayArg* a) { return gm_audio_set_loop(a[0].d, a[1].d); } },
+        { REC_SET_LOAD_MODE,               "d",      false, [](const ReplayArg* a) { return gm_audio_set_load_mode(a[0].d); } },
+        { REC_TRANSPORT_PLAY,              "",       false, [](const ReplayArg*) { return gm_audio_transport_play(); } },
+        { REC_TRANSPORT_PAUSE,             "",       false, [](const ReplayArg*) { return gm_audio_transport_pause(); } },
+        { REC_TRANSPORT_STOP,              "",       false, [](const ReplayArg*) { return gm_audio_transport_stop(); } },
+        { REC_SET_TEMPO,                   "d",      false, [](const ReplayArg* a) { return gm_audio_set_tempo(a[0].d); } },
+        { REC_GET_BEAT,                    "",       false, [](const ReplayArg*) { return gm_audio_get_beat_position(); } },
+        { REC_LOAD_PRESET,                 "s",      false, [](const ReplayArg* a) { return gm_audio_load_preset_file(a[0].s.c_str()); } },
+        { REC_PLAY_ON_BEAT,                "sd",     true,  [](const ReplayArg* a) { return gm_audio_play_on_beat(a[0].s.c_str(), a[1].d); } },
+        { REC_TICK,                        "",       false, [](const ReplayArg*) { return gm_audio_transport_tick(); } },
+        { REC_SONG_LOAD,                   "s",      false, [](const ReplayArg* a) { return gm_audio_song_load_file(a[0].s.c_str()); } },
+        { REC_SONG_PLAY,                   "",       false, [](const ReplayArg*) { return gm_audio_song_play(); } },
+        { REC_SONG_STOP,                   "",       false, [](const ReplayArg*) { return gm_audio_song_stop(); } },
+        { REC_SONG_SET_LOOP,               "d",      false, [](const ReplayArg* a) { return gm_audio_song_set_loop(a[0].d); } },
+        { REC_TRANSPORT_CREATE,            "",       true,  [](const ReplayArg*) { return gm_audio_transport_create(); } },
+        { REC_TRANSPORT_DESTROY,           "h",      false, [](const ReplayArg* a) { return gm_audio_transport_destroy(a[0].d); } },
+        { REC_TRANSPORT_PLAY_H,            "h",      false, [](const ReplayArg* a) { return gm_audio_transport_play_h(a[0].d); } },
+        { REC_TRANSPORT_PAUSE_H,           "h",      false, [](const ReplayArg* a) { return gm_audio_transport_pause_h(a[0].d); } },
+        { REC_TRANSPORT_STOP_H,            "h",      false, [](const ReplayArg* a) { return gm_audio_transport_stop_h(a[0].d); } },
+        { REC_TRANSPORT_SET_TEMPO_H,       "hd",     false, [](const ReplayArg* a) { return gm_audio_transport_set_tempo_h(a[0].d, a[1].d); } },
+        { REC_TRANSPORT_GET_BEAT_H,        "h",      false, [](const ReplayArg* a) { return gm_audio_transport_get_beat_h(a[0].d); } },
+        { REC_TRANSPORT_TEMPO_POINT_H,     "hdd",    false, [](const ReplayArg* a) { return gm_audio_transport_tempo_point_h(a[0].d, a[1].d, a[2].d); } },
+        { REC_TRANSPORT_CLEAR_TEMPO_MAP_H, "h",      false, [](const ReplayArg* a) { return gm_audio_transport_clear_tempo_map_h(a[0].d); } },
+        { REC_PLAY_ON_BEAT_H,              "hsd",    true,  [](const ReplayArg* a) { return gm_audio_play_on_beat_h(a[0].d, a[1].s.c_str(), a[2].d); } },
+        { REC_SONG_SET_TRANSPORT,          "h",      false, [](const ReplayArg* a) { return gm_audio_song_set_transport(a[0].d); } },
+        { REC_SONG_CREATE,                 "sh",     true,  [](const ReplayArg* a) { return gm_audio_song_create(a[0].s.c_str(), a[1].d); } },
+        { REC_SONG_DESTROY,                "h",      false, [](const ReplayArg* a) { return gm_audio_song_destroy(a[0].d); } },
+        { REC_SONG_PLAY_H,                 "h",      false, [](const ReplayArg* a) { return gm_audio_song_play_h(a[0].d); } },
+        { REC_SONG_STOP_H,                 "h",      false, [](const ReplayArg* a) { return gm_audio_song_stop_h(a[0].d); } },
+        { REC_SONG_SET_LOOP_H,             "hd",     false, [](const ReplayArg* a) { return gm_audio_song_set_loop_h(a[0].d, a[1].d); } },
+        { REC_SONG_SET_MUTE_H,             "hd",     false, [](const ReplayArg* a) { return gm_audio_song_set_mute_h(a[0].d, a[1].d); } },
+        { REC_SONG_SET_VOLUME_H,           "hd",     false, [](const ReplayArg* a) { return gm_audio_song_set_volume_h(a[0].d, a[1].d); } },
+        { REC_SONG_SET_TRANSPORT_H,        "hh",     false, [](const ReplayArg* a) { return gm_audio_song_set_transport_h(a[0].d, a[1].d); } },
+        { REC_STEMS_CREATE,                "",       true,  [](const ReplayArg*) { return gm_audio_stems_create(); } },
+        { REC_STEMS_ADD,                   "hsdd",   false, [](const ReplayArg* a) { return gm_audio_stems_add(a[0].d, a[1].s.c_str(), a[2].d, a[3].d); } },
+        { REC_STEMS_SET_CURVE,             "hddddd", false, [](const ReplayArg* a) { return gm_audio_stems_set_curve(a[0].d, a[1].d, a[2].d, a[3].d, a[4].d, a[5].d); } },
+        { REC_STEMS_PLAY,                  "h",      false, [](const ReplayArg* a) { return gm_audio_stems_play(a[0].d); } },
+        { REC_STEMS_STOP,                  "h",      false, [](const ReplayArg* a) { return gm_audio_stems_stop(a[0].d); } },
+        { REC_STEMS_SET_INTENSITY,         "hdd",    false, [](const ReplayArg* a) { return gm_audio_stems_set_intensity(a[0].d, a[1].d, a[2].d); } },
+        { REC_STEMS_DESTROY,               "h",      false, [](const ReplayArg* a) { return gm_audio_stems_destroy(a[0].d); } },
+        { REC_SET_LOOKAHEAD,               "d",      false, [](const ReplayArg* a) { return gm_audio_set_lookahead(a[0].d); } },
+        { REC_SONG_PLAY_QUANTIZED_H,       "hd",     false, [](const ReplayArg* a) { return gm_audio_song_play_quantized_h(a[0].d, a[1].d); } },
+        { REC_SONG_TRANSITION_H,           "hhd",    false, [](const ReplayArg* a) { return gm_audio_song_transition_h(a[0].d, a[1].d, a[2].d); } },
+        { REC_SONG_STINGER_H,              "hs",     false, [](const ReplayArg* a) { return gm_audio_song_stinger_h(a[0].d, a[1].s.c_str()); } },
+        { REC_TRANSPORT_SEEK,              "d",      false, [](const ReplayArg* a) { return gm_audio_transport_seek(a[0].d); } },
+        { REC_TRANSPORT_SEEK_H,            "hd",     false, [](const ReplayArg* a) { return gm_audio_transport_seek_h(a[0].d, a[1].d); } },
+        { REC_SET_LOOP_POINTS,             "hdd",    false, [](const ReplayArg* a) { return gm_audio_set_loop_points(a[0].d, a[1].d, a[2].d); } },
+        { REC_SET_LOOP_POINTS_BEATS,       "hddd",   false, [](const ReplayArg* a) { return gm_audio_set_loop_points_beats(a[0].d, a[1].d, a[2].d, a[3].d); } },
+        { REC_PLAYLIST_CREATE,             "",       true,  [](const ReplayArg*) { return gm_audio_playlist_create(); } },
+        { REC_PLAYLIST_ADD,                "hs",     false, [](const ReplayArg* a) { return gm_audio_playlist_add(a[0].d, a[1].s.c_str()); } },
+        { REC_PLAYLIST_PLAY,               "h",      false, [](const ReplayArg* a) { return gm_audio_playlist_play(a[0].d); } },
+        { REC_PLAYLIST_STOP,               "h",      false, [](const ReplayArg* a) { return gm_audio_playlist_stop(a[0].d); } },
+        { REC_PLAYLIST_SET_CROSSFADE,      "hd",     false, [](const ReplayArg* a) { return gm_audio_playlist_set_crossfade(a[0].d, a[1].d); } },
+        { REC_PLAYLIST_SET_LOOP,           "hd",     false, [](const ReplayArg* a) { return gm_audio_playlist_set_loop(a[0].d, a[1].d); } },
+        { REC_PLAYLIST_DESTROY,            "h",      false, [](const ReplayArg* a) { return gm_audio_playlist_destroy(a[0].d); } },
+        { REC_PLAYLIST_GET_TRACK,          "h",      false, [](const ReplayArg* a) { return gm_audio_playlist_get_track(a[0].d); } },
+        { REC_MUSIC_TRANSITION,            "sdd",    false, [](const ReplayArg* a) { return gm_audio_music_transition(a[0].s.c_str(), a[1].d, a[2].d); } },
+        { REC_MUSIC_STOP,                  "dd",     false, [](const ReplayArg* a) { return gm_audio_music_stop(a[0].d, a[1].d); } },
+        { REC_PATTERN_CREATE,              "ddh",    true,  [](const ReplayArg* a) { return gm_audio_pattern_create(a[0].d, a[1].d, a[2].d); } },
+        { REC_PATTERN_SET_STEP,            "hdsd",   false, [](const ReplayArg* a) { return gm_audio_pattern_set_step(a[0].d, a[1].d, a[2].s.c_str(), a[3].d); } },
+        { REC_PATTERN_CLEAR_STEP,          "hd",     false, [](const ReplayArg* a) { return gm_audio_pattern_clear_step(a[0].d, a[1].d); } },
+        { REC_PATTERN_SET_VELOCITY,        "hdd",    false, [](const ReplayArg* a) { return gm_audio_pattern_set_velocity(a[0].d, a[1].d, a[2].d); } },
+        { REC_AUTOMATION_CREATE,           "hsh",    true,  [](const ReplayArg* a) { return gm_audio_automation_create(a[0].d, a[1].s.c_str(), a[2].d); } },
+        { REC_AUTOMATION_ADD_POINT,        "hddddd", false, [](const ReplayArg* a) { return gm_audio_automation_add_point(a[0].d, a[1].d, a[2].d, a[3].d, a[4].d, a[5].d); } },
+        { REC_AUTOMATION_SET_LOOP,         "hd",     false, [](const ReplayArg* a) { return gm_audio_automation_set_loop(a[0].d, a[1].d); } },
+        { REC_AUTOMATION_CLEAR,            "h",      false, [](const ReplayArg* a) { return gm_audio_automation_clear(a[0].d); } },
+        { REC_AUTOMATION_DESTROY,          "h",      false, [](const ReplayArg* a) { return gm_audio_automation_destroy(a[0].d); } },
+        { REC_LFO_CREATE,                  "hsh",    true,  [](const ReplayArg* a) { return gm_audio_lfo_create(a[0].d, a[1].s.c_str(), a[2].d); } },
+        { REC_LFO_SET,                     "hdddd",  false, [](const ReplayArg* a) { return gm_audio_lfo_set(a[0].d, a[1].d, a[2].d, a[3].d, a[4].d); } },
+        { REC_LFO_SET_PHASE,               "hd",     false, [](const ReplayArg* a) { return gm_audio_lfo_set_phase(a[0].d, a[1].d); } },
+        { REC_LFO_DESTROY,                 "h",      false, [](const ReplayArg* a) { return gm_audio_lfo_destroy(a[0].d); } },
+        { REC_SET_LOWPASS,                 "hd",     false, [](const ReplayArg* a) { return gm_audio_set_lowpass(a[0].d, a[1].d); } },
+        { REC_CHART_CREATE,                "",       true,  [](const ReplayArg*) { return gm_audio_chart_create(); } },
+        { REC_CHART_ADD_NOTE,              "hddd",   false, [](const ReplayArg* a) { return gm_audio_chart_add_note(a[0].d, a[1].d, a[2].d, a[3].d); } },
+        { REC_CHART_DESTROY,               "h",      false, [](const ReplayArg* a) { return gm_audio_chart_destroy(a[0].d); } },
+        { REC_JUDGE_SET_CHART,             "hh",     false, [](const ReplayArg* a) { return gm_audio_judge_set_chart(a[0].d, a[1].d); } },
+        { REC_JUDGE_SET_WINDOWS,           "dddd",   false, [](const ReplayArg* a) { return gm_audio_judge_set_windows(a[0].d, a[1].d, a[2].d, a[3].d); } },
+        { REC_JUDGE_SET_CALIBRATION,       "d",      false, [](const ReplayArg* a) { return gm_audio_judge_set_calibration(a[0].d); } },
+        { REC_JUDGE_RESET,                 "",       false, [](const ReplayArg*) { return gm_audio_judge_reset(); } },
+        { REC_JUDGE_INPUT,                 "dd",     false, [](const ReplayArg* a) { return gm_audio_judge_input(a[0].d, a[1].d); } },
+        { REC_CHART_LOAD,                  "s",      true,  [](const ReplayArg* a) { return gm_audio_chart_load_file(a[0].s.c_str()); } },
+        { REC_CHART_SAVE,                  "hs",     false, [](const ReplayArg* a) { return gm_audio_chart_save_file(a[0].d, a[1].s.c_str()); } },
+        { REC_ANALYSIS_SET_CACHE_DIR,      "s",      false, [](const ReplayArg* a) { return gm_audio_analysis_set_cache_dir(a[0].s.c_str()); } },
+        { REC_ENVELOPE_REQUEST,            "sd",     false, [](const ReplayArg* a) { return gm_audio_envelope_request(a[0].s.c_str(), a[1].d); } },
+        { REC_TEMPO_ANALYZE,               "s",      false, [](const ReplayArg* a) { return gm_audio_tempo_analyze(a[0].s.c_str()); } },
+        { REC_TEMPO_APPLY_H,               "hs",     false, [](const ReplayArg* a) { return gm_audio_tempo_apply_h(a[0].d, a[1].s.c_str()); } },
+        { REC_DELAY_CREATE,                "h",      true,  [](const ReplayArg* a) { return gm_audio_delay_create(a[0].d); } },
+        { REC_DELAY_SET,                   "hddd",   false, [](const ReplayArg* a) { return gm_audio_delay_set(a[0].d, a[1].d, a[2].d, a[3].d); } },
+        { REC_DELAY_SET_MIX,               "hdd",    false, [](const ReplayArg* a) { return gm_audio_delay_set_mix(a[0].d, a[1].d, a[2].d); } },
+        { REC_DELAY_SEND,                  "hh",     false, [](const ReplayArg* a) { return gm_audio_delay_send(a[0].d, a[1].d); } },
+        { REC_DELAY_DESTROY,               "h",      false, [](const ReplayArg* a) { return gm_audio_delay_destroy(a[0].d); } },
+    };
+
+    static const ReplayEntry* replay_find(ma_uint8 op) {
+        for (const ReplayEntry& e : kReplayTable) {
+            if (e.op == op) return &e;
         }
-        for (auto& ps : gPendingStops) {
-            if (ps.voice) {
-                ma_sound_stop(ps.voice);
-                schedule_sound_delete(ps.voice);
-                ps.voice = nullptr;
+        return nullptr;
+    }
+
+
+    // Reproduce una grabacion contra el engine iniciado.
+    // realtime = 0: lo mas rapido posible. Con engine offline se renderiza entre llamadas
+    //               el audio que corresponde al tiempo grabado (el reloj avanza igual que en la partida)
+    // realtime = 1: respeta los tiempos grabados (duerme entre llamadas)
+    // Devuelve el numero de llamadas reproducidas o -1 si el archivo no es valido
+    __declspec(dllexport) double gm_audio_replay_file(const char* path, double realtime) {
+        if (path == nullptr || !gEngineIniciado) return -1.0;
+        std::string data;
+        if (!readTextFile(path, data)) return -1.0;
+        if (data.size() < 8 || memcmp(data.data(), "GMAR", 4) != 0) return -1.0;
+        ma_uint32 version = 0;
+        memcpy(&version, data.data() + 4, 4);
+        if (version != kRecVersion) return -1.0;
+        RecMute mute;   // las llamadas reproducidas no vuelven a grabarse
+
+        const bool rt = (realtime != 0.0);
+        const auto wallT0 = std::chrono::steady_clock::now();
+        const ma_uint64 frame0 = gEngineOffline ? ma_engine_get_time_in_pcm_frames(&gEngine) : 0;
+        const double sr = (double)ma_engine_get_sample_rate(&gEngine);
+
+        std::unordered_map<ma_uint32, double> seqToNewId;  // seq grabado -> id obtenido ahora
+        std::unordered_map<long long, double> idMap;       // id grabado -> id obtenido ahora
+        std::vector<ReplayArg> args;
+        size_t pos = 8;
+        int replayed = 0;
+
+        auto rd = [&](void* dst, size_t n) -> bool {
+            if (pos + n > data.size()) return false;
+            memcpy(dst, data.data() + pos, n);
+            pos += n;
+            return true;
+        };
+
+        while (pos < data.size()) {
+            ma_uint8 op = 0, argc = 0;
+            ma_uint32 seq = 0;
+            ma_uint64 tUs = 0;
+            if (!rd(&op, 1) || !rd(&seq, 4) || !rd(&tUs, 8) || !rd(&argc, 1)) break;
+            args.assign(argc, ReplayArg{});
+            bool ok = true;
+            for (ma_uint8 i = 0; i < argc && ok; ++i) {
+                ma_uint8 tag = 0;
+                ok = rd(&tag, 1);
+                if (!ok) break;
+                if (tag == 's') {
+                    ma_uint16 len = 0;
+                    ok = rd(&len, 2) && pos + len <= data.size();
+                    if (ok) {
+                        args[i].s.assign(data.data() + pos, len);
+                        pos += len;
+                    }
+                }
+                else {
+                    ok = rd(&args[i].d, 8);
+                }
             }
-        }
-        gPendingStops.clear();
-        for (auto& av : gActiveVoices) {
-            if (av.sound) {
-                ma_sound_stop(av.sound);
-                schedule_sound_delete(av.sound);
-                av.sound = nullptr;
+            if (!ok) break;
+
+            if (op == REC_RESULT) {
+                auto it = seqToNewId.find(seq);
+                if (it != seqToNewId.end() && argc == 1) idMap[(long long)args[0].d] = it->second;
+                continue;
+            }
+
+            // Espera (realtime) y/o avanza el audio offline hasta el instante grabado
+            if (rt) std::this_thread::sleep_until(wallT0 + std::chrono::microseconds(tUs));
+            if (gEngineOffline) {
+                const ma_uint64 target = frame0 + (ma_uint64)((double)tUs * sr / 1000000.0);
+                const ma_uint64 now = ma_engine_get_time_in_pcm_frames(&gEngine);
+                if (target > now) gm_audio_render((double)(target - now));
+            }
+
+            const ReplayEntry* e = replay_find(op);
+            if (!e || strlen(e->sig) != argc) continue;   // init/shutdown u opcodes desconocidos
+            for (ma_uint8 i = 0; i < argc; ++i) {
+                if (e->sig[i] == 'h') {
+                    auto it = idMap.find((long long)args[i].d);
+                    if (it != idMap.end()) args[i].d = it->second;
+                }
             }
+            const double r = e->call(args.data());
+            if (e->retHandle) seqToNewId[seq] = r;
+            ++replayed;
         }
-        gActiveVoices.clear();
-        return 1.0;
+        return (double)replayed;
     }
 
+} // extern "C"
 
 
 
-    // Cambia el loop de la cancion
-    __declspec(dllexport) double gm_audio_song_set_loop(double flag) {
-        std::lock_guard<std::mutex> lock(gMutex);
-        if (!gSong.loaded) return 0.0;
-        gSong.loop = (flag != 0.0);
-        return 1.0;
-    }
-
-} // extern "C"
\ No newline at end of file
+#ifdef GMAUDIO_RT_CHECK
+////////////////////////////////////////////////////////////////////////////////////////
+// new/delete globales de la DLL: cuentan las reservas hechas desde el hilo de audio
+////////////////////////////////////////////////////////////////////////////////////////
+void* operator new(size_t sz) {
+    rt_violation(gStats.rtAllocs);
+    if (void* p = malloc(sz ? sz : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t sz) {
+    rt_violation(gStats.rtAllocs);
+    if (void* p = malloc(sz ? sz : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept {
+    if (p) rt_violation(gStats.rtFrees);
+    free(p);
+}
+void operator delete[](void* p) noexcept {
+    if (p) rt_violation(gStats.rtFrees);
+    free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+    if (p) rt_violation(gStats.rtFrees);
+    free(p);
+}
+void operator delete[](void* p, size_t) noexcept {
+    if (p) rt_violation(gStats.rtFrees);
+    free(p);
+}
+#endif